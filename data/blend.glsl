@@ -0,0 +1,9 @@
+precision mediump float;
+varying vec2 vTexcoord;
+uniform sampler2D s_tex;
+uniform float alpha;
+
+void main()
+{
+    gl_FragColor = vec4(texture2D(s_tex, vTexcoord).rgb, alpha);
+}
@@ -4,12 +4,14 @@ uniform sampler2D s_ytex;
 uniform sampler2D s_utex;
 uniform sampler2D s_vtex;
 uniform float line_height;
+/* yuv to rgb conversion including the colour balance */
+uniform mat3 color_matrix;
+uniform vec3 color_offset;
 
 void main()
 {
    float y, u, v;
    float y1, y2, u1, u2, v1, v2;
-   float r, g, b;
    vec2 tmpcoord;
    vec2 tmpcoord_2;
 
@@ -29,12 +31,5 @@ void main()
    u = mix (u1, u2, 0.5);
    v = mix (v1, v2, 0.5);
 
-   y = 1.1643 * (y - 0.0625);
-   u = u - 0.5;
-   v = v - 0.5;
-
-   r = y + 1.5958 * v;
-   g = y - 0.39173 * u - 0.81290 * v;
-   b = y + 2.017 * u;
-   gl_FragColor = vec4(r, g, b, 1.0);
+   gl_FragColor = vec4(color_matrix * vec3(y, u, v) + color_offset, 1.0);
 }
@@ -0,0 +1,11 @@
+precision mediump float;
+varying vec2 vTexcoord;
+uniform sampler2D s_tex;
+uniform float alpha;
+
+void main()
+{
+    /* overlay rectangles are uploaded as BGRA bytes */
+    vec4 color = texture2D(s_tex, vTexcoord);
+    gl_FragColor = vec4(color.bgr, color.a * alpha);
+}
@@ -0,0 +1,50 @@
+#ifdef GL_FRAGMENT_PRECISION_HIGH
+precision highp float;
+#else
+precision mediump float;
+#endif
+uniform sampler2D s_tex;
+uniform vec2 size;
+
+/* packs the picture of size in s_tex into I420, four bytes per pixel of
+   the target. its rows hold the rows of Y, then two rows each of U and
+   of V, read back they are the planes one after the other */
+
+float luma(float x, float y)
+{
+    vec3 rgb = texture2D(s_tex, vec2(x + 0.5, y + 0.5) / size).rgb;
+    return dot(rgb, vec3(0.257, 0.504, 0.098)) + 0.0625;
+}
+
+/* sampled in between the 2x2 pixels, linear filtering averages them */
+vec2 chroma(float x, float y)
+{
+    vec3 rgb = texture2D(s_tex, vec2(x * 2.0 + 1.0, y * 2.0 + 1.0) /
+                         size).rgb;
+    return vec2(dot(rgb, vec3(-0.148, -0.291, 0.439)),
+                dot(rgb, vec3(0.439, -0.368, -0.071))) + 0.5;
+}
+
+void main()
+{
+    vec2 pos = floor(gl_FragCoord.xy);
+    float x = pos.x * 4.0;
+
+    if (pos.y < size.y) {
+        gl_FragColor = vec4(luma(x, pos.y), luma(x + 1.0, pos.y),
+                            luma(x + 2.0, pos.y), luma(x + 3.0, pos.y));
+    } else {
+        float row = pos.y - size.y;
+        float v = step(size.y / 4.0, row);
+        float second = step(size.x / 2.0, x);
+        float cy = (row - v * size.y / 4.0) * 2.0 + second;
+        float cx = x - second * size.x / 2.0;
+        vec2 c0 = chroma(cx, cy);
+        vec2 c1 = chroma(cx + 1.0, cy);
+        vec2 c2 = chroma(cx + 2.0, cy);
+        vec2 c3 = chroma(cx + 3.0, cy);
+
+        gl_FragColor = mix(vec4(c0.x, c1.x, c2.x, c3.x),
+                           vec4(c0.y, c1.y, c2.y, c3.y), v);
+    }
+}
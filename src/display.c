@@ -0,0 +1,737 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#define GST_USE_UNSTABLE_API
+#include <gst/gst.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include "display.h"
+
+GST_DEBUG_CATEGORY_EXTERN (gst_gles_sink_debug);
+#define GST_CAT_DEFAULT gst_gles_sink_debug
+
+/* upper limit of the render thread pool, can be overridden with the
+ * GST_GLES_RENDER_THREADS environment variable */
+#define DEFAULT_MAX_THREADS 4
+
+typedef struct _GstGLESRenderJob GstGLESRenderJob;
+
+struct _GstGLESRenderJob
+{
+    GstGLESRenderFunc func;
+    gpointer data;
+    gboolean done;
+};
+
+static GMutex default_display_lock;
+static GstGLESDisplay *default_displays[GST_GLES_WINDOW_BACKEND_COUNT];
+/* outlive the displays, so later elements can negotiate without a
+ * context. protected by default_display_lock */
+static GstGLESFeatures probed_features[GST_GLES_WINDOW_BACKEND_COUNT];
+
+/*
+ * ugly quirk, to workaround nvidia bugs
+ * the tegra driver leaves its device handles open after eglTerminate. the
+ * handles of gpu device nodes it opens while the display is initialised
+ * or a context is created are remembered, so only those are checked and
+ * closed again on teardown
+ */
+
+#define EGL_FD_DIR "/proc/self/fd"
+/* character major of the DRM device nodes */
+#define EGL_DRM_MAJOR 226
+
+/* serializes the snapshots of the open handles with the context creation
+ * they surround, and the handles remembered by the displays */
+static GMutex egl_fd_lock;
+
+/* seeing one of these enables the cleanup */
+static const gchar *egl_driver_devices[] =
+{
+    "/dev/tegra_sema",
+    "/dev/nvhost-gr2d",
+    "/dev/nvhost-gr3d",
+};
+
+/* the tegra device nodes have dynamic majors */
+static const gchar *egl_driver_prefixes[] =
+{
+    "/dev/nvhost-",
+    "/dev/nvmap",
+    "/dev/tegra_",
+};
+
+static gboolean
+egl_read_fd_target (gint dir_fd, const gchar *name, gchar *target,
+                    gsize size)
+{
+    ssize_t len;
+
+    len = readlinkat (dir_fd, name, target, size - 1);
+    if (len < 0)
+        return FALSE;
+
+    target[len] = '\0';
+    return TRUE;
+}
+
+/* numbers of all open file handles */
+static GHashTable *
+egl_list_fds (void)
+{
+    GHashTable *fds = g_hash_table_new (NULL, NULL);
+    struct dirent *entry;
+    DIR *dir;
+
+    dir = opendir (EGL_FD_DIR);
+    if (!dir) {
+        GST_WARNING ("Could not list file handles: %s", g_strerror (errno));
+        return fds;
+    }
+
+    while ((entry = readdir (dir))) {
+        if (entry->d_name[0] != '.')
+            g_hash_table_add (fds, GINT_TO_POINTER (atoi (entry->d_name)));
+    }
+
+    closedir (dir);
+    return fds;
+}
+
+/* only gpu device nodes are remembered, other threads may open files
+ * while the driver is initialised */
+static gboolean
+egl_is_driver_device (gint fd, const gchar *target)
+{
+    struct stat st;
+    guint i;
+
+    if (fstat (fd, &st) < 0 || !S_ISCHR (st.st_mode))
+        return FALSE;
+
+    if (major (st.st_rdev) == EGL_DRM_MAJOR)
+        return TRUE;
+
+    for (i = 0; i < G_N_ELEMENTS (egl_driver_prefixes); i++) {
+        if (g_str_has_prefix (target, egl_driver_prefixes[i]))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* remembers the driver handles opened since before was listed, seeing
+ * one of the tegra devices enables the cleanup. called with egl_fd_lock
+ * held */
+static void
+egl_find_driver_fds (GstGLESDisplay *display, GHashTable *before)
+{
+    gchar target[PATH_MAX];
+    struct dirent *entry;
+    DIR *dir;
+    gint fd;
+    guint i;
+
+    dir = opendir (EGL_FD_DIR);
+    if (!dir)
+        return;
+
+    while ((entry = readdir (dir))) {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        fd = atoi (entry->d_name);
+        if (fd == dirfd (dir) ||
+            g_hash_table_contains (before, GINT_TO_POINTER (fd)) ||
+            !egl_read_fd_target (dirfd (dir), entry->d_name, target,
+                                 sizeof (target)) ||
+            !egl_is_driver_device (fd, target))
+            continue;
+
+        GST_DEBUG ("Driver opened file handle %d: %s", fd, target);
+        g_hash_table_insert (display->driver_fds, GINT_TO_POINTER (fd),
+                             g_strdup (target));
+
+        for (i = 0; i < G_N_ELEMENTS (egl_driver_devices); i++) {
+            if (g_str_equal (target, egl_driver_devices[i]))
+                display->close_driver_fds = TRUE;
+        }
+    }
+
+    closedir (dir);
+}
+
+/* closes the remembered handles which still point to the same device */
+static void
+egl_close_driver_fds (GstGLESDisplay *display)
+{
+    gchar target[PATH_MAX];
+    GHashTableIter iter;
+    gpointer key, value;
+    gchar name[16];
+    gint dir_fd;
+    gint fd;
+
+    dir_fd = open (EGL_FD_DIR, O_RDONLY | O_DIRECTORY);
+    if (dir_fd < 0) {
+        GST_ERROR ("Could not open %s: %s", EGL_FD_DIR, g_strerror (errno));
+        return;
+    }
+
+    g_hash_table_iter_init (&iter, display->driver_fds);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        fd = GPOINTER_TO_INT (key);
+        g_snprintf (name, sizeof (name), "%d", fd);
+        if (!egl_read_fd_target (dir_fd, name, target, sizeof (target)) ||
+            !g_str_equal (target, value))
+            continue;
+
+        GST_DEBUG ("Close file handle %d: %s", fd, target);
+        if (close (fd) < 0)
+            GST_ERROR ("Could not close file handle: %d", errno);
+    }
+
+    close (dir_fd);
+}
+
+#ifndef EGL_OPENGL_ES3_BIT_KHR
+#define EGL_OPENGL_ES3_BIT_KHR 0x0040
+#endif
+
+static EGLContext
+egl_create_context (GstGLESDisplay *display, GstElement *element)
+{
+    const EGLint contextAttribs[] =
+    {
+        EGL_CONTEXT_CLIENT_VERSION, display->gles_version,
+        EGL_NONE
+    };
+    EGLContext context;
+
+    GST_DEBUG_OBJECT (element, "egl create context");
+    context = eglCreateContext(display->egl_display, display->config,
+                               display->context, contextAttribs);
+    if (context == EGL_NO_CONTEXT)
+        GST_ERROR_OBJECT(element, "Could not create EGL context");
+
+    return context;
+}
+
+/* initializes egl and creates the root context, the driver opens its
+ * device handles in here */
+static gint
+egl_display_init_context (GstGLESDisplay *display, GstElement *element)
+{
+    EGLint configAttribs[] =
+    {
+        EGL_SURFACE_TYPE, display->backend->surface_type,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR,
+        EGL_DEPTH_SIZE, 16,
+        EGL_NONE
+    };
+
+    EGLint num_configs;
+    EGLint major;
+    EGLint minor;
+
+    GST_DEBUG_OBJECT (element, "egl initialize");
+    if (!eglInitialize(display->egl_display, &major, &minor)) {
+        GST_ERROR_OBJECT(element, "Could not initialize EGL context");
+        display->egl_display = EGL_NO_DISPLAY;
+        return -1;
+    }
+    GST_DEBUG_OBJECT (element, "Have EGL version: %d.%d", major, minor);
+
+    /* prefer GLES3 for the streaming uploads, GLES2 works everywhere */
+    GST_DEBUG_OBJECT (element, "choose config");
+    display->gles_version = 3;
+    if (!eglChooseConfig(display->egl_display, configAttribs,
+                         &display->config, 1, &num_configs) ||
+        num_configs < 1) {
+        display->gles_version = 2;
+        configAttribs[3] = EGL_OPENGL_ES2_BIT;
+        if (!eglChooseConfig(display->egl_display, configAttribs,
+                             &display->config, 1, &num_configs)) {
+            GST_ERROR_OBJECT(element, "Could not choose EGL config");
+            return -1;
+        }
+    }
+
+    if (num_configs != 1) {
+        GST_WARNING_OBJECT(element, "Did not get exactly one config, but %d",
+                           num_configs);
+    }
+
+    /* root context of the share group */
+    display->context = egl_create_context (display, element);
+    if (display->context == EGL_NO_CONTEXT && display->gles_version > 2) {
+        display->gles_version = 2;
+        display->context = egl_create_context (display, element);
+    }
+    if (display->context == EGL_NO_CONTEXT)
+        return -1;
+
+    GST_DEBUG_OBJECT (element, "Using GLES %d contexts",
+                      display->gles_version);
+
+    return 0;
+}
+
+static gint
+egl_display_init (GstGLESDisplay *display, GstElement *element)
+{
+    GHashTable *fds;
+    gint ret;
+
+    if (display->egl_display == EGL_NO_DISPLAY) {
+        GST_ERROR_OBJECT(element, "Could not get EGL display");
+        return -1;
+    }
+
+    g_mutex_lock (&egl_fd_lock);
+    fds = egl_list_fds ();
+    ret = egl_display_init_context (display, element);
+    egl_find_driver_fds (display, fds);
+    g_hash_table_destroy (fds);
+    g_mutex_unlock (&egl_fd_lock);
+
+    if (display->close_driver_fds)
+        GST_INFO_OBJECT (element, "Closing %u driver file handles on "
+                         "teardown", g_hash_table_size (display->driver_fds));
+
+    return ret;
+}
+
+static void
+gst_gles_display_free (GstGLESDisplay *display)
+{
+    /* all shared objects go away with the last context of the group */
+    if (display->context != EGL_NO_CONTEXT)
+        eglDestroyContext (display->egl_display, display->context);
+
+    if (display->egl_display != EGL_NO_DISPLAY) {
+        eglTerminate (display->egl_display);
+        if (display->close_driver_fds)
+            egl_close_driver_fds (display);
+    }
+
+    if (display->native_display && display->backend->close_display)
+        display->backend->close_display (display->native_display);
+
+    g_hash_table_destroy (display->driver_fds);
+    gl_texture_pool_clear (&display->textures);
+    g_ptr_array_free (display->threads, TRUE);
+    g_mutex_clear (&display->lock);
+    g_slice_free (GstGLESDisplay, display);
+}
+
+GstGLESDisplay *
+gst_gles_display_ref_default (GstElement *element,
+                              GstGLESWindowBackendType backend)
+{
+    GstGLESDisplay *display;
+    const gchar *env;
+
+    g_mutex_lock (&default_display_lock);
+    if (default_displays[backend]) {
+        display = default_displays[backend];
+        display->refcount++;
+        goto done;
+    }
+
+    if (!window_get_backend (backend)) {
+        GST_ERROR_OBJECT (element, "Window system backend %d not available",
+                          backend);
+        display = NULL;
+        goto done;
+    }
+
+    display = g_slice_new0 (GstGLESDisplay);
+    display->refcount = 1;
+    display->backend = window_get_backend (backend);
+    display->egl_display = EGL_NO_DISPLAY;
+    display->context = EGL_NO_CONTEXT;
+    display->threads = g_ptr_array_new ();
+    display->driver_fds = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+    gl_texture_pool_init (&display->textures);
+    g_mutex_init (&display->lock);
+
+    display->max_threads = DEFAULT_MAX_THREADS;
+    env = g_getenv ("GST_GLES_RENDER_THREADS");
+    if (env && atoi (env) > 0)
+        display->max_threads = atoi (env);
+
+    GST_DEBUG_OBJECT (element, "Open %s display", display->backend->name);
+    if (display->backend->open_display (element, &display->native_display,
+                                        &display->egl_display) < 0) {
+        gst_gles_display_free (display);
+        display = NULL;
+        goto done;
+    }
+
+    if (egl_display_init (display, element) < 0) {
+        GST_ERROR_OBJECT (element, "EGL init failed, abort");
+        gst_gles_display_free (display);
+        display = NULL;
+        goto done;
+    }
+
+    GST_DEBUG_OBJECT (element, "Opened shared display, up to %u render "
+                      "threads", display->max_threads);
+    default_displays[backend] = display;
+
+done:
+    g_mutex_unlock (&default_display_lock);
+    return display;
+}
+
+void
+gst_gles_display_unref (GstGLESDisplay *display)
+{
+    g_mutex_lock (&default_display_lock);
+    if (--display->refcount > 0) {
+        g_mutex_unlock (&default_display_lock);
+        return;
+    }
+
+    if (default_displays[display->backend->type] == display)
+        default_displays[display->backend->type] = NULL;
+    g_mutex_unlock (&default_display_lock);
+
+    GST_DEBUG ("Closing shared display");
+    gst_gles_display_free (display);
+}
+
+gboolean
+gst_gles_display_get_probed_features (GstGLESWindowBackendType backend,
+                                      GstGLESFeatures *features)
+{
+    gboolean probed;
+
+    g_mutex_lock (&default_display_lock);
+    probed = probed_features[backend].probed;
+    if (probed)
+        *features = probed_features[backend];
+    g_mutex_unlock (&default_display_lock);
+
+    return probed;
+}
+
+void
+gst_gles_display_force_fd_cleanup (GstGLESDisplay *display)
+{
+    g_mutex_lock (&egl_fd_lock);
+    display->close_driver_fds = TRUE;
+    g_mutex_unlock (&egl_fd_lock);
+}
+
+EGLContext
+gst_gles_display_create_context (GstGLESDisplay *display,
+                                 GstElement *element)
+{
+    EGLContext context;
+    GHashTable *fds;
+
+    /* the driver may open further handles for every context */
+    g_mutex_lock (&egl_fd_lock);
+    fds = egl_list_fds ();
+    context = egl_create_context (display, element);
+    egl_find_driver_fds (display, fds);
+    g_hash_table_destroy (fds);
+    g_mutex_unlock (&egl_fd_lock);
+
+    return context;
+}
+
+/* compiles the shared shaders of process_type if no other context did,
+ * called with the display lock held */
+static gint
+gl_display_compile_shader (GstGLESDisplay *display, GstElement *element,
+                           GstGLESShaderTypes process_type)
+{
+    GstGLESShader *compiled = &display->shaders[process_type];
+    gint ret;
+
+    if (!display->features.probed) {
+        gl_probe_features (element, &display->features,
+                           display->gles_version);
+
+        g_mutex_lock (&default_display_lock);
+        probed_features[display->backend->type] = display->features;
+        g_mutex_unlock (&default_display_lock);
+    }
+    if (compiled->fragment_shader)
+        return 0;
+
+    GST_DEBUG_OBJECT (element, "Compile shared shader %d", process_type);
+    ret = gl_compile_shader (element, compiled, process_type,
+                             !display->features.parallel_compile);
+    if (ret < 0)
+        gl_delete_shader (compiled);
+
+    return ret;
+}
+
+gint
+gst_gles_display_compile_shaders (GstGLESDisplay *display,
+                                  GstElement *element,
+                                  const GstGLESShaderTypes *types,
+                                  guint n_types)
+{
+    gint ret = 0;
+    guint i;
+
+    g_mutex_lock (&display->lock);
+    for (i = 0; i < n_types && ret == 0; i++)
+        ret = gl_display_compile_shader (display, element, types[i]);
+    /* make the compiled shaders visible to the other contexts */
+    glFinish ();
+    g_mutex_unlock (&display->lock);
+
+    return ret;
+}
+
+gint
+gst_gles_display_link_shader (GstGLESDisplay *display, GstElement *element,
+                              GstGLESShader *shader,
+                              GstGLESShaderTypes process_type)
+{
+    GstGLESShader *compiled = &display->shaders[process_type];
+    gint ret;
+
+    g_mutex_lock (&display->lock);
+    if (!compiled->fragment_shader) {
+        ret = gl_display_compile_shader (display, element, process_type);
+        if (ret < 0) {
+            g_mutex_unlock (&display->lock);
+            return ret;
+        }
+        /* make the compiled shaders visible to the other contexts */
+        glFinish ();
+    }
+    g_mutex_unlock (&display->lock);
+
+    memset (shader, 0, sizeof (GstGLESShader));
+    return gl_link_shader (element, shader, compiled);
+}
+
+static gpointer
+gl_render_thread_proc (gpointer data)
+{
+    GstGLESRenderThread *thread = data;
+    GstGLESRenderJob *job;
+
+    while (TRUE) {
+        job = g_async_queue_pop (thread->queue);
+        if (job->func)
+            job->func (job->data);
+
+        g_mutex_lock (&thread->lock);
+        job->done = TRUE;
+        g_cond_broadcast (&thread->cond);
+        g_mutex_unlock (&thread->lock);
+
+        /* an empty job terminates the thread */
+        if (!job->func)
+            break;
+    }
+
+    eglMakeCurrent (thread->display->egl_display, EGL_NO_SURFACE,
+                    EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglReleaseThread ();
+
+    return NULL;
+}
+
+static GstGLESRenderThread *
+gl_render_thread_new (GstGLESDisplay *display, GstElement *element)
+{
+    GstGLESRenderThread *thread;
+    GError *error = NULL;
+
+    thread = g_slice_new0 (GstGLESRenderThread);
+    thread->display = display;
+    thread->current_surface = EGL_NO_SURFACE;
+    g_mutex_init (&thread->lock);
+    g_cond_init (&thread->cond);
+
+    thread->context = gst_gles_display_create_context (display, element);
+    if (thread->context == EGL_NO_CONTEXT)
+        goto fail;
+
+    thread->queue = g_async_queue_new ();
+    thread->handle = g_thread_try_new ("gl_thread", gl_render_thread_proc,
+                                       thread, &error);
+    if (!thread->handle) {
+        GST_ERROR_OBJECT (element, "Can't create render-thread: %s",
+                          error ? error->message : "(unknown)");
+        g_clear_error (&error);
+        goto fail;
+    }
+
+    return thread;
+
+fail:
+    if (thread->context != EGL_NO_CONTEXT)
+        eglDestroyContext (display->egl_display, thread->context);
+    if (thread->queue)
+        g_async_queue_unref (thread->queue);
+    g_mutex_clear (&thread->lock);
+    g_cond_clear (&thread->cond);
+    g_slice_free (GstGLESRenderThread, thread);
+    return NULL;
+}
+
+static void
+gl_render_thread_free (GstGLESRenderThread *thread)
+{
+    /* the empty job stops the thread */
+    gst_gles_render_thread_invoke (thread, NULL, NULL);
+    g_thread_join (thread->handle);
+
+    eglDestroyContext (thread->display->egl_display, thread->context);
+    g_async_queue_unref (thread->queue);
+    g_mutex_clear (&thread->lock);
+    g_cond_clear (&thread->cond);
+    g_slice_free (GstGLESRenderThread, thread);
+}
+
+GstGLESRenderThread *
+gst_gles_display_acquire_thread (GstGLESDisplay *display,
+                                 GstElement *element)
+{
+    GstGLESRenderThread *thread = NULL;
+    guint i;
+
+    g_mutex_lock (&display->lock);
+    for (i = 0; i < display->threads->len; i++) {
+        GstGLESRenderThread *t = g_ptr_array_index (display->threads, i);
+        if (!thread || t->users < thread->users)
+            thread = t;
+    }
+
+    if (!thread || (thread->users > 0 &&
+                    display->threads->len < display->max_threads)) {
+        GstGLESRenderThread *t = gl_render_thread_new (display, element);
+        if (t) {
+            g_ptr_array_add (display->threads, t);
+            thread = t;
+        }
+    }
+
+    if (thread) {
+        thread->users++;
+        GST_DEBUG_OBJECT (element, "Using render thread %p, %u users",
+                          thread, thread->users);
+    }
+    g_mutex_unlock (&display->lock);
+
+    return thread;
+}
+
+void
+gst_gles_display_release_thread (GstGLESDisplay *display,
+                                 GstGLESRenderThread *thread)
+{
+    g_mutex_lock (&display->lock);
+    if (--thread->users > 0) {
+        g_mutex_unlock (&display->lock);
+        return;
+    }
+    g_ptr_array_remove (display->threads, thread);
+    g_mutex_unlock (&display->lock);
+
+    gl_render_thread_free (thread);
+}
+
+void
+gst_gles_render_thread_invoke (GstGLESRenderThread *thread,
+                               GstGLESRenderFunc func, gpointer data)
+{
+    GstGLESRenderJob job;
+
+    job.func = func;
+    job.data = data;
+    job.done = FALSE;
+
+    g_async_queue_push (thread->queue, &job);
+
+    g_mutex_lock (&thread->lock);
+    while (!job.done)
+        g_cond_wait (&thread->cond, &thread->lock);
+    g_mutex_unlock (&thread->lock);
+}
+
+gboolean
+gst_gles_render_thread_make_current (GstGLESRenderThread *thread,
+                                     EGLSurface surface)
+{
+    EGLDisplay egl_display = thread->display->egl_display;
+    gboolean vsync;
+
+    /* a blocking swap would stall all other windows served by this
+       thread, only sync to vblank when the thread is not shared. the
+       windows of a shared thread are paced by window_frame_ready.
+       backends with frame callbacks are always paced by them, wayland
+       EGL would otherwise block the swap on a callback of its own,
+       which a hidden surface never gets */
+    g_mutex_lock (&thread->display->lock);
+    vsync = thread->users <= 1 && !thread->display->backend->frame_ready;
+    g_mutex_unlock (&thread->display->lock);
+
+    if (thread->current_surface == surface && thread->vsync == vsync &&
+        eglGetCurrentContext () == thread->context)
+        return TRUE;
+
+    if (!eglMakeCurrent (egl_display, surface, surface, thread->context)) {
+        GST_ERROR ("Could not set EGL context to current");
+        return FALSE;
+    }
+    thread->current_surface = surface;
+
+    if (surface != EGL_NO_SURFACE)
+        eglSwapInterval (egl_display, vsync ? 1 : 0);
+    thread->vsync = vsync;
+
+    return TRUE;
+}
+
+void
+gst_gles_render_thread_release_current (GstGLESRenderThread *thread)
+{
+    eglMakeCurrent (thread->display->egl_display, EGL_NO_SURFACE,
+                    EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    thread->current_surface = EGL_NO_SURFACE;
+}
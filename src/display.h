@@ -0,0 +1,164 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _DISPLAY_H__
+#define _DISPLAY_H__
+
+#include <GLES2/gl2.h>
+#include <EGL/egl.h>
+
+#include <X11/Xlib.h>
+
+#include <gst/gst.h>
+
+#include "render.h"
+#include "shader.h"
+#include "window.h"
+
+typedef struct _GstGLESDisplay       GstGLESDisplay;
+typedef struct _GstGLESRenderThread  GstGLESRenderThread;
+
+typedef void (*GstGLESRenderFunc) (gpointer data);
+
+/* process wide display connection per window system, shared by all
+ * elements using that backend. all contexts
+ * created from it are in one share group, so shaders are compiled only
+ * once per process */
+struct _GstGLESDisplay
+{
+    gint refcount;
+    GMutex lock;
+
+    /* native display of the window system */
+    const GstGLESWindowBackend *backend;
+    gpointer native_display;
+
+    /* egl context */
+    EGLDisplay egl_display;
+    EGLConfig config;
+    /* root of the share group, never made current */
+    EGLContext context;
+    /* client version of all contexts, 3 if available */
+    gint gles_version;
+    /* probed with the first linked shader, protected by lock */
+    GstGLESFeatures features;
+
+    /* textures of the share group kept for reuse, with its own lock */
+    GstGLESTexturePool textures;
+
+    /* shaders compiled in the share group, protected by lock */
+    GstGLESShader shaders[SHADER_COUNT];
+
+    /* gpu device handles the driver opened during initialisation and
+       context creation, closed after eglTerminate if close_driver_fds is
+       set. protected by a lock of the quirk in display.c */
+    GHashTable *driver_fds;
+    gboolean close_driver_fds;
+
+    /* pool of render threads, protected by lock */
+    GPtrArray *threads;
+    guint max_threads;
+};
+
+/* render thread with its own context in the share group, it executes the
+ * jobs of all elements assigned to it */
+struct _GstGLESRenderThread
+{
+    GstGLESDisplay *display;
+
+    GThread *handle;
+    GAsyncQueue *queue;
+    GMutex lock;
+    GCond cond;
+
+    EGLContext context;
+    EGLSurface current_surface;
+    /* the current surface syncs its swaps to vblank, only used from
+     * the thread itself */
+    gboolean vsync;
+
+    /* number of elements assigned, protected by the display lock */
+    guint users;
+};
+
+/* returns a reference to the process wide display of the backend, opening
+ * it on first use. returns NULL on failure */
+GstGLESDisplay *
+gst_gles_display_ref_default (GstElement *element,
+                              GstGLESWindowBackendType backend);
+void
+gst_gles_display_unref (GstGLESDisplay *display);
+
+/* closes the device handles the driver leaves open when the display is
+ * closed, even if it is not one known to leak them */
+void
+gst_gles_display_force_fd_cleanup (GstGLESDisplay *display);
+
+/* creates a new context in the share group of the display, the device
+ * handles the driver opens for it are closed on teardown as well */
+EGLContext
+gst_gles_display_create_context (GstGLESDisplay *display,
+                                 GstElement *element);
+
+/* copies the features the contexts of backend had when they were last
+ * probed in this process, FALSE if no context was created yet */
+gboolean
+gst_gles_display_get_probed_features (GstGLESWindowBackendType backend,
+                                      GstGLESFeatures *features);
+
+/* starts compiling the shared shaders of all types at once, so with
+ * parallel compiles they are built side by side before the first link */
+gint
+gst_gles_display_compile_shaders (GstGLESDisplay *display,
+                                  GstElement *element,
+                                  const GstGLESShaderTypes *types,
+                                  guint n_types);
+
+/* links a new program for shader, compiling the shared shaders if this is
+ * the first use. a context of the share group has to be current */
+gint
+gst_gles_display_link_shader (GstGLESDisplay *display, GstElement *element,
+                              GstGLESShader *shader,
+                              GstGLESShaderTypes process_type);
+
+/* assigns a render thread to an element, picks the least used thread of
+ * the pool and spawns a new one while the pool is not full */
+GstGLESRenderThread *
+gst_gles_display_acquire_thread (GstGLESDisplay *display,
+                                 GstElement *element);
+void
+gst_gles_display_release_thread (GstGLESDisplay *display,
+                                 GstGLESRenderThread *thread);
+
+/* runs func on the render thread and waits for it to complete */
+void
+gst_gles_render_thread_invoke (GstGLESRenderThread *thread,
+                               GstGLESRenderFunc func, gpointer data);
+/* makes the context of the render thread current on surface, has to be
+ * called from within a job */
+gboolean
+gst_gles_render_thread_make_current (GstGLESRenderThread *thread,
+                                     EGLSurface surface);
+/* releases the context, needed before the current surface is destroyed */
+void
+gst_gles_render_thread_release_current (GstGLESRenderThread *thread);
+
+#endif
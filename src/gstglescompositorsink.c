@@ -0,0 +1,1135 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-glescompositorsink
+ *
+ * Composes any number of video streams into a single window. Each request
+ * pad has its own upload textures and deinterlace pass, the results are
+ * blended according to the pad properties and presented with a single
+ * swap per output refresh.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch -v glescompositorsink name=c
+ *     videotestsrc ! c.
+ *     videotestsrc pattern=ball ! c.
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib.h>
+
+#define GST_USE_UNSTABLE_API
+#include <gst/gst.h>
+
+#if GST_CHECK_VERSION(1, 0, 0)
+#include <gst/video/videooverlay.h>
+#else
+#include <gst/interfaces/xoverlay.h>
+#endif
+#include <gst/video/video.h>
+
+#include <GLES2/gl2.h>
+
+#include "gstglescompositorsink.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_gles_compositor_sink_debug);
+#define GST_CAT_DEFAULT gst_gles_compositor_sink_debug
+
+#define DEFAULT_WINDOW_WIDTH 1280
+#define DEFAULT_WINDOW_HEIGHT 720
+
+/* how often window events are checked while no input has new data */
+#define EVENT_POLL_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+/* how often the window is checked while a frame waits for it */
+#define FRAME_POLL_INTERVAL (2 * G_TIME_SPAN_MILLISECOND)
+
+enum
+{
+  PROP_0,
+  PROP_BACKEND
+};
+
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_XPOS,
+  PROP_PAD_YPOS,
+  PROP_PAD_WIDTH,
+  PROP_PAD_HEIGHT,
+  PROP_PAD_ZORDER,
+  PROP_PAD_ALPHA
+};
+
+/* layout and pending buffer of an input, copied while holding the lock */
+typedef struct
+{
+  GstGLESCompositorInput *input;
+  GstBuffer *buf;
+  gint frame_width;
+  gint frame_height;
+  gint xpos;
+  gint ypos;
+  gint width;
+  gint height;
+  gdouble alpha;
+} GstGLESCompositorFrame;
+
+#define WxH ", width = (int) [ 16, 4096 ], height = (int) [ 16, 4096 ]"
+
+#if GST_CHECK_VERSION(1, 0, 0)
+#define COMPOSITOR_CAPS GST_VIDEO_CAPS_MAKE("I420") WxH
+#define COMPOSITOR_PAD_NAME "sink_%u"
+#else
+#define COMPOSITOR_CAPS GST_VIDEO_CAPS_YUV("I420") WxH
+#define COMPOSITOR_PAD_NAME "sink_%d"
+#endif
+
+static GstStaticPadTemplate input_sink_factory =
+        GST_STATIC_PAD_TEMPLATE ("sink",
+                                 GST_PAD_SINK,
+                                 GST_PAD_ALWAYS,
+                                 GST_STATIC_CAPS (COMPOSITOR_CAPS));
+
+static GstStaticPadTemplate compositor_sink_factory =
+        GST_STATIC_PAD_TEMPLATE (COMPOSITOR_PAD_NAME,
+                                 GST_PAD_SINK,
+                                 GST_PAD_REQUEST,
+                                 GST_STATIC_CAPS (COMPOSITOR_CAPS));
+
+#if GST_CHECK_VERSION(1, 0, 0)
+static void
+gst_gles_compositor_sink_video_overlay_init (GstVideoOverlayInterface * iface);
+
+G_DEFINE_TYPE_WITH_CODE (GstGLESCompositorSink, gst_gles_compositor_sink,
+    GST_TYPE_BIN, G_IMPLEMENT_INTERFACE(GST_TYPE_VIDEO_OVERLAY,
+    gst_gles_compositor_sink_video_overlay_init));
+#else
+GST_BOILERPLATE_WITH_INTERFACE (GstGLESCompositorSink,
+    gst_gles_compositor_sink, GstBin, GST_TYPE_BIN, GstXOverlay,
+    GST_TYPE_X_OVERLAY, gst_gles_compositor_sink_xoverlay)
+#endif
+
+#if GST_CHECK_VERSION(1, 0, 0)
+#define parent_class gst_gles_compositor_sink_parent_class
+#endif
+
+G_DEFINE_TYPE (GstGLESCompositorPad, gst_gles_compositor_pad,
+    GST_TYPE_GHOST_PAD);
+G_DEFINE_TYPE (GstGLESCompositorInput, gst_gles_compositor_input,
+    GST_TYPE_VIDEO_SINK);
+
+/* input sink implementation */
+
+static gboolean
+gst_gles_compositor_input_set_caps (GstBaseSink *basesink, GstCaps *caps)
+{
+    GstGLESCompositorInput *input = GST_GLES_COMPOSITOR_INPUT (basesink);
+    GstVideoFormat fmt;
+    gint par_n;
+    gint par_d;
+    gint w;
+    gint h;
+
+#if GST_CHECK_VERSION(1, 0, 0)
+    GstVideoInfo info;
+
+    if (!gst_video_info_from_caps (&info, caps)) {
+        GST_WARNING_OBJECT (input, "Failed to read video info from caps");
+        return FALSE;
+    }
+
+    fmt = GST_VIDEO_INFO_FORMAT(&info);
+    w = info.width;
+    h = info.height;
+    par_n = info.par_n;
+    par_d = info.par_d;
+#else
+    if (!gst_video_format_parse_caps (caps, &fmt, &w, &h)) {
+        GST_WARNING_OBJECT (input, "pase_caps failed");
+        return FALSE;
+    }
+
+    if (!gst_video_parse_caps_pixel_aspect_ratio (caps, &par_n, &par_d)) {
+        GST_WARNING_OBJECT (input, "no pixel aspect ratio");
+        return FALSE;
+    }
+#endif
+    g_assert ((fmt == GST_VIDEO_FORMAT_I420));
+
+    /* buffers of the previous caps may still be queued, the gl thread
+       gets the size with each buffer */
+    GST_VIDEO_SINK_WIDTH (input) = w;
+    GST_VIDEO_SINK_HEIGHT (input) = h;
+    input->par_n = par_n;
+    input->par_d = par_d;
+
+    return TRUE;
+}
+
+static GstFlowReturn
+gst_gles_compositor_input_show_frame (GstBaseSink *basesink, GstBuffer *buf)
+{
+    GstGLESCompositorInput *input = GST_GLES_COMPOSITOR_INPUT (basesink);
+    GstGLESCompositorSink *comp = input->compositor;
+
+    /* just keep the latest buffer, the gl thread picks it up at the
+       next output refresh */
+    g_mutex_lock (&comp->lock);
+    gst_buffer_replace (&input->buf, buf);
+    input->frame_width = GST_VIDEO_SINK_WIDTH (input);
+    input->frame_height = GST_VIDEO_SINK_HEIGHT (input);
+    input->video_width = input->frame_width * input->par_n / input->par_d;
+    input->video_height = input->frame_height;
+    comp->dirty = TRUE;
+    g_cond_signal (&comp->cond);
+    g_mutex_unlock (&comp->lock);
+
+    return GST_FLOW_OK;
+}
+
+static gboolean
+gst_gles_compositor_input_stop (GstBaseSink *basesink)
+{
+    GstGLESCompositorInput *input = GST_GLES_COMPOSITOR_INPUT (basesink);
+
+    g_mutex_lock (&input->compositor->lock);
+    gst_buffer_replace (&input->buf, NULL);
+    g_mutex_unlock (&input->compositor->lock);
+
+    GST_VIDEO_SINK_WIDTH (input) = 0;
+    GST_VIDEO_SINK_HEIGHT (input) = 0;
+
+    return TRUE;
+}
+
+static void
+gst_gles_compositor_input_class_init (GstGLESCompositorInputClass *klass)
+{
+    GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+    basesink_class->set_caps =
+        GST_DEBUG_FUNCPTR (gst_gles_compositor_input_set_caps);
+    basesink_class->render =
+        GST_DEBUG_FUNCPTR (gst_gles_compositor_input_show_frame);
+    basesink_class->preroll =
+        GST_DEBUG_FUNCPTR (gst_gles_compositor_input_show_frame);
+    basesink_class->stop = GST_DEBUG_FUNCPTR (gst_gles_compositor_input_stop);
+
+    gst_element_class_set_details_simple(element_class,
+      "GLES compositor input",
+      "Sink/Video",
+      "Input of the OpenGL ES 2.0 compositor",
+      "Julian Scheel <julian jusst de>");
+
+    gst_element_class_add_pad_template (element_class,
+        gst_static_pad_template_get (&input_sink_factory));
+}
+
+static void
+gst_gles_compositor_input_init (GstGLESCompositorInput *input)
+{
+    input->alpha = 1.0;
+
+    gst_base_sink_set_max_lateness (GST_BASE_SINK (input), 20 * GST_MSECOND);
+    gst_base_sink_set_qos_enabled (GST_BASE_SINK (input), TRUE);
+}
+
+/* pad implementation */
+
+static gint
+gst_gles_compositor_sort_inputs (gconstpointer a, gconstpointer b)
+{
+    const GstGLESCompositorInput *input_a = a;
+    const GstGLESCompositorInput *input_b = b;
+
+    return (gint) input_a->zorder - (gint) input_b->zorder;
+}
+
+static void
+gst_gles_compositor_pad_set_property (GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
+{
+    GstGLESCompositorPad *pad = GST_GLES_COMPOSITOR_PAD (object);
+    GstGLESCompositorInput *input = pad->input;
+    GstGLESCompositorSink *comp;
+
+    if (!input) {
+        GST_WARNING_OBJECT (pad, "Pad is not linked to an input");
+        return;
+    }
+    comp = input->compositor;
+
+    g_mutex_lock (&comp->lock);
+    switch (prop_id) {
+      case PROP_PAD_XPOS:
+        input->xpos = g_value_get_int (value);
+        break;
+      case PROP_PAD_YPOS:
+        input->ypos = g_value_get_int (value);
+        break;
+      case PROP_PAD_WIDTH:
+        input->width = g_value_get_int (value);
+        break;
+      case PROP_PAD_HEIGHT:
+        input->height = g_value_get_int (value);
+        break;
+      case PROP_PAD_ZORDER:
+        input->zorder = g_value_get_uint (value);
+        comp->inputs = g_list_sort (comp->inputs,
+                                    gst_gles_compositor_sort_inputs);
+        break;
+      case PROP_PAD_ALPHA:
+        input->alpha = g_value_get_double (value);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+        break;
+    }
+
+    /* redraw with the new layout */
+    comp->dirty = TRUE;
+    g_cond_signal (&comp->cond);
+    g_mutex_unlock (&comp->lock);
+}
+
+static void
+gst_gles_compositor_pad_get_property (GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+    GstGLESCompositorPad *pad = GST_GLES_COMPOSITOR_PAD (object);
+    GstGLESCompositorInput *input = pad->input;
+
+    if (!input)
+        return;
+
+    g_mutex_lock (&input->compositor->lock);
+    switch (prop_id) {
+      case PROP_PAD_XPOS:
+        g_value_set_int (value, input->xpos);
+        break;
+      case PROP_PAD_YPOS:
+        g_value_set_int (value, input->ypos);
+        break;
+      case PROP_PAD_WIDTH:
+        g_value_set_int (value, input->width);
+        break;
+      case PROP_PAD_HEIGHT:
+        g_value_set_int (value, input->height);
+        break;
+      case PROP_PAD_ZORDER:
+        g_value_set_uint (value, input->zorder);
+        break;
+      case PROP_PAD_ALPHA:
+        g_value_set_double (value, input->alpha);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+        break;
+    }
+    g_mutex_unlock (&input->compositor->lock);
+}
+
+static void
+gst_gles_compositor_pad_class_init (GstGLESCompositorPadClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+    gobject_class->set_property = gst_gles_compositor_pad_set_property;
+    gobject_class->get_property = gst_gles_compositor_pad_get_property;
+
+    g_object_class_install_property (gobject_class, PROP_PAD_XPOS,
+        g_param_spec_int ("xpos", "X position", "X position of the picture "
+            "in the window", G_MININT, G_MAXINT, 0, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, PROP_PAD_YPOS,
+        g_param_spec_int ("ypos", "Y position", "Y position of the picture "
+            "in the window", G_MININT, G_MAXINT, 0, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, PROP_PAD_WIDTH,
+        g_param_spec_int ("width", "Width", "Width of the picture in the "
+            "window, 0 for the video width", 0, G_MAXINT, 0,
+            G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, PROP_PAD_HEIGHT,
+        g_param_spec_int ("height", "Height", "Height of the picture in the "
+            "window, 0 for the video height", 0, G_MAXINT, 0,
+            G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, PROP_PAD_ZORDER,
+        g_param_spec_uint ("zorder", "Z-Order", "Z order of the picture",
+            0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, PROP_PAD_ALPHA,
+        g_param_spec_double ("alpha", "Alpha", "Alpha of the picture",
+            0.0, 1.0, 1.0, G_PARAM_READWRITE));
+}
+
+static void
+gst_gles_compositor_pad_init (GstGLESCompositorPad *pad)
+{
+}
+
+/* compositor implementation, everything below runs on the gl thread
+ * unless noted otherwise */
+
+static void
+gl_compositor_close (GstGLESCompositorSink *comp)
+{
+    guint i;
+    GList *l;
+
+    g_mutex_lock (&comp->lock);
+    for (l = comp->inputs; l; l = l->next) {
+        GstGLESCompositorInput *input = l->data;
+        if (input->stream.initialized)
+            gl_stream_delete (&input->stream);
+    }
+
+    for (i = 0; i < comp->released->len; i++)
+        gl_stream_delete (&g_array_index (comp->released, GstGLESStream, i));
+    g_array_set_size (comp->released, 0);
+    g_mutex_unlock (&comp->lock);
+
+    gl_delete_shader (&comp->blend);
+    gl_delete_shader (&comp->deinterlace);
+
+    eglMakeCurrent (comp->window.egl_display, EGL_NO_SURFACE,
+                    EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    egl_close_surface (GST_ELEMENT (comp), &comp->window);
+    if (comp->context != EGL_NO_CONTEXT) {
+        eglDestroyContext (comp->window.egl_display, comp->context);
+        comp->context = EGL_NO_CONTEXT;
+    }
+    eglReleaseThread ();
+}
+
+/* gets the window handle the application set last, FALSE if there was
+ * no new one */
+static gboolean
+gl_compositor_take_window (GstGLESCompositorSink *comp, guintptr *handle)
+{
+    gboolean changed;
+
+    g_mutex_lock (&comp->lock);
+    changed = comp->window_changed;
+    *handle = comp->window_handle;
+    comp->window_changed = FALSE;
+    g_mutex_unlock (&comp->lock);
+
+    return changed;
+}
+
+/* moves the output to another window between two frames. only the EGL
+ * surface is replaced, the context and the input textures stay */
+static void
+gl_compositor_switch_window (GstGLESCompositorSink *comp)
+{
+    guintptr handle;
+
+    if (!gl_compositor_take_window (comp, &handle) ||
+        handle == comp->window.window)
+        return;
+
+    eglMakeCurrent (comp->window.egl_display, EGL_NO_SURFACE,
+                    EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    egl_close_surface (GST_ELEMENT (comp), &comp->window);
+    window_close (GST_ELEMENT (comp), &comp->window);
+
+    comp->window.window = handle;
+    comp->window.external_window = handle != 0;
+
+    if (window_init (GST_ELEMENT (comp), &comp->window,
+                     comp->display->backend, comp->display->native_display,
+                     comp->window.width, comp->window.height) < 0 ||
+        egl_init_surface (GST_ELEMENT (comp), &comp->window,
+                          comp->display->config) < 0 ||
+        !eglMakeCurrent (comp->window.egl_display, comp->window.surface,
+                         comp->window.surface, comp->context)) {
+        GST_ERROR_OBJECT (comp, "Could not switch to window %"
+                          G_GUINTPTR_FORMAT, comp->window.window);
+        egl_close_surface (GST_ELEMENT (comp), &comp->window);
+        return;
+    }
+    eglSwapInterval (comp->window.egl_display, comp->vsync ? 1 : 0);
+
+    if (!comp->window.external_window && comp->window.window)
+#if GST_CHECK_VERSION(1, 0, 0)
+        gst_video_overlay_got_window_handle (GST_VIDEO_OVERLAY (comp),
+                                             comp->window.window);
+#else
+        gst_x_overlay_got_window_handle (GST_X_OVERLAY (comp),
+                                         comp->window.window);
+#endif
+}
+
+static gint
+gl_compositor_setup (GstGLESCompositorSink *comp)
+{
+    guintptr handle;
+    gint ret;
+
+    if (gl_compositor_take_window (comp, &handle)) {
+        comp->window.window = handle;
+        comp->window.external_window = handle != 0;
+    }
+    comp->window.egl_display = comp->display->egl_display;
+    comp->window.width = DEFAULT_WINDOW_WIDTH;
+    comp->window.height = DEFAULT_WINDOW_HEIGHT;
+    if (window_init (GST_ELEMENT (comp), &comp->window,
+                     comp->display->backend, comp->display->native_display,
+                     comp->window.width, comp->window.height) < 0) {
+        GST_ERROR_OBJECT (comp, "Window init failed, abort");
+        return -ENOMEM;
+    }
+
+    /* the compositor keeps its own thread as it polls window events
+       and is not paced by a single stream, but it still shares the
+       compiled shaders with all other sinks */
+    comp->context = gst_gles_display_create_context (comp->display,
+                                                     GST_ELEMENT (comp));
+    if (comp->context == EGL_NO_CONTEXT ||
+        egl_init_surface (GST_ELEMENT (comp), &comp->window,
+                          comp->display->config) < 0 ||
+        !eglMakeCurrent (comp->window.egl_display, comp->window.surface,
+                         comp->window.surface, comp->context)) {
+        GST_ERROR_OBJECT (comp, "EGL init failed, abort");
+        gl_compositor_close (comp);
+        window_close (GST_ELEMENT (comp), &comp->window);
+        return -ENOMEM;
+    }
+
+    /* backends with frame callbacks are paced by them instead of a
+       blocking swap, see gst_gles_render_thread_make_current () */
+    comp->vsync = !comp->display->backend->frame_ready;
+    eglSwapInterval (comp->window.egl_display, comp->vsync ? 1 : 0);
+
+    ret = gst_gles_display_link_shader (comp->display, GST_ELEMENT (comp),
+                                        &comp->deinterlace,
+                                        SHADER_DEINT_LINEAR);
+    if (ret < 0) {
+        GST_ERROR_OBJECT (comp, "Could not initialize shader: %d", ret);
+        gl_compositor_close (comp);
+        window_close (GST_ELEMENT (comp), &comp->window);
+        return -ENOMEM;
+    }
+
+    /* without the blend program the inputs are composed opaque, only the
+       alpha pad property is lost */
+    ret = gst_gles_display_link_shader (comp->display, GST_ELEMENT (comp),
+                                        &comp->blend, SHADER_BLEND);
+    if (ret < 0) {
+        GST_ELEMENT_WARNING (comp, RESOURCE, FAILED,
+                             ("Could not initialize shader"),
+                             ("blend shader is not available, inputs are "
+                              "composed without alpha"));
+        ret = gst_gles_display_link_shader (comp->display,
+                                            GST_ELEMENT (comp),
+                                            &comp->blend, SHADER_COPY);
+    }
+    if (ret < 0) {
+        GST_ERROR_OBJECT (comp, "Could not initialize shader: %d", ret);
+        gl_compositor_close (comp);
+        window_close (GST_ELEMENT (comp), &comp->window);
+        return -ENOMEM;
+    }
+    comp->blend_tex_loc = glGetUniformLocation (comp->blend.program, "s_tex");
+    comp->blend_alpha_loc = glGetUniformLocation (comp->blend.program,
+                                                  "alpha");
+
+    /* finally announce the window handle to controling app */
+    if (!comp->window.external_window && comp->window.window)
+#if GST_CHECK_VERSION(1, 0, 0)
+        gst_video_overlay_got_window_handle (GST_VIDEO_OVERLAY (comp),
+                                             comp->window.window);
+#else
+        gst_x_overlay_got_window_handle (GST_X_OVERLAY (comp),
+                                         comp->window.window);
+#endif
+    return 0;
+}
+
+static void
+gl_compositor_draw_input (GstGLESCompositorSink *comp,
+                          GstGLESCompositorFrame *frame)
+{
+    GstGLESCompositorInput *input = frame->input;
+    float x0, x1, y0, y1;
+
+    /* window coordinates have their origin in the top left corner */
+    x0 = (float) frame->xpos / comp->window.width * 2.0f - 1.0f;
+    x1 = (float) (frame->xpos + frame->width) / comp->window.width *
+            2.0f - 1.0f;
+    y0 = 1.0f - (float) frame->ypos / comp->window.height * 2.0f;
+    y1 = 1.0f - (float) (frame->ypos + frame->height) / comp->window.height *
+            2.0f;
+
+    {
+        GLfloat vVertices[] =
+        {
+            x0, y1,
+            0.0f, 0.0f,
+
+            x1, y1,
+            1.0f, 0.0f,
+
+            x1, y0,
+            1.0f, 1.0f,
+
+            x0, y0,
+            0.0f, 1.0f,
+        };
+
+        if (frame->alpha < 1.0) {
+            glEnable (GL_BLEND);
+            glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+
+        glActiveTexture (GL_TEXTURE3);
+        glBindTexture (GL_TEXTURE_2D, input->stream.rgb_tex.id);
+        glUniform1i (comp->blend_tex_loc, 3);
+        glUniform1f (comp->blend_alpha_loc, frame->alpha);
+
+        gl_draw_quad (&comp->blend, vVertices);
+
+        if (frame->alpha < 1.0)
+            glDisable (GL_BLEND);
+    }
+}
+
+/* uploads all pending buffers and composes one output frame */
+static void
+gl_compositor_draw (GstGLESCompositorSink *comp)
+{
+    GstGLESCompositorFrame *frames;
+    guint n_frames;
+    guint i;
+    GList *l;
+
+    g_mutex_lock (&comp->render_lock);
+    g_mutex_lock (&comp->lock);
+
+    for (i = 0; i < comp->released->len; i++)
+        gl_stream_delete (&g_array_index (comp->released, GstGLESStream, i));
+    g_array_set_size (comp->released, 0);
+
+    n_frames = g_list_length (comp->inputs);
+    frames = g_new0 (GstGLESCompositorFrame, n_frames);
+    for (l = comp->inputs, i = 0; l; l = l->next, i++) {
+        GstGLESCompositorInput *input = l->data;
+
+        frames[i].input = input;
+        frames[i].buf = input->buf;
+        frames[i].frame_width = input->frame_width;
+        frames[i].frame_height = input->frame_height;
+        frames[i].xpos = input->xpos;
+        frames[i].ypos = input->ypos;
+        frames[i].width = input->width ? input->width : input->video_width;
+        frames[i].height = input->height ? input->height :
+                                           input->video_height;
+        frames[i].alpha = input->alpha;
+        input->buf = NULL;
+    }
+    g_mutex_unlock (&comp->lock);
+
+    /* upload and deinterlace every input which has new data */
+    for (i = 0; i < n_frames; i++) {
+        GstGLESCompositorInput *input = frames[i].input;
+        GstGLESStream *stream = &input->stream;
+        GstGLESAllocResult res;
+
+        if (!frames[i].buf)
+            continue;
+
+        if (!stream->initialized) {
+            gl_stream_init (stream, &comp->deinterlace,
+                            &comp->display->features,
+                            &comp->display->textures, NULL);
+            res = gl_stream_gen_framebuffer (GST_ELEMENT (input), stream,
+                                             frames[i].frame_width,
+                                             frames[i].frame_height);
+        } else {
+            res = gl_stream_resize (GST_ELEMENT (input), stream,
+                                    frames[i].frame_width,
+                                    frames[i].frame_height);
+        }
+
+        /* the input is left out until a frame fits again */
+        if (res != GST_GLES_ALLOC_OK) {
+            GST_ELEMENT_ERROR (input, RESOURCE, FAILED,
+                               ("Could not allocate textures"),
+                               ("%dx%d frame", frames[i].frame_width,
+                                frames[i].frame_height));
+            gl_stream_delete (stream);
+            gst_buffer_unref (frames[i].buf);
+            continue;
+        }
+
+        gl_stream_draw_fbo (GST_ELEMENT (input), stream, &comp->deinterlace,
+                            frames[i].buf);
+        gst_buffer_unref (frames[i].buf);
+    }
+
+    /* compose all inputs in zorder into the window */
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+    glViewport (0, 0, comp->window.width, comp->window.height);
+    glClear (GL_COLOR_BUFFER_BIT);
+    glUseProgram (comp->blend.program);
+
+    for (i = 0; i < n_frames; i++) {
+        if (frames[i].input->stream.initialized)
+            gl_compositor_draw_input (comp, &frames[i]);
+    }
+
+    window_swap_buffers (&comp->window);
+
+    g_mutex_unlock (&comp->render_lock);
+
+    g_free (frames);
+}
+
+static gpointer
+gl_compositor_thread_proc (gpointer data)
+{
+    GstGLESCompositorSink *comp = GST_GLES_COMPOSITOR_SINK (data);
+    gboolean pending = FALSE;
+    gboolean running;
+
+    GST_DEBUG_OBJECT (comp, "Init GL context");
+    running = gl_compositor_setup (comp) == 0;
+
+    g_mutex_lock (&comp->lock);
+    comp->running = running;
+    comp->init_done = TRUE;
+    g_cond_broadcast (&comp->cond);
+    g_mutex_unlock (&comp->lock);
+
+    if (!running)
+        return NULL;
+
+    while (comp->running) {
+        gboolean redraw;
+
+        redraw = window_handle_events (GST_ELEMENT (comp), &comp->window);
+
+        g_mutex_lock (&comp->lock);
+        if (pending && comp->running) {
+            /* the window is not ready for the next frame yet */
+            g_cond_wait_until (&comp->cond, &comp->lock,
+                               g_get_monotonic_time () +
+                               FRAME_POLL_INTERVAL);
+        } else if (!comp->dirty && !redraw && comp->running) {
+            /* wake up now and then to process window events */
+            g_cond_wait_until (&comp->cond, &comp->lock,
+                               g_get_monotonic_time () +
+                               EVENT_POLL_INTERVAL);
+        }
+        redraw |= comp->dirty || pending;
+        comp->dirty = FALSE;
+        g_mutex_unlock (&comp->lock);
+
+        if (comp->running)
+            gl_compositor_switch_window (comp);
+
+        /* all inputs are drawn with a single swap, so the output never
+           presents more than one frame per refresh */
+        pending = redraw && comp->running &&
+                  !window_frame_ready (&comp->window, comp->vsync);
+        if (redraw && comp->running && !pending)
+            gl_compositor_draw (comp);
+    }
+
+    gl_compositor_close (comp);
+    window_close (GST_ELEMENT (comp), &comp->window);
+    return NULL;
+}
+
+/* called from the state change, not on the gl thread */
+static gboolean
+gl_compositor_thread_start (GstGLESCompositorSink *comp)
+{
+    GError *error = NULL;
+
+    /* give the application the opportunity to head in a
+       xwindow id to use as render target */
+#if GST_CHECK_VERSION(1, 0, 0)
+    gst_video_overlay_prepare_window_handle (GST_VIDEO_OVERLAY (comp));
+#else
+    gst_x_overlay_prepare_xwindow_id (GST_X_OVERLAY (comp));
+#endif
+
+    comp->display = gst_gles_display_ref_default (GST_ELEMENT (comp),
+                                                  comp->backend);
+    if (!comp->display)
+        return FALSE;
+
+    comp->init_done = FALSE;
+    comp->thread = g_thread_try_new ("gl_compositor", gl_compositor_thread_proc,
+                                     comp, &error);
+    if (!comp->thread) {
+        GST_ERROR_OBJECT (comp, "Can't create render-thread: %s",
+                          error ? error->message : "(unknown)");
+        g_clear_error (&error);
+        goto fail;
+    }
+
+    g_mutex_lock (&comp->lock);
+    while (!comp->init_done)
+        g_cond_wait (&comp->cond, &comp->lock);
+    g_mutex_unlock (&comp->lock);
+
+    if (!comp->running) {
+        g_thread_join (comp->thread);
+        comp->thread = NULL;
+        goto fail;
+    }
+
+    return TRUE;
+
+fail:
+    gst_gles_display_unref (comp->display);
+    comp->display = NULL;
+    return FALSE;
+}
+
+static void
+gl_compositor_thread_stop (GstGLESCompositorSink *comp)
+{
+    if (!comp->thread)
+        return;
+
+    g_mutex_lock (&comp->lock);
+    comp->running = FALSE;
+    g_cond_signal (&comp->cond);
+    g_mutex_unlock (&comp->lock);
+
+    g_thread_join (comp->thread);
+    comp->thread = NULL;
+
+    gst_gles_display_unref (comp->display);
+    comp->display = NULL;
+}
+
+/* element implementation */
+
+#if GST_CHECK_VERSION(1, 0, 0)
+static GstPad *
+gst_gles_compositor_sink_request_new_pad (GstElement *element,
+    GstPadTemplate *templ, const gchar *req_name, const GstCaps *caps)
+#else
+static GstPad *
+gst_gles_compositor_sink_request_new_pad (GstElement *element,
+    GstPadTemplate *templ, const gchar *req_name)
+#endif
+{
+    GstGLESCompositorSink *comp = GST_GLES_COMPOSITOR_SINK (element);
+    GstGLESCompositorInput *input;
+    GstPad *target;
+    GstPad *pad;
+    gchar *name;
+    guint id;
+
+    g_mutex_lock (&comp->lock);
+    id = comp->next_pad_id++;
+    g_mutex_unlock (&comp->lock);
+
+    if (req_name)
+        name = g_strdup (req_name);
+    else
+        name = g_strdup_printf ("sink_%u", id);
+
+    input = g_object_new (GST_TYPE_GLES_COMPOSITOR_INPUT, "name", name, NULL);
+    input->compositor = comp;
+    /* later pads are stacked on top by default */
+    input->zorder = id;
+
+    if (!gst_bin_add (GST_BIN (comp), GST_ELEMENT (input))) {
+        GST_ERROR_OBJECT (comp, "Could not add input %s", name);
+        g_free (name);
+        return NULL;
+    }
+
+    target = gst_element_get_static_pad (GST_ELEMENT (input), "sink");
+    pad = g_object_new (GST_TYPE_GLES_COMPOSITOR_PAD, "name", name,
+                        "direction", GST_PAD_SINK, "template", templ, NULL);
+    gst_ghost_pad_construct (GST_GHOST_PAD (pad));
+    gst_ghost_pad_set_target (GST_GHOST_PAD (pad), target);
+    gst_object_unref (target);
+    GST_GLES_COMPOSITOR_PAD (pad)->input = input;
+
+    g_mutex_lock (&comp->lock);
+    comp->inputs = g_list_insert_sorted (comp->inputs, input,
+                                         gst_gles_compositor_sort_inputs);
+    g_mutex_unlock (&comp->lock);
+
+    if (GST_STATE (comp) > GST_STATE_READY)
+        gst_pad_set_active (pad, TRUE);
+    gst_element_add_pad (element, pad);
+    gst_element_sync_state_with_parent (GST_ELEMENT (input));
+
+    GST_DEBUG_OBJECT (comp, "Created pad %s", name);
+    g_free (name);
+
+    return pad;
+}
+
+static void
+gst_gles_compositor_sink_release_pad (GstElement *element, GstPad *pad)
+{
+    GstGLESCompositorSink *comp = GST_GLES_COMPOSITOR_SINK (element);
+    GstGLESCompositorInput *input = GST_GLES_COMPOSITOR_PAD (pad)->input;
+
+    GST_DEBUG_OBJECT (comp, "Release pad %s", GST_PAD_NAME (pad));
+
+    /* wait for the gl thread to finish the current frame, the textures
+       of the input are deleted with the next one */
+    g_mutex_lock (&comp->render_lock);
+    g_mutex_lock (&comp->lock);
+    comp->inputs = g_list_remove (comp->inputs, input);
+    if (input->stream.initialized)
+        g_array_append_val (comp->released, input->stream);
+    memset (&input->stream, 0, sizeof (GstGLESStream));
+    gst_buffer_replace (&input->buf, NULL);
+    comp->dirty = TRUE;
+    g_cond_signal (&comp->cond);
+    g_mutex_unlock (&comp->lock);
+    g_mutex_unlock (&comp->render_lock);
+
+    GST_GLES_COMPOSITOR_PAD (pad)->input = NULL;
+    gst_element_remove_pad (element, pad);
+
+    gst_element_set_state (GST_ELEMENT (input), GST_STATE_NULL);
+    gst_bin_remove (GST_BIN (comp), GST_ELEMENT (input));
+}
+
+static GstStateChangeReturn
+gst_gles_compositor_sink_change_state (GstElement *element,
+                                       GstStateChange transition)
+{
+    GstGLESCompositorSink *comp = GST_GLES_COMPOSITOR_SINK (element);
+    GstStateChangeReturn ret;
+
+    switch (transition) {
+      case GST_STATE_CHANGE_READY_TO_PAUSED:
+        if (!gl_compositor_thread_start (comp)) {
+            GST_ELEMENT_ERROR (comp, LIBRARY, INIT,
+                               ("Can't create render-thread"), (NULL));
+            return GST_STATE_CHANGE_FAILURE;
+        }
+        break;
+      default:
+        break;
+    }
+
+    ret = GST_ELEMENT_CLASS (parent_class)->change_state (element,
+                                                          transition);
+
+    switch (transition) {
+      case GST_STATE_CHANGE_PAUSED_TO_READY:
+        gl_compositor_thread_stop (comp);
+        break;
+      default:
+        break;
+    }
+
+    return ret;
+}
+
+static void
+gst_gles_compositor_sink_finalize (GObject *gobject)
+{
+    GstGLESCompositorSink *comp = GST_GLES_COMPOSITOR_SINK (gobject);
+
+    gl_compositor_thread_stop (comp);
+
+    g_list_free (comp->inputs);
+    g_array_free (comp->released, TRUE);
+    g_mutex_clear (&comp->render_lock);
+    g_mutex_clear (&comp->lock);
+    g_cond_clear (&comp->cond);
+
+    G_OBJECT_CLASS (parent_class)->finalize (gobject);
+}
+
+#if !GST_CHECK_VERSION(1, 0, 0)
+static void
+gst_gles_compositor_sink_base_init (gpointer gclass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS (gclass);
+
+  gst_element_class_set_details_simple(element_class,
+    "GLES compositor sink",
+    "Sink/Video",
+    "Compose multiple videos into one window using Open GL ES 2.0",
+    "Julian Scheel <julian jusst de>");
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&compositor_sink_factory));
+}
+#endif
+
+static void
+gst_gles_compositor_sink_set_property (GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
+{
+  GstGLESCompositorSink *comp = GST_GLES_COMPOSITOR_SINK (object);
+
+  switch (prop_id) {
+    case PROP_BACKEND:
+      comp->backend = g_value_get_enum (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_gles_compositor_sink_get_property (GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+  GstGLESCompositorSink *comp = GST_GLES_COMPOSITOR_SINK (object);
+
+  switch (prop_id) {
+    case PROP_BACKEND:
+      g_value_set_enum (value, comp->backend);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_gles_compositor_sink_class_init (GstGLESCompositorSinkClass *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  GST_DEBUG_CATEGORY_INIT (gst_gles_compositor_sink_debug,
+      "glescompositorsink", 0, "OpenGL ES 2.0 compositor");
+
+  gobject_class->finalize = gst_gles_compositor_sink_finalize;
+  gobject_class->set_property = gst_gles_compositor_sink_set_property;
+  gobject_class->get_property = gst_gles_compositor_sink_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_BACKEND,
+      g_param_spec_enum ("backend", "Window system backend", "Window system "
+        "to render on, takes effect on the next start.",
+        GST_TYPE_GLES_WINDOW_BACKEND, GST_GLES_WINDOW_BACKEND_X11,
+        G_PARAM_READWRITE));
+
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_gles_compositor_sink_request_new_pad);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_gles_compositor_sink_release_pad);
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_gles_compositor_sink_change_state);
+
+#if GST_CHECK_VERSION(1, 0, 0)
+  gst_element_class_set_details_simple(element_class,
+    "GLES compositor sink",
+    "Sink/Video",
+    "Compose multiple videos into one window using Open GL ES 2.0",
+    "Julian Scheel <julian jusst de>");
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&compositor_sink_factory));
+#endif
+}
+
+#if GST_CHECK_VERSION(1, 0, 0)
+static void
+gst_gles_compositor_sink_init (GstGLESCompositorSink *comp)
+#else
+static void
+gst_gles_compositor_sink_init (GstGLESCompositorSink *comp,
+    GstGLESCompositorSinkClass *gclass)
+#endif
+{
+    g_mutex_init (&comp->lock);
+    g_mutex_init (&comp->render_lock);
+    g_cond_init (&comp->cond);
+
+    comp->released = g_array_new (FALSE, TRUE, sizeof (GstGLESStream));
+
+    if (XInitThreads () == 0)
+        GST_ERROR_OBJECT (comp, "XInitThreads failed");
+}
+
+/* Overlay Interface implementation */
+#if GST_CHECK_VERSION(1, 0, 0)
+static void
+gst_gles_compositor_sink_set_window_handle (GstVideoOverlay *overlay,
+                                            guintptr handle)
+#else
+static void
+gst_gles_compositor_sink_set_window_handle (GstXOverlay *overlay,
+                                            guintptr handle)
+#endif
+{
+    GstGLESCompositorSink *comp = GST_GLES_COMPOSITOR_SINK (overlay);
+
+    GST_DEBUG_OBJECT (comp, "Setting window handle %" G_GUINTPTR_FORMAT,
+                      handle);
+
+    /* the gl thread takes the handle with its setup or switches over
+       before the next frame, this may be called from it as well */
+    g_mutex_lock (&comp->lock);
+    comp->window_handle = handle;
+    comp->window_changed = TRUE;
+    comp->dirty = TRUE;
+    g_cond_signal (&comp->cond);
+    g_mutex_unlock (&comp->lock);
+}
+
+#if GST_CHECK_VERSION(1, 0, 0)
+static void
+gst_gles_compositor_sink_video_overlay_init (GstVideoOverlayInterface * iface)
+{
+    iface->set_window_handle = gst_gles_compositor_sink_set_window_handle;
+}
+#else
+static void
+gst_gles_compositor_sink_xoverlay_interface_init (GstXOverlayClass *klass)
+{
+    klass->set_window_handle = gst_gles_compositor_sink_set_window_handle;
+}
+
+static gboolean
+gst_gles_compositor_sink_xoverlay_supported (GstGLESCompositorSink *comp,
+                                             GType iface_type)
+{
+    g_return_val_if_fail (iface_type == GST_TYPE_X_OVERLAY, FALSE);
+
+    return TRUE;
+}
+#endif
@@ -0,0 +1,163 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _GST_GLES_COMPOSITOR_SINK_H__
+#define _GST_GLES_COMPOSITOR_SINK_H__
+
+#include <GLES2/gl2.h>
+
+#include <gst/gst.h>
+#include <gst/video/gstvideosink.h>
+
+#include "display.h"
+#include "shader.h"
+#include "render.h"
+#include "window.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_GLES_COMPOSITOR_SINK \
+  (gst_gles_compositor_sink_get_type())
+#define GST_GLES_COMPOSITOR_SINK(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_GLES_COMPOSITOR_SINK,GstGLESCompositorSink))
+#define GST_GLES_COMPOSITOR_SINK_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_GLES_COMPOSITOR_SINK,GstGLESCompositorSinkClass))
+#define GST_IS_GLES_COMPOSITOR_SINK(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_GLES_COMPOSITOR_SINK))
+
+#define GST_TYPE_GLES_COMPOSITOR_PAD \
+  (gst_gles_compositor_pad_get_type())
+#define GST_GLES_COMPOSITOR_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_GLES_COMPOSITOR_PAD,GstGLESCompositorPad))
+
+#define GST_TYPE_GLES_COMPOSITOR_INPUT \
+  (gst_gles_compositor_input_get_type())
+#define GST_GLES_COMPOSITOR_INPUT(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_GLES_COMPOSITOR_INPUT,GstGLESCompositorInput))
+
+typedef struct _GstGLESCompositorSink       GstGLESCompositorSink;
+typedef struct _GstGLESCompositorSinkClass  GstGLESCompositorSinkClass;
+typedef struct _GstGLESCompositorPad        GstGLESCompositorPad;
+typedef struct _GstGLESCompositorPadClass   GstGLESCompositorPadClass;
+typedef struct _GstGLESCompositorInput      GstGLESCompositorInput;
+typedef struct _GstGLESCompositorInputClass GstGLESCompositorInputClass;
+
+/* internal sink behind each request pad, it does the clock sync and
+ * hands its buffers over to the compositor */
+struct _GstGLESCompositorInput
+{
+  GstVideoSink basesink;
+
+  GstGLESCompositorSink *compositor;
+
+  /* pixel aspect ratio of the caps, only used by the streaming thread */
+  gint par_n;
+  gint par_d;
+  /* size of buf and the size it is shown with, protected by the
+     compositor lock */
+  gint frame_width;
+  gint frame_height;
+  gint video_width;
+  gint video_height;
+
+  /* layout in window coordinates, protected by the compositor lock */
+  gint xpos;
+  gint ypos;
+  gint width;
+  gint height;
+  guint zorder;
+  gdouble alpha;
+
+  /* latest buffer which has not been uploaded yet, protected by
+     the compositor lock */
+  GstBuffer *buf;
+
+  /* only touched by the gl thread with the render lock held */
+  GstGLESStream stream;
+};
+
+struct _GstGLESCompositorInputClass
+{
+  GstVideoSinkClass basesinkclass;
+};
+
+struct _GstGLESCompositorPad
+{
+  GstGhostPad ghostpad;
+
+  GstGLESCompositorInput *input;
+};
+
+struct _GstGLESCompositorPadClass
+{
+  GstGhostPadClass ghostpadclass;
+};
+
+struct _GstGLESCompositorSink
+{
+  GstBin bin;
+
+  GstGLESWindow window;
+  GstGLESWindowBackendType backend;
+  GstGLESDisplay *display;
+  /* own context in the share group of the display */
+  EGLContext context;
+  /* the window syncs its swaps to vblank, otherwise the backend paces
+     them with frame callbacks */
+  gboolean vsync;
+
+  /* thread context */
+  GThread *thread;
+  GMutex lock;
+  GCond cond;
+  GMutex render_lock;
+  volatile gboolean running;
+  gboolean init_done;
+  gboolean dirty;
+  /* window handle set by the application, picked up by the gl thread */
+  guintptr window_handle;
+  gboolean window_changed;
+
+  /* shader programs, shared by all inputs */
+  GstGLESShader deinterlace;
+  GstGLESShader blend;
+  GLint blend_tex_loc;
+  GLint blend_alpha_loc;
+
+  /* inputs sorted by zorder, protected by lock */
+  GList *inputs;
+  /* streams of released pads, deleted by the gl thread */
+  GArray *released;
+  guint next_pad_id;
+};
+
+struct _GstGLESCompositorSinkClass
+{
+  GstBinClass binclass;
+};
+
+GType gst_gles_compositor_sink_get_type (void);
+GType gst_gles_compositor_pad_get_type (void);
+GType gst_gles_compositor_input_get_type (void);
+
+G_END_DECLS
+
+#endif /* _GST_GLES_COMPOSITOR_SINK_H__ */
@@ -0,0 +1,840 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-glesconvert
+ *
+ * Deinterlaces, colour converts and scales I420 video to RGBA on the GPU,
+ * using the same shaders as glessink. The result is rendered into a ring
+ * of framebuffers and read back readback-depth - 1 frames later, so the
+ * readback does not wait for the frame that has just been submitted.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch -v videotestsrc ! glesconvert ! video/x-raw,width=320,height=240 ! fakesink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#define GST_USE_UNSTABLE_API
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include "gstglesconvert.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_gles_convert_debug);
+#define GST_CAT_DEFAULT gst_gles_convert_debug
+
+#define DEFAULT_READBACK_DEPTH 3
+
+enum
+{
+  PROP_0,
+  PROP_READBACK_DEPTH
+};
+
+#define WxH ", width = (int) [ 16, 4096 ], height = (int) [ 16, 4096 ]"
+
+#if GST_CHECK_VERSION(1, 0, 0)
+#define CONVERT_SINK_CAPS GST_VIDEO_CAPS_MAKE("I420") WxH
+#define CONVERT_SRC_CAPS GST_VIDEO_CAPS_MAKE("RGBA") WxH
+#else
+#define CONVERT_SINK_CAPS GST_VIDEO_CAPS_YUV("I420") WxH
+#define CONVERT_SRC_CAPS GST_VIDEO_CAPS_RGBA WxH
+#endif
+
+static GstStaticPadTemplate convert_sink_factory =
+        GST_STATIC_PAD_TEMPLATE ("sink",
+                                 GST_PAD_SINK,
+                                 GST_PAD_ALWAYS,
+                                 GST_STATIC_CAPS (CONVERT_SINK_CAPS));
+
+static GstStaticPadTemplate convert_src_factory =
+        GST_STATIC_PAD_TEMPLATE ("src",
+                                 GST_PAD_SRC,
+                                 GST_PAD_ALWAYS,
+                                 GST_STATIC_CAPS (CONVERT_SRC_CAPS));
+
+#if GST_CHECK_VERSION(1, 0, 0)
+G_DEFINE_TYPE (GstGLESConvert, gst_gles_convert, GST_TYPE_BASE_TRANSFORM);
+#define parent_class gst_gles_convert_parent_class
+#else
+GST_BOILERPLATE (GstGLESConvert, gst_gles_convert, GstBaseTransform,
+    GST_TYPE_BASE_TRANSFORM);
+#endif
+
+/* the input framebuffer is stored bottom up, this flips it back, so
+ * the rows are read back top down */
+static const GLfloat convert_vertices[] =
+{
+    -1.0f, -1.0f,
+    0.0f, 1.0f,
+
+    1.0f, -1.0f,
+    1.0f, 1.0f,
+
+    1.0f, 1.0f,
+    1.0f, 0.0f,
+
+    -1.0f, 1.0f,
+    0.0f, 0.0f,
+};
+
+/* gl implementation, everything below runs on the render thread */
+
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ       0x88E1
+#endif
+#ifndef GL_MAP_READ_BIT
+#define GL_MAP_READ_BIT      0x0001
+#endif
+
+static void
+gl_convert_delete_ring (GstGLESConvert *conv)
+{
+    gsize size = conv->out_width * conv->out_height * 4;
+    guint i;
+
+    for (i = 0; i < conv->depth; i++) {
+        GstGLESConvertSlot *slot = &conv->slots[i];
+
+        if (slot->framebuffer)
+            glDeleteFramebuffers (1, &slot->framebuffer);
+        gl_texture_pool_release (&conv->display->textures, &conv->memory,
+                                 &slot->tex);
+        if (slot->pbo) {
+            glDeleteBuffers (1, &slot->pbo);
+            gl_memory_uncharge (&conv->display->textures, &conv->memory,
+                                size);
+        }
+    }
+
+    memset (conv->slots, 0, sizeof (conv->slots));
+    conv->depth = 0;
+    conv->write_index = 0;
+    conv->pending = 0;
+}
+
+static GstGLESAllocResult
+gl_convert_alloc_ring (GstGLESConvert *conv)
+{
+    gsize size = conv->out_width * conv->out_height * 4;
+    GstGLESAllocResult res;
+    GLenum status;
+    guint i;
+
+    conv->depth = conv->readback_depth;
+    conv->write_index = 0;
+    conv->pending = 0;
+
+    for (i = 0; i < conv->depth; i++) {
+        GstGLESConvertSlot *slot = &conv->slots[i];
+
+        res = gl_texture_pool_acquire (&conv->display->textures,
+                                       &conv->memory, &slot->tex, GL_RGBA,
+                                       conv->out_width, conv->out_height,
+                                       GL_NEAREST, &conv->display->features);
+        if (res != GST_GLES_ALLOC_OK)
+            goto fail;
+
+        glGenFramebuffers (1, &slot->framebuffer);
+        glBindFramebuffer (GL_FRAMEBUFFER, slot->framebuffer);
+        glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                GL_TEXTURE_2D, slot->tex.id, 0);
+
+        status = glCheckFramebufferStatus (GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            GST_ERROR_OBJECT (conv, "%dx%d framebuffer incomplete: 0x%x",
+                              conv->out_width, conv->out_height, status);
+            res = GST_GLES_ALLOC_FAILED;
+            goto fail;
+        }
+
+        /* with GLES3 the frame is copied into a pack buffer right after
+           rendering, the copy then runs while later frames are drawn */
+        if (conv->display->features.gles3) {
+            GLenum error;
+
+            while (glGetError () != GL_NO_ERROR);
+
+            glGenBuffers (1, &slot->pbo);
+            glBindBuffer (GL_PIXEL_PACK_BUFFER, slot->pbo);
+            glBufferData (GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+            glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+
+            error = glGetError ();
+            if (error != GL_NO_ERROR) {
+                GST_ERROR_OBJECT (conv, "Could not allocate readback "
+                                  "buffer: 0x%x", error);
+                glDeleteBuffers (1, &slot->pbo);
+                slot->pbo = 0;
+                res = GST_GLES_ALLOC_FAILED;
+                goto fail;
+            }
+            gl_memory_charge (&conv->display->textures, &conv->memory,
+                              size);
+        }
+    }
+
+    GST_DEBUG_OBJECT (conv, "%" G_GSIZE_FORMAT " bytes of GPU memory in use",
+                      conv->memory.allocated);
+    return GST_GLES_ALLOC_OK;
+
+fail:
+    gl_convert_delete_ring (conv);
+    return res;
+}
+
+/* reads the oldest frame in flight into outdata */
+static void
+gl_convert_read (GstGLESConvert *conv)
+{
+    guint index = (conv->write_index + conv->depth - conv->pending) %
+                  conv->depth;
+    GstGLESConvertSlot *slot = &conv->slots[index];
+    const GstGLESFeatures *gl = &conv->display->features;
+    gsize size = conv->out_width * conv->out_height * 4;
+    gpointer data;
+
+    if (slot->pbo) {
+        glBindBuffer (GL_PIXEL_PACK_BUFFER, slot->pbo);
+        data = gl->MapBufferRange (GL_PIXEL_PACK_BUFFER, 0, size,
+                                   GL_MAP_READ_BIT);
+        if (data) {
+            memcpy (conv->outdata, data, size);
+            gl->UnmapBuffer (GL_PIXEL_PACK_BUFFER);
+        } else {
+            GST_WARNING_OBJECT (conv, "Could not map readback buffer");
+        }
+        glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+    } else {
+        glBindFramebuffer (GL_FRAMEBUFFER, slot->framebuffer);
+        glPixelStorei (GL_PACK_ALIGNMENT, 4);
+        glReadPixels (0, 0, conv->out_width, conv->out_height, GL_RGBA,
+                      GL_UNSIGNED_BYTE, conv->outdata);
+    }
+
+    conv->pending--;
+    conv->out_slot = slot;
+}
+
+static void
+gl_convert_job (gpointer data)
+{
+    GstGLESConvert *conv = GST_GLES_CONVERT (data);
+    GstGLESConvertSlot *slot;
+
+    conv->out_slot = NULL;
+    conv->alloc_failed = FALSE;
+    if (!gst_gles_render_thread_make_current (conv->render,
+                                              conv->window.surface))
+        return;
+
+    if (!conv->stream.initialized) {
+        gl_stream_init (&conv->stream, &conv->deinterlace,
+                        &conv->display->features, &conv->display->textures,
+                        &conv->memory);
+        conv->stream.rgb_tex.loc = glGetUniformLocation (conv->scale.program,
+                                                         "s_tex");
+        if (gl_stream_gen_framebuffer (GST_ELEMENT (conv), &conv->stream,
+                                       conv->in_width, conv->in_height) !=
+            GST_GLES_ALLOC_OK ||
+            gl_convert_alloc_ring (conv) != GST_GLES_ALLOC_OK) {
+            gl_stream_delete (&conv->stream);
+            conv->alloc_failed = TRUE;
+            return;
+        }
+    }
+
+    gl_stream_draw_fbo (GST_ELEMENT (conv), &conv->stream,
+                        &conv->deinterlace, conv->inbuf);
+
+    slot = &conv->slots[conv->write_index];
+
+    glUseProgram (conv->scale.program);
+    glBindFramebuffer (GL_FRAMEBUFFER, slot->framebuffer);
+    glViewport (0, 0, conv->out_width, conv->out_height);
+
+    glActiveTexture (GL_TEXTURE3);
+    glBindTexture (GL_TEXTURE_2D, conv->stream.rgb_tex.id);
+    glUniform1i (conv->stream.rgb_tex.loc, 3);
+
+    gl_draw_quad (&conv->scale, convert_vertices);
+
+    if (slot->pbo) {
+        glBindBuffer (GL_PIXEL_PACK_BUFFER, slot->pbo);
+        glPixelStorei (GL_PACK_ALIGNMENT, 4);
+        glReadPixels (0, 0, conv->out_width, conv->out_height, GL_RGBA,
+                      GL_UNSIGNED_BYTE, NULL);
+        glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    /* get the gpu going, the frame is not read back before the ring
+       wrapped around */
+    glFlush ();
+
+    slot->timestamp = GST_BUFFER_TIMESTAMP (conv->inbuf);
+    slot->duration = GST_BUFFER_DURATION (conv->inbuf);
+    conv->write_index = (conv->write_index + 1) % conv->depth;
+    conv->pending++;
+
+    if (conv->pending >= conv->depth)
+        gl_convert_read (conv);
+}
+
+static void
+gl_convert_read_job (gpointer data)
+{
+    GstGLESConvert *conv = GST_GLES_CONVERT (data);
+
+    conv->out_slot = NULL;
+    if (gst_gles_render_thread_make_current (conv->render,
+                                             conv->window.surface))
+        gl_convert_read (conv);
+}
+
+static void
+gl_convert_reset_job (gpointer data)
+{
+    GstGLESConvert *conv = GST_GLES_CONVERT (data);
+
+    if (!gst_gles_render_thread_make_current (conv->render,
+                                              conv->window.surface))
+        return;
+
+    gl_convert_delete_ring (conv);
+    gl_stream_delete (&conv->stream);
+}
+
+static void
+gl_convert_close_job (gpointer data)
+{
+    GstGLESConvert *conv = GST_GLES_CONVERT (data);
+
+    if (gst_gles_render_thread_make_current (conv->render,
+                                             conv->window.surface)) {
+        gl_convert_delete_ring (conv);
+        gl_stream_delete (&conv->stream);
+        gl_delete_shader (&conv->scale);
+        gl_delete_shader (&conv->deinterlace);
+    }
+
+    gst_gles_render_thread_release_current (conv->render);
+    egl_close_surface (GST_ELEMENT (conv), &conv->window);
+    window_close (GST_ELEMENT (conv), &conv->window);
+}
+
+static void
+gl_convert_setup_job (gpointer data)
+{
+    GstGLESConvert *conv = GST_GLES_CONVERT (data);
+    GstGLESDisplay *display = conv->display;
+
+    conv->initialized = FALSE;
+
+    /* all rendering goes to framebuffer objects, the surface is only
+       needed to make the context current */
+    conv->window.egl_display = display->egl_display;
+    if (window_init (GST_ELEMENT (conv), &conv->window, display->backend,
+                     display->native_display, 16, 16) < 0 ||
+        egl_init_surface (GST_ELEMENT (conv), &conv->window,
+                          display->config) < 0 ||
+        !gst_gles_render_thread_make_current (conv->render,
+                                              conv->window.surface)) {
+        GST_ERROR_OBJECT (conv, "EGL init failed, abort");
+        goto fail;
+    }
+
+    if (gst_gles_display_link_shader (display, GST_ELEMENT (conv),
+                                      &conv->deinterlace,
+                                      SHADER_DEINT_LINEAR) < 0 ||
+        gst_gles_display_link_shader (display, GST_ELEMENT (conv),
+                                      &conv->scale, SHADER_COPY) < 0) {
+        GST_ERROR_OBJECT (conv, "Could not initialize shaders");
+        goto fail;
+    }
+
+    conv->initialized = TRUE;
+    return;
+
+fail:
+    gl_convert_close_job (conv);
+}
+
+/* element implementation */
+
+static gboolean
+gst_gles_convert_parse_caps (GstCaps *caps, gint *width, gint *height,
+                             gsize *size)
+{
+#if GST_CHECK_VERSION(1, 0, 0)
+  GstVideoInfo info;
+
+  if (!gst_video_info_from_caps (&info, caps))
+    return FALSE;
+
+  *width = info.width;
+  *height = info.height;
+  *size = info.size;
+#else
+  GstVideoFormat fmt;
+
+  if (!gst_video_format_parse_caps (caps, &fmt, width, height))
+    return FALSE;
+
+  *size = gst_video_format_get_size (fmt, *width, *height);
+#endif
+  return TRUE;
+}
+
+#if GST_CHECK_VERSION(1, 0, 0)
+static GstCaps *
+gst_gles_convert_transform_caps (GstBaseTransform *trans,
+    GstPadDirection direction, GstCaps *caps, GstCaps *filter)
+#else
+static GstCaps *
+gst_gles_convert_transform_caps (GstBaseTransform *trans,
+    GstPadDirection direction, GstCaps *caps)
+#endif
+{
+  const GValue *framerate = NULL;
+  GstCaps *ret;
+  guint i;
+
+  /* format and size may change, the frame rate is passed through */
+  ret = gst_caps_from_string (direction == GST_PAD_SINK ?
+                              CONVERT_SRC_CAPS : CONVERT_SINK_CAPS);
+
+  if (gst_caps_get_size (caps) > 0)
+    framerate = gst_structure_get_value (gst_caps_get_structure (caps, 0),
+                                         "framerate");
+  if (framerate) {
+    for (i = 0; i < gst_caps_get_size (ret); i++)
+      gst_structure_set_value (gst_caps_get_structure (ret, i), "framerate",
+                               framerate);
+  }
+
+#if GST_CHECK_VERSION(1, 0, 0)
+  if (filter) {
+    GstCaps *tmp = gst_caps_intersect_full (filter, ret,
+                                            GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (ret);
+    ret = tmp;
+  }
+#endif
+
+  return ret;
+}
+
+#if GST_CHECK_VERSION(1, 0, 0)
+static GstCaps *
+gst_gles_convert_fixate_caps (GstBaseTransform *trans,
+    GstPadDirection direction, GstCaps *caps, GstCaps *othercaps)
+#else
+static void
+gst_gles_convert_fixate_caps (GstBaseTransform *trans,
+    GstPadDirection direction, GstCaps *caps, GstCaps *othercaps)
+#endif
+{
+  GstStructure *ins;
+  GstStructure *outs;
+  gint fps_n;
+  gint fps_d;
+  gint width;
+  gint height;
+
+#if GST_CHECK_VERSION(1, 0, 0)
+  othercaps = gst_caps_truncate (othercaps);
+  othercaps = gst_caps_make_writable (othercaps);
+#else
+  gst_caps_truncate (othercaps);
+#endif
+
+  ins = gst_caps_get_structure (caps, 0);
+  outs = gst_caps_get_structure (othercaps, 0);
+
+  /* keep the size, unless the other side asks for scaling */
+  if (gst_structure_get_int (ins, "width", &width))
+    gst_structure_fixate_field_nearest_int (outs, "width", width);
+  if (gst_structure_get_int (ins, "height", &height))
+    gst_structure_fixate_field_nearest_int (outs, "height", height);
+  if (gst_structure_get_fraction (ins, "framerate", &fps_n, &fps_d))
+    gst_structure_fixate_field_nearest_fraction (outs, "framerate",
+                                                 fps_n, fps_d);
+
+#if GST_CHECK_VERSION(1, 0, 0)
+  return gst_caps_fixate (othercaps);
+#endif
+}
+
+#if GST_CHECK_VERSION(1, 0, 0)
+static gboolean
+gst_gles_convert_get_unit_size (GstBaseTransform *trans, GstCaps *caps,
+    gsize *size)
+#else
+static gboolean
+gst_gles_convert_get_unit_size (GstBaseTransform *trans, GstCaps *caps,
+    guint *size)
+#endif
+{
+  gsize frame_size;
+  gint width;
+  gint height;
+
+  if (!gst_gles_convert_parse_caps (caps, &width, &height, &frame_size))
+    return FALSE;
+
+  *size = frame_size;
+  return TRUE;
+}
+
+static gboolean
+gst_gles_convert_set_caps (GstBaseTransform *trans, GstCaps *incaps,
+    GstCaps *outcaps)
+{
+  GstGLESConvert *conv = GST_GLES_CONVERT (trans);
+  gint in_width, in_height;
+  gint out_width, out_height;
+  gsize size;
+
+  if (!gst_gles_convert_parse_caps (incaps, &in_width, &in_height, &size) ||
+      !gst_gles_convert_parse_caps (outcaps, &out_width, &out_height,
+                                    &size)) {
+    GST_WARNING_OBJECT (conv, "Failed to read video info from caps");
+    return FALSE;
+  }
+
+  if (in_width == conv->in_width && in_height == conv->in_height &&
+      out_width == conv->out_width && out_height == conv->out_height)
+    return TRUE;
+
+  /* the buffers are reallocated with the first frame */
+  if (conv->pending)
+    GST_DEBUG_OBJECT (conv, "Size changed, dropping %u frames in flight",
+                      conv->pending);
+  gst_gles_render_thread_invoke (conv->render, gl_convert_reset_job, conv);
+
+  conv->in_width = in_width;
+  conv->in_height = in_height;
+  conv->out_width = out_width;
+  conv->out_height = out_height;
+
+  GST_DEBUG_OBJECT (conv, "Converting %dx%d to %dx%d", in_width, in_height,
+                    out_width, out_height);
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_gles_convert_transform (GstBaseTransform *trans, GstBuffer *inbuf,
+    GstBuffer *outbuf)
+{
+  GstGLESConvert *conv = GST_GLES_CONVERT (trans);
+#if GST_CHECK_VERSION(1, 0, 0)
+  GstMapInfo map;
+
+  if (!gst_buffer_map (outbuf, &map, GST_MAP_WRITE)) {
+    GST_WARNING_OBJECT (conv, "Failed to map output buffer");
+    return GST_FLOW_ERROR;
+  }
+  conv->outdata = map.data;
+#else
+  conv->outdata = GST_BUFFER_DATA (outbuf);
+#endif
+
+  conv->inbuf = inbuf;
+  gst_gles_render_thread_invoke (conv->render, gl_convert_job, conv);
+  conv->inbuf = NULL;
+
+#if GST_CHECK_VERSION(1, 0, 0)
+  gst_buffer_unmap (outbuf, &map);
+#endif
+
+  if (conv->alloc_failed) {
+    GST_ELEMENT_ERROR (conv, RESOURCE, FAILED,
+        ("Could not allocate textures"),
+        ("%dx%d to %dx%d with %u frames in flight", conv->in_width,
+         conv->in_height, conv->out_width, conv->out_height,
+         conv->readback_depth));
+    return GST_FLOW_ERROR;
+  }
+
+  /* nothing to read back while the ring fills up */
+  if (!conv->out_slot)
+    return GST_BASE_TRANSFORM_FLOW_DROPPED;
+
+  GST_BUFFER_TIMESTAMP (outbuf) = conv->out_slot->timestamp;
+  GST_BUFFER_DURATION (outbuf) = conv->out_slot->duration;
+
+  return GST_FLOW_OK;
+}
+
+/* reads back and pushes all frames still in flight */
+static GstFlowReturn
+gst_gles_convert_drain (GstGLESConvert *conv)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM (conv);
+  GstFlowReturn ret = GST_FLOW_OK;
+  gsize size = conv->out_width * conv->out_height * 4;
+
+  GST_DEBUG_OBJECT (conv, "Draining %u frames", conv->pending);
+
+  while (conv->pending > 0 && ret == GST_FLOW_OK) {
+    GstBuffer *buf;
+#if GST_CHECK_VERSION(1, 0, 0)
+    GstMapInfo map;
+
+    buf = gst_buffer_new_allocate (NULL, size, NULL);
+    gst_buffer_map (buf, &map, GST_MAP_WRITE);
+    conv->outdata = map.data;
+#else
+    buf = gst_buffer_new_and_alloc (size);
+    gst_buffer_set_caps (buf, GST_PAD_CAPS (trans->srcpad));
+    conv->outdata = GST_BUFFER_DATA (buf);
+#endif
+
+    gst_gles_render_thread_invoke (conv->render, gl_convert_read_job, conv);
+
+#if GST_CHECK_VERSION(1, 0, 0)
+    gst_buffer_unmap (buf, &map);
+#endif
+
+    if (!conv->out_slot) {
+      gst_buffer_unref (buf);
+      break;
+    }
+
+    GST_BUFFER_TIMESTAMP (buf) = conv->out_slot->timestamp;
+    GST_BUFFER_DURATION (buf) = conv->out_slot->duration;
+    ret = gst_pad_push (trans->srcpad, buf);
+  }
+
+  conv->pending = 0;
+  return ret;
+}
+
+static gboolean
+gst_gles_convert_sink_event (GstBaseTransform *trans, GstEvent *event)
+{
+  GstGLESConvert *conv = GST_GLES_CONVERT (trans);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_EOS:
+      gst_gles_convert_drain (conv);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      /* frames in flight belong to the old segment */
+      conv->pending = 0;
+      break;
+    default:
+      break;
+  }
+
+#if GST_CHECK_VERSION(1, 0, 0)
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (trans, event);
+#else
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->event (trans, event);
+#endif
+}
+
+static gboolean
+gst_gles_convert_start (GstBaseTransform *trans)
+{
+  GstGLESConvert *conv = GST_GLES_CONVERT (trans);
+
+  /* nothing is shown, so the window system is never needed */
+  conv->display = gst_gles_display_ref_default (GST_ELEMENT (conv),
+      GST_GLES_WINDOW_BACKEND_HEADLESS);
+  if (!conv->display)
+    goto fail;
+
+  conv->render = gst_gles_display_acquire_thread (conv->display,
+                                                  GST_ELEMENT (conv));
+  if (!conv->render)
+    goto fail;
+
+  gst_gles_render_thread_invoke (conv->render, gl_convert_setup_job, conv);
+  if (!conv->initialized)
+    goto fail;
+
+  return TRUE;
+
+fail:
+  if (conv->render) {
+    gst_gles_display_release_thread (conv->display, conv->render);
+    conv->render = NULL;
+  }
+  if (conv->display) {
+    gst_gles_display_unref (conv->display);
+    conv->display = NULL;
+  }
+
+  GST_ELEMENT_ERROR (conv, LIBRARY, INIT, ("Can't initialize GL context"),
+                     (NULL));
+  return FALSE;
+}
+
+static gboolean
+gst_gles_convert_stop (GstBaseTransform *trans)
+{
+  GstGLESConvert *conv = GST_GLES_CONVERT (trans);
+
+  if (conv->render) {
+    gst_gles_render_thread_invoke (conv->render, gl_convert_close_job, conv);
+    gst_gles_display_release_thread (conv->display, conv->render);
+    conv->render = NULL;
+    gst_gles_display_unref (conv->display);
+    conv->display = NULL;
+  }
+
+  conv->initialized = FALSE;
+  conv->in_width = conv->in_height = 0;
+  conv->out_width = conv->out_height = 0;
+
+  return TRUE;
+}
+
+static void
+gst_gles_convert_set_property (GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
+{
+  GstGLESConvert *conv = GST_GLES_CONVERT (object);
+
+  switch (prop_id) {
+    case PROP_READBACK_DEPTH:
+      conv->readback_depth = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_gles_convert_get_property (GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+  GstGLESConvert *conv = GST_GLES_CONVERT (object);
+
+  switch (prop_id) {
+    case PROP_READBACK_DEPTH:
+      g_value_set_uint (value, conv->readback_depth);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+#if !GST_CHECK_VERSION(1, 0, 0)
+static void
+gst_gles_convert_base_init (gpointer gclass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS (gclass);
+
+  gst_element_class_set_details_simple(element_class,
+    "GLES converter",
+    "Filter/Converter/Video",
+    "Deinterlace, convert and scale video using Open GL ES 2.0",
+    "Julian Scheel <julian jusst de>");
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&convert_sink_factory));
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&convert_src_factory));
+}
+#endif
+
+static void
+gst_gles_convert_class_init (GstGLESConvertClass *klass)
+{
+  GstBaseTransformClass *transform_class = GST_BASE_TRANSFORM_CLASS (klass);
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+#if GST_CHECK_VERSION(1, 0, 0)
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+#endif
+
+  GST_DEBUG_CATEGORY_INIT (gst_gles_convert_debug, "glesconvert", 0,
+      "OpenGL ES 2.0 converter");
+
+  gobject_class->set_property = gst_gles_convert_set_property;
+  gobject_class->get_property = gst_gles_convert_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_READBACK_DEPTH,
+      g_param_spec_uint ("readback-depth", "Readback depth", "Number of "
+          "frames in flight, a frame is read back readback-depth - 1 frames "
+          "after it has been rendered. 1 reads back synchronously.",
+          1, GST_GLES_CONVERT_MAX_DEPTH, DEFAULT_READBACK_DEPTH,
+          G_PARAM_READWRITE));
+
+  transform_class->start = GST_DEBUG_FUNCPTR (gst_gles_convert_start);
+  transform_class->stop = GST_DEBUG_FUNCPTR (gst_gles_convert_stop);
+  transform_class->transform_caps =
+      GST_DEBUG_FUNCPTR (gst_gles_convert_transform_caps);
+  transform_class->fixate_caps =
+      GST_DEBUG_FUNCPTR (gst_gles_convert_fixate_caps);
+  transform_class->get_unit_size =
+      GST_DEBUG_FUNCPTR (gst_gles_convert_get_unit_size);
+  transform_class->set_caps = GST_DEBUG_FUNCPTR (gst_gles_convert_set_caps);
+  transform_class->transform = GST_DEBUG_FUNCPTR (gst_gles_convert_transform);
+#if GST_CHECK_VERSION(1, 0, 0)
+  transform_class->sink_event =
+      GST_DEBUG_FUNCPTR (gst_gles_convert_sink_event);
+
+  gst_element_class_set_details_simple(element_class,
+    "GLES converter",
+    "Filter/Converter/Video",
+    "Deinterlace, convert and scale video using Open GL ES 2.0",
+    "Julian Scheel <julian jusst de>");
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&convert_sink_factory));
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&convert_src_factory));
+#else
+  transform_class->event = GST_DEBUG_FUNCPTR (gst_gles_convert_sink_event);
+#endif
+}
+
+#if GST_CHECK_VERSION(1, 0, 0)
+static void
+gst_gles_convert_init (GstGLESConvert *conv)
+#else
+static void
+gst_gles_convert_init (GstGLESConvert *conv, GstGLESConvertClass *gclass)
+#endif
+{
+  conv->readback_depth = DEFAULT_READBACK_DEPTH;
+}
@@ -0,0 +1,113 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _GST_GLES_CONVERT_H__
+#define _GST_GLES_CONVERT_H__
+
+#include <GLES2/gl2.h>
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+
+#include "display.h"
+#include "shader.h"
+#include "render.h"
+#include "window.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_GLES_CONVERT \
+  (gst_gles_convert_get_type())
+#define GST_GLES_CONVERT(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_GLES_CONVERT,GstGLESConvert))
+#define GST_GLES_CONVERT_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_GLES_CONVERT,GstGLESConvertClass))
+#define GST_IS_GLES_CONVERT(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_GLES_CONVERT))
+
+/* upper limit of frames in flight between rendering and readback */
+#define GST_GLES_CONVERT_MAX_DEPTH 8
+
+typedef struct _GstGLESConvert       GstGLESConvert;
+typedef struct _GstGLESConvertClass  GstGLESConvertClass;
+typedef struct _GstGLESConvertSlot   GstGLESConvertSlot;
+
+/* output framebuffer of the readback ring and the timing of the frame
+ * rendered into it */
+struct _GstGLESConvertSlot
+{
+  GLuint framebuffer;
+  GstGLESTexture tex;
+  /* pack buffer the frame is copied into with GLES3, 0 otherwise */
+  GLuint pbo;
+
+  GstClockTime timestamp;
+  GstClockTime duration;
+};
+
+struct _GstGLESConvert
+{
+  GstBaseTransform transform;
+
+  /* offscreen surface the context is made current on */
+  GstGLESWindow window;
+  GstGLESDisplay *display;
+  GstGLESRenderThread *render;
+  gboolean initialized;
+
+  GstGLESShader deinterlace;
+  GstGLESShader scale;
+  GstGLESStream stream;
+  /* gpu memory of the stream and the readback ring, no budget */
+  GstGLESMemory memory;
+
+  /* readback ring, frames are read back depth - 1 frames after they
+   * have been rendered */
+  GstGLESConvertSlot slots[GST_GLES_CONVERT_MAX_DEPTH];
+  guint depth;
+  guint write_index;
+  guint pending;
+
+  gint in_width;
+  gint in_height;
+  gint out_width;
+  gint out_height;
+
+  /* job data */
+  GstBuffer *inbuf;
+  guint8 *outdata;
+  GstGLESConvertSlot *out_slot;
+  gboolean alloc_failed;
+
+  /* properties */
+  guint readback_depth;
+};
+
+struct _GstGLESConvertClass
+{
+  GstBaseTransformClass transformclass;
+};
+
+GType gst_gles_convert_get_type (void);
+
+G_END_DECLS
+
+#endif /* _GST_GLES_CONVERT_H__ */
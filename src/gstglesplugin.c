@@ -0,0 +1,88 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#define GST_USE_UNSTABLE_API
+#include <gst/gst.h>
+
+#include "gstglessink.h"
+#include "gstglescompositorsink.h"
+#include "gstglesconvert.h"
+
+/* entry point to initialize the plug-in
+ * initialize the plug-in itself
+ * register the element factories and other features
+ */
+static gboolean
+plugin_init (GstPlugin * plugin)
+{
+  /* debug category for fltering log messages
+   *
+   * exchange the string 'Template plugin' with your description
+   */
+  GST_DEBUG_CATEGORY_INIT (gst_gles_sink_debug, "glesplugin",
+      0, "OpenGL ES 2.0 plugin");
+
+  if (!gst_element_register (plugin, "glessink", GST_RANK_NONE,
+      GST_TYPE_GLES_SINK))
+    return FALSE;
+
+  if (!gst_element_register (plugin, "glescompositorsink", GST_RANK_NONE,
+      GST_TYPE_GLES_COMPOSITOR_SINK))
+    return FALSE;
+
+  return gst_element_register (plugin, "glesconvert", GST_RANK_NONE,
+      GST_TYPE_GLES_CONVERT);
+}
+
+/* PACKAGE: this is usually set by autotools depending on some _INIT macro
+ * in configure.ac and then written into and defined in config.h, but we can
+ * just set it ourselves here in case someone doesn't use autotools to
+ * compile this code. GST_PLUGIN_DEFINE needs PACKAGE to be defined.
+ */
+#ifndef PACKAGE
+#define PACKAGE "glesplugin"
+#endif
+
+/* gstreamer looks for this structure to register plugins
+ *
+ * exchange the string 'Template plugin' with your plugin description
+ */
+GST_PLUGIN_DEFINE (
+    GST_VERSION_MAJOR,
+    GST_VERSION_MINOR,
+#if GST_CHECK_VERSION(1, 0, 0)
+    glesplugin,
+#else
+    "glesplugin",
+#endif
+    "Open GL ES 2.0 plugin",
+    plugin_init,
+    VERSION,
+    "LGPL",
+    "Avionic Design",
+    "http://avionic-design.de/"
+)
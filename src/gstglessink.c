@@ -30,6 +30,10 @@
  * |[
  * gst-launch -v -m videotestsrc ! glessink
  * ]|
+ * Without a display server, e.g. on build machines, render offscreen:
+ * |[
+ * gst-launch -v -m videotestsrc ! glessink backend=headless
+ * ]|
  * </refsect2>
  */
 
@@ -48,9 +52,13 @@
 
 #if GST_CHECK_VERSION(1, 0, 0)
 #include <gst/video/videooverlay.h>
+#include <gst/video/colorbalance.h>
 #else
 #include <gst/interfaces/xoverlay.h>
 #endif
+#if GST_CHECK_VERSION(1, 10, 0)
+#include <gst/video/videodirection.h>
+#endif
 #include <gst/video/video.h>
 
 #include <EGL/egl.h>
@@ -77,46 +85,120 @@ enum _GstGLESPluginProperties
   PROP_CROP_BOTTOM,
   PROP_CROP_LEFT,
   PROP_CROP_RIGHT,
-  PROP_DROP_FIRST
+  PROP_DROP_FIRST,
+  PROP_BACKEND,
+  PROP_PERSISTENT,
+  PROP_MAX_FPS,
+  PROP_TIMELINE,
+  PROP_PRESENT_INTERVAL,
+  PROP_VIDEO_DIRECTION,
+  PROP_BRIGHTNESS,
+  PROP_CONTRAST,
+  PROP_HUE,
+  PROP_SATURATION,
+  PROP_INIT_STATS,
+  PROP_CLOSE_DRIVER_FDS,
+  PROP_MAX_GPU_MEMORY,
+  PROP_MEMORY_STATS,
+  PROP_FRAME_BLENDING
 };
 
-#if GST_CHECK_VERSION(1, 0, 0)
+enum
+{
+  SIGNAL_SNAPSHOT,
+  SIGNAL_SNAPSHOT_READY,
+  LAST_SIGNAL
+};
+
+static guint gst_gles_sink_signals[LAST_SIGNAL] = { 0 };
+
+#if GST_CHECK_VERSION(1, 10, 0)
 static void
 gst_gles_video_overlay_init (GstVideoOverlayInterface * iface);
+static void
+gst_gles_color_balance_init (GstColorBalanceInterface * iface);
+static void
+gst_gles_video_direction_init (GstVideoDirectionInterface * iface);
 
 G_DEFINE_TYPE_WITH_CODE (GstGLESSink, gst_gles_sink, GST_TYPE_VIDEO_SINK,
     G_IMPLEMENT_INTERFACE(GST_TYPE_VIDEO_OVERLAY,
-    gst_gles_video_overlay_init));
+    gst_gles_video_overlay_init)
+    G_IMPLEMENT_INTERFACE(GST_TYPE_COLOR_BALANCE,
+    gst_gles_color_balance_init)
+    G_IMPLEMENT_INTERFACE(GST_TYPE_VIDEO_DIRECTION,
+    gst_gles_video_direction_init));
+#elif GST_CHECK_VERSION(1, 0, 0)
+static void
+gst_gles_video_overlay_init (GstVideoOverlayInterface * iface);
+static void
+gst_gles_color_balance_init (GstColorBalanceInterface * iface);
+
+G_DEFINE_TYPE_WITH_CODE (GstGLESSink, gst_gles_sink, GST_TYPE_VIDEO_SINK,
+    G_IMPLEMENT_INTERFACE(GST_TYPE_VIDEO_OVERLAY,
+    gst_gles_video_overlay_init)
+    G_IMPLEMENT_INTERFACE(GST_TYPE_COLOR_BALANCE,
+    gst_gles_color_balance_init));
 #else
 GST_BOILERPLATE_WITH_INTERFACE (GstGLESSink, gst_gles_sink, GstVideoSink,
     GST_TYPE_VIDEO_SINK, GstXOverlay, GST_TYPE_X_OVERLAY, gst_gles_xoverlay)
 #endif
 
+#if GST_CHECK_VERSION(1, 0, 0)
+#define parent_class gst_gles_sink_parent_class
+#endif
+
 static void gst_gles_sink_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
 static void gst_gles_sink_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec);
 
+static GstStateChangeReturn gst_gles_sink_change_state (GstElement * element,
+    GstStateChange transition);
 static gboolean gst_gles_sink_start (GstBaseSink * basesink);
 static gboolean gst_gles_sink_stop (GstBaseSink * basesink);
+#if GST_CHECK_VERSION(1, 0, 0)
+static GstCaps *gst_gles_sink_get_caps (GstBaseSink * basesink,
+                                        GstCaps * filter);
+#else
+static GstCaps *gst_gles_sink_get_caps (GstBaseSink * basesink);
+#endif
 static gboolean gst_gles_sink_set_caps (GstBaseSink * basesink,
                                           GstCaps * caps);
 static GstFlowReturn gst_gles_sink_render (GstBaseSink * basesink,
                                              GstBuffer * buf);
 static GstFlowReturn gst_gles_sink_preroll (GstBaseSink * basesink,
                                               GstBuffer * buf);
+#if GST_CHECK_VERSION(1, 0, 0)
+static gboolean gst_gles_sink_propose_allocation (GstBaseSink * basesink,
+                                                  GstQuery * query);
+#endif
+#if GST_CHECK_VERSION(1, 2, 0) && defined(HAVE_WAYLAND)
+static void gst_gles_sink_set_context (GstElement * element,
+                                       GstContext * context);
+#endif
+#if GST_CHECK_VERSION(1, 10, 0)
+static gboolean gst_gles_sink_event (GstBaseSink * basesink,
+                                     GstEvent * event);
+#endif
 static void gst_gles_sink_finalize (GObject *gobject);
 static gint setup_gl_context (GstGLESSink *sink);
-static gpointer gl_thread_proc (gpointer data);
 
-#define WxH ", width = (int) [ 16, 4096 ], height = (int) [ 16, 4096 ]"
+#define GST_GLES_MIN_SIZE 16
+#define GST_GLES_MAX_SIZE 16384
+#define WxH ", width = (int) [ " G_STRINGIFY (GST_GLES_MIN_SIZE) ", " \
+            G_STRINGIFY (GST_GLES_MAX_SIZE) " ], height = (int) [ " \
+            G_STRINGIFY (GST_GLES_MIN_SIZE) ", " \
+            G_STRINGIFY (GST_GLES_MAX_SIZE) " ]"
 
 #if GST_CHECK_VERSION(1, 0, 0)
 static GstStaticPadTemplate gles_sink_factory =
         GST_STATIC_PAD_TEMPLATE ("sink",
                                  GST_PAD_SINK,
                                  GST_PAD_ALWAYS,
-                                 GST_STATIC_CAPS ( GST_VIDEO_CAPS_MAKE("I420")
+                                 GST_STATIC_CAPS ( GST_VIDEO_CAPS_MAKE_WITH_FEATURES(
+                                                   GST_CAPS_FEATURE_META_GST_VIDEO_OVERLAY_COMPOSITION,
+                                                   "I420") WxH "; "
+                                                   GST_VIDEO_CAPS_MAKE("I420")
                                                    WxH) );
 #else
 static GstStaticPadTemplate gles_sink_factory =
@@ -127,201 +209,411 @@ static GstStaticPadTemplate gles_sink_factory =
                                                    WxH) );
 #endif
 
-/* OpenGL ES 2.0 implementation */
-static GLuint
-gl_create_texture(GLuint tex_filter)
+/* rotations and flips in the order of GstVideoOrientationMethod, as the
+ * matrix taking a window position to the position of the picture shown
+ * there. both are normalized to -0.5..0.5 and counted from the top left */
+static const gint gl_directions[][4] =
 {
-    GLuint tex_id = 0;
+    {  1,  0,  0,  1 },     /* identity */
+    {  0,  1, -1,  0 },     /* 90r */
+    { -1,  0,  0, -1 },     /* 180 */
+    {  0, -1,  1,  0 },     /* 90l */
+    { -1,  0,  0,  1 },     /* horiz */
+    {  1,  0,  0, -1 },     /* vert */
+    {  0,  1,  1,  0 },     /* ul-lr */
+    {  0, -1, -1,  0 },     /* ur-ll */
+};
 
-    glGenTextures (1, &tex_id);
-    glBindTexture (GL_TEXTURE_2D, tex_id);
+static const gint *
+gl_get_direction (GstGLESSink *sink)
+{
+    guint method;
 
-    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, tex_filter);
-    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, tex_filter);
+    GST_OBJECT_LOCK (sink);
+    method = sink->direction;
+#if GST_CHECK_VERSION(1, 10, 0)
+    if (method == GST_VIDEO_ORIENTATION_AUTO)
+        method = sink->tag_direction;
+#endif
+    GST_OBJECT_UNLOCK (sink);
 
-    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    /* custom has no meaning for a sink */
+    if (method >= G_N_ELEMENTS (gl_directions))
+        method = 0;
 
-    return tex_id;
+    return gl_directions[method];
 }
 
+/* the inverse of the orthogonal matrices is their transpose */
 static void
-gl_gen_framebuffer(GstGLESSink *sink)
+gl_direction_map (const gint *m, gboolean inverse, float x, float y,
+                  float *out_x, float *out_y)
 {
-    GstGLESContext *gles = &sink->gl_thread.gles;
-    glGenFramebuffers (1, &gles->framebuffer);
+    x -= 0.5f;
+    y -= 0.5f;
+    if (inverse) {
+        *out_x = 0.5f + m[0] * x + m[2] * y;
+        *out_y = 0.5f + m[1] * x + m[3] * y;
+    } else {
+        *out_x = 0.5f + m[0] * x + m[1] * y;
+        *out_y = 0.5f + m[2] * x + m[3] * y;
+    }
+}
 
-    gles->rgb_tex.id = gl_create_texture(GL_LINEAR);
-    if (!gles->rgb_tex.id)
-        GST_ERROR_OBJECT (sink, "Could not create RGB texture");
+/* overlays and frame blending need programs of their own, there may be
+ * no binaries of these. they are linked when first used, if that fails
+ * the feature is turned off for the context instead of the whole sink */
+static gboolean
+gl_link_optional_shader (GstGLESSink *sink, GstGLESShader *shader,
+                         GstGLESShaderTypes process_type, gboolean *failed)
+{
+    if (shader->program)
+        return TRUE;
+    if (*failed)
+        return FALSE;
 
-    glTexImage2D (GL_TEXTURE_2D, 0, GL_RGB, GST_VIDEO_SINK_WIDTH (sink),
-                  GST_VIDEO_SINK_HEIGHT (sink), 0, GL_RGB,
-                  GL_UNSIGNED_BYTE, NULL);
+    if (gst_gles_display_link_shader (sink->gl_thread.display,
+                                      GST_ELEMENT (sink), shader,
+                                      process_type) < 0) {
+        GST_ELEMENT_WARNING (sink, RESOURCE, FAILED,
+                             ("Could not initialize shader"),
+                             ("shader %d is not available, disabled",
+                              process_type));
+        *failed = TRUE;
+        return FALSE;
+    }
 
-    glBindFramebuffer (GL_FRAMEBUFFER, gles->framebuffer);
-    glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                            GL_TEXTURE_2D, gles->rgb_tex.id, 0);
+    return TRUE;
 }
 
+#if GST_CHECK_VERSION(1, 0, 0)
 static void
-gl_init_textures (GstGLESSink *sink)
+gl_delete_overlays (GstGLESSink *sink)
 {
-    sink->gl_thread.gles.y_tex.id = gl_create_texture(GL_NEAREST);
-    sink->gl_thread.gles.u_tex.id = gl_create_texture(GL_NEAREST);
-    sink->gl_thread.gles.v_tex.id = gl_create_texture(GL_NEAREST);
-}
+    GstGLESContext *gles = &sink->gl_thread.gles;
+    guint i;
 
-static void
-gl_load_texture (GstGLESSink *sink, GstBuffer *buf)
-{
-#if GST_CHECK_VERSION(1, 0, 0)
-    GstMapInfo bufmap;
-    guint8 *data;
+    if (!gles->overlays)
+        return;
 
-    if (G_UNLIKELY(!gst_buffer_map (buf, &bufmap, GST_MAP_READ))) {
-	GST_WARNING_OBJECT (sink, "%s: Failed to map buffer data", __func__);
-	return;
+    for (i = 0; i < gles->overlays->len; i++) {
+        GstGLESOverlay *overlay = &g_array_index (gles->overlays,
+                                                  GstGLESOverlay, i);
+        if (overlay->tex)
+            glDeleteTextures (1, &overlay->tex);
     }
+    g_array_set_size (gles->overlays, 0);
+}
 
-    data = bufmap.data;
-#else
-    guint8 *data = GST_BUFFER_DATA (buf);
-#endif
+static GLuint
+gl_upload_overlay (GstGLESSink *sink, GstVideoOverlayRectangle *rectangle)
+{
+    GstVideoMeta *vmeta;
+    GstMapInfo map;
+    GstBuffer *pixels;
+    GLuint tex;
+    guint i;
+
+    pixels = gst_video_overlay_rectangle_get_pixels_unscaled_argb (rectangle,
+            GST_VIDEO_OVERLAY_FORMAT_FLAG_NONE);
+    vmeta = gst_buffer_get_video_meta (pixels);
+    if (!vmeta || !gst_buffer_map (pixels, &map, GST_MAP_READ)) {
+        GST_WARNING_OBJECT (sink, "Could not map overlay rectangle");
+        return 0;
+    }
 
-    GstGLESContext *gles = &sink->gl_thread.gles;
-    /* y component */
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture (GL_TEXTURE_2D, gles->y_tex.id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, GST_VIDEO_SINK_WIDTH (sink),
-                 GST_VIDEO_SINK_HEIGHT (sink), 0, GL_LUMINANCE,
-                 GL_UNSIGNED_BYTE, data);
-    glUniform1i (gles->y_tex.loc, 0);
-
-    /* u component */
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture (GL_TEXTURE_2D, gles->u_tex.id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                 GST_VIDEO_SINK_WIDTH (sink)/2,
-                 GST_VIDEO_SINK_HEIGHT (sink)/2, 0, GL_LUMINANCE,
-                 GL_UNSIGNED_BYTE, data +
-                 GST_VIDEO_SINK_WIDTH (sink) * GST_VIDEO_SINK_HEIGHT (sink));
-    glUniform1i (gles->u_tex.loc, 1);
-
-    /* v component */
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture (GL_TEXTURE_2D, gles->v_tex.id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                 GST_VIDEO_SINK_WIDTH (sink)/2,
-                 GST_VIDEO_SINK_HEIGHT (sink)/2, 0, GL_LUMINANCE,
-                 GL_UNSIGNED_BYTE, data +
-                 GST_VIDEO_SINK_WIDTH (sink) * GST_VIDEO_SINK_HEIGHT (sink) +
-                 GST_VIDEO_SINK_WIDTH (sink)/2 *
-                 GST_VIDEO_SINK_HEIGHT (sink)/2);
-    glUniform1i (gles->v_tex.loc, 2);
+    tex = gl_create_texture (GL_LINEAR);
+    if (vmeta->stride[0] == vmeta->width * 4) {
+        glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, vmeta->width,
+                      vmeta->height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                      map.data + vmeta->offset[0]);
+    } else {
+        /* GLES2 has no unpack row length, upload line by line */
+        glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, vmeta->width,
+                      vmeta->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        for (i = 0; i < vmeta->height; i++)
+            glTexSubImage2D (GL_TEXTURE_2D, 0, 0, i, vmeta->width, 1,
+                             GL_RGBA, GL_UNSIGNED_BYTE, map.data +
+                             vmeta->offset[0] + i * vmeta->stride[0]);
+    }
 
-#if GST_CHECK_VERSION(1, 0, 0)
-    gst_buffer_unmap(buf, &bufmap);
-#endif
+    gst_buffer_unmap (pixels, &map);
+    return tex;
 }
 
+/* refresh the overlay textures from the buffers composition meta, textures
+ * are only uploaded again if the rectangles sequence number changed */
 static void
-gl_draw_fbo (GstGLESSink *sink, GstBuffer *buf)
+gl_update_overlays (GstGLESSink *sink, GstBuffer *buf)
 {
-    GLfloat vVertices[] =
-    {
-        -1.0f, -1.0f,
-        0.0f, 1.0f,
-
-        1.0f, -1.0f,
-        1.0f, 1.0f,
-
-        1.0f, 1.0f,
-        1.0f, 0.0f,
-
-        -1.0f, 1.0f,
-        0.0f, 0.0f,
-    };
-    GLushort indices[] = { 0, 1, 2, 0, 2, 3 };
     GstGLESContext *gles = &sink->gl_thread.gles;
+    GstVideoOverlayCompositionMeta *meta;
+    GArray *overlays;
+    guint n, i, j;
+
+    meta = gst_buffer_get_video_overlay_composition_meta (buf);
+    if (!meta) {
+        gl_delete_overlays (sink);
+        return;
+    }
 
-    glBindFramebuffer (GL_FRAMEBUFFER, gles->framebuffer);
-    glUseProgram (gles->deinterlace.program);
+    if (!gles->overlay.program) {
+        if (!gl_link_optional_shader (sink, &gles->overlay, SHADER_OVERLAY,
+                                      &gles->overlay_failed)) {
+            gl_delete_overlays (sink);
+            return;
+        }
+        gles->overlay_tex_loc = glGetUniformLocation (gles->overlay.program,
+                                                      "s_tex");
+        gles->overlay_alpha_loc = glGetUniformLocation (
+                                      gles->overlay.program, "alpha");
+    }
 
-    glViewport(0, 0, GST_VIDEO_SINK_WIDTH (sink),
-               GST_VIDEO_SINK_HEIGHT (sink));
+    n = gst_video_overlay_composition_n_rectangles (meta->overlay);
+    overlays = g_array_sized_new (FALSE, TRUE, sizeof (GstGLESOverlay), n);
 
-    glClear (GL_COLOR_BUFFER_BIT);
+    for (i = 0; i < n; i++) {
+        GstVideoOverlayRectangle *rectangle;
+        GstGLESOverlay overlay = { 0, };
 
-    glVertexAttribPointer (gles->deinterlace.position_loc, 2,
-                           GL_FLOAT, GL_FALSE, 4 * sizeof (GLfloat),
-                           vVertices);
+        rectangle = gst_video_overlay_composition_get_rectangle (
+                        meta->overlay, i);
+        overlay.seqnum = gst_video_overlay_rectangle_get_seqnum (rectangle);
 
-    glVertexAttribPointer (gles->deinterlace.texcoord_loc, 2,
-                           GL_FLOAT, GL_FALSE, 4 * sizeof (GLfloat),
-                           &vVertices[2]);
+        for (j = 0; j < gles->overlays->len; j++) {
+            GstGLESOverlay *cached = &g_array_index (gles->overlays,
+                                                     GstGLESOverlay, j);
+            if (cached->tex && cached->seqnum == overlay.seqnum) {
+                overlay.tex = cached->tex;
+                cached->tex = 0;
+                break;
+            }
+        }
 
-    glEnableVertexAttribArray (gles->deinterlace.position_loc);
-    glEnableVertexAttribArray (gles->deinterlace.texcoord_loc);
+        if (!overlay.tex) {
+            GST_LOG_OBJECT (sink, "Upload overlay rectangle %u",
+                            overlay.seqnum);
+            overlay.tex = gl_upload_overlay (sink, rectangle);
+            if (!overlay.tex)
+                continue;
+        }
 
-    gl_load_texture(sink, buf);
-    GLint line_height_loc =
-            glGetUniformLocation(gles->deinterlace.program,
-                                 "line_height");
-    glUniform1f(line_height_loc, 1.0/sink->video_height);
+        gst_video_overlay_rectangle_get_render_rectangle (rectangle,
+                &overlay.x, &overlay.y, &overlay.width, &overlay.height);
+        overlay.alpha = gst_video_overlay_rectangle_get_global_alpha (
+                            rectangle);
+        g_array_append_val (overlays, overlay);
+    }
 
-    glDrawElements (GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices);
+    /* whatever is left in the cache is not used anymore */
+    gl_delete_overlays (sink);
+    g_array_free (gles->overlays, TRUE);
+    gles->overlays = overlays;
 }
 
-void
-gl_draw_onscreen (GstGLESSink *sink)
+/* blend the overlay rectangles on top of the scaled video, expects the
+ * viewport to be set to the visible video area */
+static void
+gl_draw_overlays (GstGLESSink *sink, const gint *direction, float crop_left,
+                  float crop_right, float crop_top, float crop_bottom)
 {
-    GLfloat vVertices[] =
-    {
-        -1.0f, -1.0f,
-        0.0f, 0.0f,
+    GstGLESContext *gles = &sink->gl_thread.gles;
+    float visible_w = 1.0f - crop_left - crop_right;
+    float visible_h = 1.0f - crop_top - crop_bottom;
+    guint i;
+
+    if (!gles->overlays || !gles->overlays->len)
+        return;
+
+    glUseProgram (gles->overlay.program);
+    glEnable (GL_BLEND);
+    glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    for (i = 0; i < gles->overlays->len; i++) {
+        GstGLESOverlay *overlay = &g_array_index (gles->overlays,
+                                                  GstGLESOverlay, i);
+        float x0, x1, y0, y1;
+        guint v;
+
+        /* map the video relative render rectangle into the visible area */
+        x0 = (float)overlay->x / GST_VIDEO_SINK_WIDTH (sink);
+        x1 = (float)(overlay->x + overlay->width) /
+                GST_VIDEO_SINK_WIDTH (sink);
+        y0 = (float)overlay->y / GST_VIDEO_SINK_HEIGHT (sink);
+        y1 = (float)(overlay->y + overlay->height) /
+                GST_VIDEO_SINK_HEIGHT (sink);
+
+        x0 = (x0 - crop_left) / visible_w;
+        x1 = (x1 - crop_left) / visible_w;
+        y0 = (y0 - crop_top) / visible_h;
+        y1 = (y1 - crop_top) / visible_h;
+
+        {
+            GLfloat vVertices[] =
+            {
+                x0, y1,
+                0.0f, 1.0f,
+
+                x1, y1,
+                1.0f, 1.0f,
+
+                x1, y0,
+                1.0f, 0.0f,
+
+                x0, y0,
+                0.0f, 0.0f,
+            };
+
+            /* overlays turn with the video, then go to device coords */
+            for (v = 0; v < 4; v++) {
+                GLfloat *pos = &vVertices[v * 4];
+
+                gl_direction_map (direction, TRUE, pos[0], pos[1],
+                                  &pos[0], &pos[1]);
+                pos[0] = pos[0] * 2.0f - 1.0f;
+                pos[1] = 1.0f - pos[1] * 2.0f;
+            }
 
-        1.0f, -1.0f,
-        1.0f, 0.0f,
+            glActiveTexture (GL_TEXTURE4);
+            glBindTexture (GL_TEXTURE_2D, overlay->tex);
+            glUniform1i (gles->overlay_tex_loc, 4);
+            glUniform1f (gles->overlay_alpha_loc, overlay->alpha);
 
-        1.0f, 1.0f,
-        1.0f, 1.0f,
+            gl_draw_quad (&gles->overlay, vVertices);
+        }
+    }
 
-        -1.0f, 1.0f,
-        0.0f, 1.0f,
-    };
-    GLushort indices[] = { 0, 1, 2, 0, 2, 3 };
+    glDisable (GL_BLEND);
+}
+#endif
+
+/* scales the rgb textures of the tiles into the viewport, each its own
+ * quad. rotating and flipping is free, only the corners are moved. flip
+ * turns the picture upside down for reading it back. with frame
+ * blending the current frame is drawn over the previous one */
+static void
+gl_draw_tiles (GstGLESSink *sink, const gint *direction, gboolean flip)
+{
+    GstGLESContext *gles = &sink->gl_thread.gles;
+    const GstGLESCrop *crop = &sink->gl_thread.crop;
+    gboolean blend = sink->gl_thread.blend_weight < 1.0f;
+    guint i, v;
+
+    glActiveTexture (GL_TEXTURE3);
+
+    for (i = 0; i < gles->n_tiles; i++) {
+        GstGLESTile *tile = &gles->tiles[i];
+        const GstGLESCrop *upload = &tile->stream.crop;
+        float x0, x1, y0, y1, tx0, tx1, ty0, ty1;
+
+        /* the area of the tile within the visible picture */
+        x0 = (float)(tile->area.x - crop->x) / crop->width;
+        x1 = (float)(tile->area.x + tile->area.width - crop->x) /
+                crop->width;
+        y0 = (float)(tile->area.y - crop->y) / crop->height;
+        y1 = (float)(tile->area.y + tile->area.height - crop->y) /
+                crop->height;
+
+        /* and within its texture, which is stored bottom up */
+        tx0 = (float)(tile->area.x - upload->x) / upload->width;
+        tx1 = (float)(tile->area.x + tile->area.width - upload->x) /
+                upload->width;
+        ty0 = 1.0f - (float)(tile->area.y - upload->y) / upload->height;
+        ty1 = 1.0f - (float)(tile->area.y + tile->area.height - upload->y) /
+                upload->height;
+
+        {
+            GLfloat vVertices[] =
+            {
+                x0, y1,
+                tx0, ty1,
+
+                x1, y1,
+                tx1, ty1,
+
+                x1, y0,
+                tx1, ty0,
+
+                x0, y0,
+                tx0, ty0,
+            };
+
+            for (v = 0; v < 4; v++) {
+                GLfloat *pos = &vVertices[v * 4];
+
+                gl_direction_map (direction, TRUE, pos[0], pos[1],
+                                  &pos[0], &pos[1]);
+                pos[0] = pos[0] * 2.0f - 1.0f;
+                pos[1] = flip ? pos[1] * 2.0f - 1.0f : 1.0f - pos[1] * 2.0f;
+            }
 
+            if (blend) {
+                glBindTexture (GL_TEXTURE_2D, tile->previous.id);
+                glUniform1i (tile->stream.rgb_tex.loc, 3);
+                gl_draw_quad (&gles->scale, vVertices);
+
+                /* the alpha of the window stays untouched */
+                glUseProgram (gles->blend.program);
+                glEnable (GL_BLEND);
+                glBlendFuncSeparate (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                                     GL_ZERO, GL_ONE);
+                glBindTexture (GL_TEXTURE_2D, tile->stream.rgb_tex.id);
+                glUniform1i (gles->blend_tex_loc, 3);
+                glUniform1f (gles->blend_alpha_loc,
+                             sink->gl_thread.blend_weight);
+                gl_draw_quad (&gles->blend, vVertices);
+                glDisable (GL_BLEND);
+                glUseProgram (gles->scale.program);
+            } else {
+                glBindTexture (GL_TEXTURE_2D, tile->stream.rgb_tex.id);
+                glUniform1i (tile->stream.rgb_tex.loc, 3);
+                gl_draw_quad (&gles->scale, vVertices);
+            }
+        }
+    }
+}
+
+void
+gl_draw_onscreen (GstGLESSink *sink)
+{
     GstVideoRectangle src;
     GstVideoRectangle dst;
     GstVideoRectangle result;
 
     GstGLESContext *gles = &sink->gl_thread.gles;
-
-    /* add cropping to texture coordinates */
-    float crop_left = (float)sink->crop_left / sink->video_width;
-    float crop_right = (float)sink->crop_right / sink->video_width;
-    float crop_top = (float)sink->crop_top / sink->video_height;
-    float crop_bottom = (float)sink->crop_bottom / sink->video_height;
-
-    vVertices[2] += crop_left;
-    vVertices[3] += crop_bottom;
-    vVertices[6] -= crop_right;
-    vVertices[7] += crop_bottom;
-    vVertices[10] -= crop_right;
-    vVertices[11] -= crop_top;
-    vVertices[14] += crop_left;
-    vVertices[15] -= crop_top;
-
-    dst.x = 0;
-    dst.y = 0;
-    dst.w = sink->x11.width;
-    dst.h = sink->x11.height;
+    const gint *direction = gl_get_direction (sink);
+
+    /* the rgb texture only holds the visible part of the frame, the
+       fractions place overlays given in frame coordinates */
+    const GstGLESCrop *crop = &sink->gl_thread.crop;
+    gint frame_w = GST_VIDEO_SINK_WIDTH (sink);
+    gint frame_h = GST_VIDEO_SINK_HEIGHT (sink);
+    float crop_left = (float)crop->x / frame_w;
+    float crop_right = (float)(frame_w - crop->x - crop->width) / frame_w;
+    float crop_top = (float)crop->y / frame_h;
+    float crop_bottom = (float)(frame_h - crop->y - crop->height) / frame_h;
+
+    if (sink->render_rect.w > 0 && sink->render_rect.h > 0) {
+        /* window coordinates count from the top, gl from the bottom */
+        dst = sink->render_rect;
+        dst.y = sink->x11.height - dst.y - dst.h;
+    } else {
+        dst.x = 0;
+        dst.y = 0;
+        dst.w = sink->x11.width;
+        dst.h = sink->x11.height;
+    }
 
     src.x = 0;
     src.y = 0;
-    src.w = sink->video_width - sink->crop_left - sink->crop_right;
-    src.h = sink->video_height - sink->crop_top - sink->crop_bottom;
+    src.w = crop->width * sink->video_width / frame_w;
+    src.h = crop->height;
+
+    /* turned by 90 degrees the picture is as wide as it was high */
+    if (!direction[0]) {
+        src.w = crop->height;
+        src.h = crop->width * sink->video_width / frame_w;
+    }
 
     gst_video_sink_center_rect(src, dst, &result, TRUE);
 
@@ -332,482 +624,1451 @@ gl_draw_onscreen (GstGLESSink *sink)
 
     glClear (GL_COLOR_BUFFER_BIT);
 
-    glVertexAttribPointer (gles->scale.position_loc, 2, GL_FLOAT,
-        GL_FALSE, 4 * sizeof (GLfloat), vVertices);
-
-    glVertexAttribPointer (gles->scale.texcoord_loc, 2, GL_FLOAT,
-        GL_FALSE, 4 * sizeof (GLfloat), &vVertices[2]);
+    gl_draw_tiles (sink, direction, FALSE);
 
-    glEnableVertexAttribArray (gles->scale.position_loc);
-    glEnableVertexAttribArray (gles->scale.texcoord_loc);
-
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture (GL_TEXTURE_2D, gles->rgb_tex.id);
-    glUniform1i (gles->rgb_tex.loc, 3);
+#if GST_CHECK_VERSION(1, 0, 0)
+    gl_draw_overlays (sink, direction, crop_left, crop_right, crop_top,
+                      crop_bottom);
+#endif
+}
 
-    glDrawElements (GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices);
-    eglSwapBuffers (gles->display, gles->surface);
+static void
+gl_delete_tile (GstGLESSink *sink, GstGLESTile *tile)
+{
+    gl_texture_pool_release (tile->stream.pool, tile->stream.memory,
+                             &tile->previous);
+    gl_stream_delete (&tile->stream);
 }
 
-/* EGL implementation */
+/* snapshots of the picture shown on screen, drawn and packed into the
+ * requested format on the gpu */
 
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER          0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ                0x88E1
+#endif
+#ifndef GL_MAP_READ_BIT
+#define GL_MAP_READ_BIT               0x0001
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT    0x00000001
+#endif
+#ifndef GL_TIMEOUT_EXPIRED
+#define GL_TIMEOUT_EXPIRED            0x911B
+#endif
+#ifndef GL_WAIT_FAILED
+#define GL_WAIT_FAILED                0x911D
+#endif
 
-static gint
-egl_init (GstGLESSink *sink)
-{
-    const EGLint configAttribs[] =
-    {
-        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
-        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-        EGL_DEPTH_SIZE, 16,
-        EGL_NONE
-    };
+static const GLfloat gl_snapshot_vertices[] =
+{
+    -1.0f, -1.0f,
+    0.0f, 0.0f,
 
-    const EGLint contextAttribs[] =
-    {
-        EGL_CONTEXT_CLIENT_VERSION, 2,
-        EGL_NONE
-    };
+    1.0f, -1.0f,
+    1.0f, 0.0f,
 
-    EGLConfig config;
-    EGLint num_configs;
-    EGLint major;
-    EGLint minor;
+    1.0f, 1.0f,
+    1.0f, 1.0f,
 
-    GstGLESContext *gles = &sink->gl_thread.gles;
+    -1.0f, 1.0f,
+    0.0f, 1.0f,
+};
 
-    GST_DEBUG_OBJECT (sink, "egl get display");
-    gles->display = eglGetDisplay((EGLNativeDisplayType)
-                                          sink->x11.display);
-    if (gles->display == EGL_NO_DISPLAY) {
-        GST_ERROR_OBJECT(sink, "Could not get EGL display");
-        return -1;
+static void
+gl_snapshot_clear (GstGLESSink *sink)
+{
+    GstGLESSnapshot *snapshot = &sink->gl_thread.snapshot;
+    GstGLESDisplay *display = sink->gl_thread.display;
+
+    if (snapshot->fence)
+        display->features.DeleteSync (snapshot->fence);
+    snapshot->fence = NULL;
+    if (snapshot->pbo) {
+        glDeleteBuffers (1, &snapshot->pbo);
+        gl_memory_uncharge (&display->textures, NULL, snapshot->pbo_size);
     }
+    snapshot->pbo = 0;
+    snapshot->pbo_size = 0;
+    snapshot->pending = FALSE;
+}
 
-    GST_DEBUG_OBJECT (sink, "egl initialize");
-    if (!eglInitialize(gles->display, &major, &minor)) {
-        GST_ERROR_OBJECT(sink, "Could not initialize EGL context");
-        return -1;
+/* wraps the data read back into the result handed out next, a result
+ * nobody picked up yet is replaced */
+static void
+gl_snapshot_deliver (GstGLESSink *sink, GstBuffer *buf)
+{
+    GstGLESSnapshot *snapshot = &sink->gl_thread.snapshot;
+    GstVideoFormat format = snapshot->i420 ? GST_VIDEO_FORMAT_I420 :
+                            GST_VIDEO_FORMAT_RGBA;
+    GstCaps *caps;
+#if GST_CHECK_VERSION(1, 0, 0)
+    GstVideoInfo info;
+    GstSample *result;
+
+    GST_BUFFER_TIMESTAMP (buf) = snapshot->timestamp;
+    gst_video_info_set_format (&info, format, snapshot->width,
+                               snapshot->height);
+    caps = gst_video_info_to_caps (&info);
+    result = gst_sample_new (buf, caps, NULL, NULL);
+    gst_caps_unref (caps);
+    gst_buffer_unref (buf);
+#else
+    GstBuffer *result = buf;
+
+    GST_BUFFER_TIMESTAMP (buf) = snapshot->timestamp;
+    caps = gst_video_format_new_caps (format, snapshot->width,
+                                      snapshot->height, 0, 1, 1, 1);
+    gst_buffer_set_caps (buf, caps);
+    gst_caps_unref (caps);
+#endif
+
+    GST_OBJECT_LOCK (sink);
+    if (snapshot->result)
+#if GST_CHECK_VERSION(1, 0, 0)
+        gst_sample_unref (snapshot->result);
+#else
+        gst_buffer_unref (snapshot->result);
+#endif
+    snapshot->result = result;
+    GST_OBJECT_UNLOCK (sink);
+}
+
+/* copies the readback in flight out of its pack buffer. without wait
+ * this only happens once the gpu is done with it */
+static void
+gl_snapshot_finish (GstGLESSink *sink, gboolean wait)
+{
+    GstGLESSnapshot *snapshot = &sink->gl_thread.snapshot;
+    const GstGLESFeatures *gl = &sink->gl_thread.display->features;
+    GstBuffer *buf = NULL;
+    gpointer data;
+    GLenum status;
+
+    if (!snapshot->pending)
+        return;
+
+    status = gl->ClientWaitSync (snapshot->fence,
+                                 wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                 wait ? GST_SECOND : 0);
+    if (status == GL_TIMEOUT_EXPIRED && !wait)
+        return;
+
+    if (status != GL_TIMEOUT_EXPIRED && status != GL_WAIT_FAILED) {
+        glBindBuffer (GL_PIXEL_PACK_BUFFER, snapshot->pbo);
+        data = gl->MapBufferRange (GL_PIXEL_PACK_BUFFER, 0,
+                                   snapshot->pbo_size, GL_MAP_READ_BIT);
+        if (data) {
+            buf = gst_buffer_new_and_alloc (snapshot->pbo_size);
+#if GST_CHECK_VERSION(1, 0, 0)
+            gst_buffer_fill (buf, 0, data, snapshot->pbo_size);
+#else
+            memcpy (GST_BUFFER_DATA (buf), data, snapshot->pbo_size);
+#endif
+            gl->UnmapBuffer (GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
     }
-    GST_DEBUG_OBJECT (sink, "Have EGL version: %d.%d", major, minor);
 
-    GST_DEBUG_OBJECT (sink, "choose config");
-    if (!eglChooseConfig(gles->display, configAttribs, &config, 1,
-                        &num_configs)) {
-        GST_ERROR_OBJECT(sink, "Could not choose EGL config");
-        return -1;
+    if (buf)
+        gl_snapshot_deliver (sink, buf);
+    else
+        GST_WARNING_OBJECT (sink, "Could not read back snapshot: 0x%x",
+                            status);
+    gl_snapshot_clear (sink);
+}
+
+/* makes a texture of width x height the target of the bound framebuffer */
+static gboolean
+gl_snapshot_attach (GstGLESSink *sink, GstGLESTexture *tex, gint width,
+                    gint height, GLuint filter)
+{
+    GstGLESDisplay *display = sink->gl_thread.display;
+    GLenum status;
+
+    /* snapshots are short lived, they don't count against the budget */
+    if (gl_texture_pool_acquire (&display->textures, NULL, tex, GL_RGBA,
+                                 width, height, filter,
+                                 &display->features) != GST_GLES_ALLOC_OK) {
+        GST_WARNING_OBJECT (sink, "Could not allocate %dx%d snapshot",
+                            width, height);
+        return FALSE;
     }
 
-    if (num_configs != 1) {
-        GST_WARNING_OBJECT(sink, "Did not get exactly one config, but %d",
-                           num_configs);
+    glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_TEXTURE_2D, tex->id, 0);
+    status = glCheckFramebufferStatus (GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        GST_WARNING_OBJECT (sink, "%dx%d snapshot framebuffer incomplete: "
+                            "0x%x", width, height, status);
+        return FALSE;
     }
 
-    GST_DEBUG_OBJECT (sink, "create window surface");
-    gles->surface = eglCreateWindowSurface(gles->display, config,
-                                     sink->x11.window, NULL);
-    if (gles->surface == EGL_NO_SURFACE) {
-        GST_ERROR_OBJECT (sink, "Could not create EGL surface");
-        return -1;
+    return TRUE;
+}
+
+/* draws the picture as it is shown, turned and cropped, at the size of a
+ * pending request and starts reading it back. I420 is packed by a second
+ * pass, four bytes of its planes per pixel, so the read data is the frame
+ * already. with GLES3 it goes into a pack buffer the gpu fills while the
+ * next frame is drawn, GLES2 has to wait for the read */
+static void
+gl_snapshot_start (GstGLESSink *sink)
+{
+    GstGLESThread *thread = &sink->gl_thread;
+    GstGLESSnapshot *snapshot = &thread->snapshot;
+    GstGLESContext *gles = &thread->gles;
+    GstGLESDisplay *display = thread->display;
+    const GstGLESFeatures *gl = &display->features;
+    const GstGLESCrop *crop = &thread->crop;
+    const gint *direction;
+    GstGLESTexture picture = { 0, };
+    GstGLESTexture packed = { 0, };
+    GLuint framebuffer = 0;
+    GstBuffer *buf = NULL;
+    gint shown_w, shown_h, read_w, read_h;
+    GLenum error;
+
+    if (snapshot->pending || !gles->tiles[0].stream.initialized)
+        return;
+
+    GST_OBJECT_LOCK (sink);
+    if (!snapshot->requested) {
+        GST_OBJECT_UNLOCK (sink);
+        return;
     }
+    snapshot->requested = FALSE;
+    snapshot->width = snapshot->request_width;
+    snapshot->height = snapshot->request_height;
+    snapshot->i420 = snapshot->request_i420;
+    GST_OBJECT_UNLOCK (sink);
+
+    /* default to the size shown on screen, turned by 90 degrees the
+       picture is as wide as it was high */
+    direction = gl_get_direction (sink);
+    shown_w = crop->width * sink->video_width / GST_VIDEO_SINK_WIDTH (sink);
+    shown_h = crop->height;
+    if (snapshot->width <= 0)
+        snapshot->width = direction[0] ? shown_w : shown_h;
+    if (snapshot->height <= 0)
+        snapshot->height = direction[0] ? shown_h : shown_w;
+
+    /* packed I420 is a quarter as wide and half again as high, its
+       pixels must not straddle two rows of the chroma planes */
+    snapshot->width = MIN (snapshot->width, gl->max_texture_size);
+    snapshot->height = MIN (snapshot->height, snapshot->i420 ?
+                            gl->max_texture_size * 2 / 3 :
+                            gl->max_texture_size);
+    if (snapshot->i420) {
+        snapshot->width &= ~7;
+        snapshot->height &= ~3;
+    }
+    if (snapshot->width <= 0 || snapshot->height <= 0) {
+        GST_WARNING_OBJECT (sink, "Snapshot of %dx%d is too small",
+                            snapshot->width, snapshot->height);
+        return;
+    }
+    read_w = snapshot->i420 ? snapshot->width / 4 : snapshot->width;
+    read_h = snapshot->i420 ? snapshot->height * 3 / 2 : snapshot->height;
+
+    if (snapshot->i420 && !gles->snapshot_i420.program) {
+        if (!gl_link_optional_shader (sink, &gles->snapshot_i420,
+                                      SHADER_SNAPSHOT_I420,
+                                      &gles->snapshot_failed))
+            return;
+        gles->snapshot_tex_loc = glGetUniformLocation (
+                                     gles->snapshot_i420.program, "s_tex");
+        gles->snapshot_size_loc = glGetUniformLocation (
+                                      gles->snapshot_i420.program, "size");
+    }
+
+    glGenFramebuffers (1, &framebuffer);
+    glBindFramebuffer (GL_FRAMEBUFFER, framebuffer);
+    if (!gl_snapshot_attach (sink, &picture, snapshot->width,
+                             snapshot->height, GL_LINEAR))
+        goto done;
+
+    glUseProgram (gles->scale.program);
+    glViewport (0, 0, snapshot->width, snapshot->height);
+    glClear (GL_COLOR_BUFFER_BIT);
 
-    GST_DEBUG_OBJECT (sink, "egl create context");
-    gles->context = eglCreateContext(gles->display, config,
-                                     EGL_NO_CONTEXT, contextAttribs);
-    if (gles->context == EGL_NO_CONTEXT) {
-        GST_ERROR_OBJECT(sink, "Could not create EGL context");
-        return -1;
+    /* the rgb textures are stored bottom up, flip them so the rows are
+       read back top down. they hold the cropped picture already */
+    gl_draw_tiles (sink, direction, TRUE);
+
+    if (snapshot->i420) {
+        if (!gl_snapshot_attach (sink, &packed, read_w, read_h, GL_NEAREST))
+            goto done;
+
+        glUseProgram (gles->snapshot_i420.program);
+        glViewport (0, 0, read_w, read_h);
+        glActiveTexture (GL_TEXTURE3);
+        glBindTexture (GL_TEXTURE_2D, picture.id);
+        glUniform1i (gles->snapshot_tex_loc, 3);
+        glUniform2f (gles->snapshot_size_loc, snapshot->width,
+                     snapshot->height);
+        gl_draw_quad (&gles->snapshot_i420, gl_snapshot_vertices);
+        glUseProgram (gles->scale.program);
     }
 
-    GST_DEBUG_OBJECT (sink, "egl make context current");
-    if (!eglMakeCurrent(gles->display, gles->surface,
-                        gles->surface, gles->context)) {
-        GST_ERROR_OBJECT(sink, "Could not set EGL context to current");
-        return -1;
+    snapshot->timestamp = thread->buf ? GST_BUFFER_TIMESTAMP (thread->buf) :
+                          thread->last_timestamp;
+    glPixelStorei (GL_PACK_ALIGNMENT, 4);
+
+    if (gl->gles3) {
+        while (glGetError () != GL_NO_ERROR);
+
+        snapshot->pbo_size = read_w * read_h * 4;
+        glGenBuffers (1, &snapshot->pbo);
+        glBindBuffer (GL_PIXEL_PACK_BUFFER, snapshot->pbo);
+        glBufferData (GL_PIXEL_PACK_BUFFER, snapshot->pbo_size, NULL,
+                      GL_STREAM_READ);
+        glReadPixels (0, 0, read_w, read_h, GL_RGBA, GL_UNSIGNED_BYTE,
+                      NULL);
+        glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+        gl_memory_charge (&display->textures, NULL, snapshot->pbo_size);
+
+        error = glGetError ();
+        if (error != GL_NO_ERROR) {
+            GST_WARNING_OBJECT (sink, "Could not read back snapshot: 0x%x",
+                                error);
+            gl_snapshot_clear (sink);
+            goto done;
+        }
+
+        snapshot->fence = gl->FenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush ();
+        snapshot->pending = TRUE;
+    } else {
+#if GST_CHECK_VERSION(1, 0, 0)
+        GstMapInfo map;
+
+        buf = gst_buffer_new_and_alloc (read_w * read_h * 4);
+        gst_buffer_map (buf, &map, GST_MAP_WRITE);
+        glReadPixels (0, 0, read_w, read_h, GL_RGBA, GL_UNSIGNED_BYTE,
+                      map.data);
+        gst_buffer_unmap (buf, &map);
+#else
+        buf = gst_buffer_new_and_alloc (read_w * read_h * 4);
+        glReadPixels (0, 0, read_w, read_h, GL_RGBA, GL_UNSIGNED_BYTE,
+                      GST_BUFFER_DATA (buf));
+#endif
     }
 
-    GST_DEBUG_OBJECT (sink, "egl init done");
+done:
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers (1, &framebuffer);
+    gl_texture_pool_release (&display->textures, NULL, &picture);
+    gl_texture_pool_release (&display->textures, NULL, &packed);
 
-    return 0;
+    if (buf)
+        gl_snapshot_deliver (sink, buf);
 }
 
-/*
- * ugly quirk, to workaround nvidia bugs
- * closes left open file handles
- */
+static void
+gl_close (GstGLESSink *sink)
+{
+    GstGLESContext *gles = &sink->gl_thread.gles;
+
+    guint i;
 
+    /* the tiles are set up with the first frame, if there was one, and
+       may be missing if they exceeded the memory budget */
+    for (i = 0; i < gles->n_tiles; i++)
+        gl_delete_tile (sink, &gles->tiles[i]);
+    gles->n_tiles = 0;
+#if GST_CHECK_VERSION(1, 0, 0)
+    gl_delete_overlays (sink);
+    gl_delete_shader (&gles->overlay);
+    gles->overlay_failed = FALSE;
+#endif
+    gl_delete_shader (&gles->blend);
+    gles->blend_failed = FALSE;
+    gl_snapshot_clear (sink);
+    gl_delete_shader (&gles->snapshot_i420);
+    gles->snapshot_failed = FALSE;
+    gl_delete_shader (&gles->scale);
+    gl_delete_shader (&gles->deinterlace);
+
+    gst_gles_render_thread_release_current (sink->gl_thread.render);
+    egl_close_surface (GST_ELEMENT (sink), &sink->x11);
+}
+
+/* takes over the geometry negotiated in set_caps, runs on the render
+ * thread so a frame is never drawn with a half updated size */
 static void
-egl_close_file (GstGLESSink *sink, const gchar *filename)
-{
-    const gchar *target_file;
-    GError *err = NULL;
-    GFileInfo *info;
-    GFile *file;
-
-    GST_DEBUG_OBJECT (sink, "Check file handle: %s", filename);
-
-    file = g_file_new_for_path (filename);
-    info = g_file_query_info (file, "*",
-                              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                              NULL, &err);
-    if (!info || err) {
-        GST_ERROR_OBJECT (sink, "Could get file info: %s",
-                         err->message);
-        g_error_free(err);
-        goto cleanup;
-    }
-
-    GST_DEBUG_OBJECT (sink, "File type is: %d",
-                     g_file_info_get_file_type(info));
-
-    if (!g_file_info_get_is_symlink (info)) {
-        GST_DEBUG_OBJECT (sink, "File is no symlink");
-        goto cleanup;
-    }
-
-    target_file = g_file_info_get_symlink_target (info);
-    GST_DEBUG_OBJECT (sink, "Check file resolves to: '%s'",
-                      target_file);
-
-    if (g_str_equal (target_file, "/dev/tegra_sema") ||
-        g_str_equal (target_file, "/dev/nvhost-gr2d") ||
-        g_str_equal (target_file, "/dev/nvhost-gr3d"))
-    {
-        gchar *basename = g_file_get_basename (file);
-        gint64 fid = g_ascii_strtoll (basename, NULL, 10);
-
-        if (fid > 0) {
-            GST_DEBUG_OBJECT (sink, "Close file handle %"
-                              G_GINT64_FORMAT, fid);
-            if (close (fid) < 0) {
-                GST_ERROR_OBJECT (sink,
-                                  "Could not close file handle: %d",
-                                  errno);
-            }
-        }
+gl_apply_caps (GstGLESSink *sink)
+{
+    GstGLESThread *thread = &sink->gl_thread;
+
+    GST_VIDEO_SINK_WIDTH (sink) = thread->width;
+    GST_VIDEO_SINK_HEIGHT (sink) = thread->height;
+    sink->video_width = thread->video_width;
+    sink->video_height = thread->height;
+    thread->reconfigure = FALSE;
+}
+
+/* combines the crop meta of buf with the crop properties, which may be
+ * changed from any thread. the result is aligned to the I420 chroma and
+ * keeps at least a 2x2 picture */
+static void
+gl_update_crop (GstGLESSink *sink, GstBuffer *buf)
+{
+    GstGLESCrop *crop = &sink->gl_thread.crop;
+    gint frame_w = GST_VIDEO_SINK_WIDTH (sink);
+    gint frame_h = GST_VIDEO_SINK_HEIGHT (sink);
+    gint left, right, top, bottom;
+#if GST_CHECK_VERSION(1, 0, 0)
+    GstVideoCropMeta *meta = gst_buffer_get_video_crop_meta (buf);
+#endif
 
-        g_free (basename);
+    left = top = 0;
+    right = frame_w;
+    bottom = frame_h;
+#if GST_CHECK_VERSION(1, 0, 0)
+    if (meta && meta->width > 0 && meta->height > 0) {
+        left = MIN (meta->x, frame_w);
+        top = MIN (meta->y, frame_h);
+        right = MIN (meta->x + meta->width, frame_w);
+        bottom = MIN (meta->y + meta->height, frame_h);
     }
+#endif
+
+    GST_OBJECT_LOCK (sink);
+    left += sink->crop_left;
+    top += sink->crop_top;
+    right -= sink->crop_right;
+    bottom -= sink->crop_bottom;
+    GST_OBJECT_UNLOCK (sink);
+
+    left = CLAMP (left, 0, frame_w - 2) & ~1;
+    top = CLAMP (top, 0, frame_h - 2) & ~1;
+    right = CLAMP (right, left + 2, frame_w);
+    bottom = CLAMP (bottom, top + 2, frame_h);
+
+    if (crop->x != left || crop->y != top ||
+        crop->width != ((right - left) & ~1) ||
+        crop->height != ((bottom - top) & ~1))
+        GST_DEBUG_OBJECT (sink, "Visible area %d,%d %dx%d", left, top,
+                          (right - left) & ~1, (bottom - top) & ~1);
+
+    crop->x = left;
+    crop->y = top;
+    crop->width = (right - left) & ~1;
+    crop->height = (bottom - top) & ~1;
+}
 
-cleanup:
-    g_object_unref (info);
-    g_object_unref (file);
+/* takes the colour balance over into the conversion matrix, the values
+ * may be changed from any thread */
+static void
+gl_update_balance (GstGLESSink *sink)
+{
+    gint balance[GST_GLES_BALANCE_COUNT];
+    guint i;
+
+    GST_OBJECT_LOCK (sink);
+    memcpy (balance, sink->balance, sizeof (balance));
+    GST_OBJECT_UNLOCK (sink);
+
+    for (i = 0; i < sink->gl_thread.gles.n_tiles; i++)
+        gl_stream_set_balance (&sink->gl_thread.gles.tiles[i].stream,
+                               balance[GST_GLES_BALANCE_BRIGHTNESS] / 1000.0f,
+                               balance[GST_GLES_BALANCE_CONTRAST] / 1000.0f +
+                               1.0f,
+                               balance[GST_GLES_BALANCE_HUE] / 1000.0f,
+                               balance[GST_GLES_BALANCE_SATURATION] / 1000.0f +
+                               1.0f);
 }
 
+static const gchar *gl_balance_labels[GST_GLES_BALANCE_COUNT] =
+{
+    "BRIGHTNESS",
+    "CONTRAST",
+    "HUE",
+    "SATURATION",
+};
+
+#if GST_CHECK_VERSION(1, 0, 0)
+static void
+gl_init_balance_channels (GstGLESSink *sink)
+{
+    GstColorBalanceChannel *channel;
+    guint i;
+
+    for (i = 0; i < GST_GLES_BALANCE_COUNT; i++) {
+        channel = g_object_new (GST_TYPE_COLOR_BALANCE_CHANNEL, NULL);
+        channel->label = g_strdup (gl_balance_labels[i]);
+        channel->min_value = -1000;
+        channel->max_value = 1000;
+        sink->channels = g_list_append (sink->channels, channel);
+    }
+}
+#endif
+
+/* sets one balance value from the properties or the interface, it is
+ * picked up with the next frame */
 static void
-egl_close_handles (GstGLESSink *sink)
+gl_set_balance (GstGLESSink *sink, guint index, gint value)
 {
-    GError *err = NULL;
-    GDir *directory;
-    const gchar *file;
-    gchar *path;
+    gboolean changed;
 
+    value = CLAMP (value, -1000, 1000);
 
-    path = g_strdup_printf ("/proc/%u/fd", getpid());
-    GST_DEBUG_OBJECT (sink, "Check for dead file handles in %s", path);
+    GST_OBJECT_LOCK (sink);
+    changed = sink->balance[index] != value;
+    sink->balance[index] = value;
+    GST_OBJECT_UNLOCK (sink);
 
-    directory = g_dir_open (path, 0, &err);
-    if (!directory || err) {
-        GST_ERROR_OBJECT(sink, "Could not list files: %s",
-                         err->message);
-        g_object_unref (err);
-        goto cleanup;
+    if (!changed)
+        return;
+
+    GST_DEBUG_OBJECT (sink, "%s set to %d", gl_balance_labels[index], value);
+#if GST_CHECK_VERSION(1, 0, 0)
+    gst_color_balance_value_changed (GST_COLOR_BALANCE (sink),
+                                     g_list_nth_data (sink->channels, index),
+                                     value);
+#endif
+}
+
+/* width and height of the part of a frame a single tile shows, the
+ * overlap has to fit into the texture as well */
+static gint
+gl_tile_size (gint max_texture_size)
+{
+    if (max_texture_size <= 0)
+        return G_MAXINT;
+
+    return (max_texture_size - 2 * GST_GLES_TILE_OVERLAP) & ~1;
+}
+
+/* number of tiles in each direction needed for width x height */
+static void
+gl_tile_grid (gint max_texture_size, gint width, gint height, gint *columns,
+              gint *rows)
+{
+    gint tile_size = gl_tile_size (max_texture_size);
+
+    *columns = (width + tile_size - 1) / tile_size;
+    *rows = (height + tile_size - 1) / tile_size;
+}
+
+/* splits the visible area into tiles no texture of which exceeds the
+ * maximum size, usually that is a single one. set_caps rejected frames
+ * which need more than GST_GLES_MAX_TILES. runs between two frames */
+static GstGLESAllocResult
+gl_update_tiles (GstGLESSink *sink)
+{
+    GstGLESThread *thread = &sink->gl_thread;
+    GstGLESContext *gles = &thread->gles;
+    const GstGLESCrop *crop = &thread->crop;
+    GstGLESAllocResult res;
+    gint columns, rows, x0, x1, y0, y1;
+    guint i;
+
+    gl_tile_grid (thread->display->features.max_texture_size, crop->width,
+                  crop->height, &columns, &rows);
+    if (columns * rows > GST_GLES_MAX_TILES) {
+        GST_ERROR_OBJECT (sink, "%dx%d exceeds %d tiles", crop->width,
+                          crop->height, GST_GLES_MAX_TILES);
+        return GST_GLES_ALLOC_FAILED;
     }
 
-    while ((file = g_dir_read_name(directory))) {
-        gchar *filename = g_strconcat(path, "/", file, NULL);
-        egl_close_file (sink, filename);
-        g_free (filename);
+    if (gles->n_tiles != columns * rows)
+        GST_DEBUG_OBJECT (sink, "Rendering %dx%d in %dx%d tiles",
+                          crop->width, crop->height, columns, rows);
+
+    /* release the tiles which are no longer needed */
+    for (i = columns * rows; i < gles->n_tiles; i++)
+        gl_delete_tile (sink, &gles->tiles[i]);
+    gles->n_tiles = columns * rows;
+
+    for (i = 0; i < gles->n_tiles; i++) {
+        GstGLESTile *tile = &gles->tiles[i];
+        gint column = i % columns;
+        gint row = i / columns;
+        GstGLESCrop upload;
+
+        /* even edges, the last tile takes the remainder */
+        x0 = crop->x + ((crop->width * column / columns) & ~1);
+        x1 = column == columns - 1 ? crop->x + crop->width :
+             crop->x + ((crop->width * (column + 1) / columns) & ~1);
+        y0 = crop->y + ((crop->height * row / rows) & ~1);
+        y1 = row == rows - 1 ? crop->y + crop->height :
+             crop->y + ((crop->height * (row + 1) / rows) & ~1);
+
+        tile->area.x = x0;
+        tile->area.y = y0;
+        tile->area.width = x1 - x0;
+        tile->area.height = y1 - y0;
+
+        /* only overlap the neighbours, never beyond the visible area */
+        upload.x = MAX (x0 - GST_GLES_TILE_OVERLAP, crop->x);
+        upload.y = MAX (y0 - GST_GLES_TILE_OVERLAP, crop->y);
+        upload.width = MIN (x1 + GST_GLES_TILE_OVERLAP,
+                            crop->x + crop->width) - upload.x;
+        upload.height = MIN (y1 + GST_GLES_TILE_OVERLAP,
+                             crop->y + crop->height) - upload.y;
+
+        if (!tile->stream.initialized) {
+            gl_stream_init (&tile->stream, &gles->deinterlace,
+                            &thread->display->features,
+                            &thread->display->textures, &thread->memory);
+            tile->stream.rgb_tex.loc =
+                    glGetUniformLocation (gles->scale.program, "s_tex");
+            /* generate the framebuffer object */
+            res = gl_stream_gen_framebuffer (GST_ELEMENT (sink),
+                                             &tile->stream, upload.width,
+                                             upload.height);
+            if (res != GST_GLES_ALLOC_OK) {
+                gl_stream_delete (&tile->stream);
+                return res;
+            }
+        } else {
+            res = gl_stream_resize (GST_ELEMENT (sink), &tile->stream,
+                                    upload.width, upload.height);
+            if (res != GST_GLES_ALLOC_OK)
+                return res;
+        }
+        gl_stream_set_crop (&tile->stream, GST_VIDEO_SINK_WIDTH (sink),
+                            GST_VIDEO_SINK_HEIGHT (sink), &upload);
     }
 
-cleanup:
-    g_free (path);
-    g_dir_close (directory);
+    return GST_GLES_ALLOC_OK;
 }
 
+/* frame blending */
 
-static void
-egl_close(GstGLESSink *sink)
+static GstClockTime
+gl_get_running_time (GstGLESSink *sink)
 {
-    GstGLESContext *context = &sink->gl_thread.gles;
+    GstClockTime now;
+    GstClock *clock;
 
-    const GLuint framebuffers[] = {
-        context->framebuffer
-    };
+    clock = gst_element_get_clock (GST_ELEMENT (sink));
+    if (!clock)
+        return GST_CLOCK_TIME_NONE;
+    now = gst_clock_get_time (clock);
+    gst_object_unref (clock);
 
-    const GLuint textures[] = {
-        context->y_tex.id,
-        context->u_tex.id,
-        context->v_tex.id,
-        context->rgb_tex.id
-    };
+    return now - gst_element_get_base_time (GST_ELEMENT (sink));
+}
 
-    if (context->initialized) {
-        glDeleteFramebuffers (G_N_ELEMENTS(framebuffers), framebuffers);
-        glDeleteTextures (G_N_ELEMENTS(textures), textures);
-        gl_delete_shader (&context->scale);
-        gl_delete_shader (&context->deinterlace);
+/* keeps the picture of the previous frame of every tile by rendering the
+ * new frame into the other one of two textures. a frame is blended if
+ * all tiles still have the picture of the frame before, which follows
+ * at most GST_GLES_BLEND_MAX_INTERVAL earlier */
+static GstGLESAllocResult
+gl_update_blend (GstGLESSink *sink)
+{
+    GstGLESThread *thread = &sink->gl_thread;
+    GstGLESContext *gles = &thread->gles;
+    GstClockTime timestamp = GST_BUFFER_TIMESTAMP (thread->buf);
+    GstClockTime running = GST_CLOCK_TIME_NONE;
+    GstGLESAllocResult res;
+    gboolean valid = TRUE;
+    guint i;
+
+    thread->blend_weight = 1.0f;
+    thread->blend_interval = GST_CLOCK_TIME_NONE;
+
+    if (sink->frame_blending && !gles->blend.program &&
+        gl_link_optional_shader (sink, &gles->blend, SHADER_BLEND,
+                                 &gles->blend_failed)) {
+        gles->blend_tex_loc = glGetUniformLocation (gles->blend.program,
+                                                    "s_tex");
+        gles->blend_alpha_loc = glGetUniformLocation (gles->blend.program,
+                                                      "alpha");
     }
 
-    if (context->context) {
-        eglDestroyContext (context->display, context->context);
-        context->context = NULL;
+    if (!sink->frame_blending || !gles->blend.program) {
+        for (i = 0; i < gles->n_tiles; i++)
+            gl_texture_pool_release (gles->tiles[i].stream.pool,
+                                     gles->tiles[i].stream.memory,
+                                     &gles->tiles[i].previous);
+        thread->blend_running = GST_CLOCK_TIME_NONE;
+        return GST_GLES_ALLOC_OK;
     }
 
-    if (context->surface) {
-        eglDestroySurface (context->display, context->surface) ;
-        context->surface = NULL;
+    for (i = 0; i < gles->n_tiles; i++) {
+        GstGLESTile *tile = &gles->tiles[i];
+
+        valid = valid && tile->previous.id &&
+                tile->previous.width == tile->stream.width &&
+                tile->previous.height == tile->stream.height;
+        res = gl_stream_swap_texture (GST_ELEMENT (sink), &tile->stream,
+                                      &tile->previous);
+        if (res != GST_GLES_ALLOC_OK) {
+            thread->blend_running = GST_CLOCK_TIME_NONE;
+            return res;
+        }
     }
 
-    if (context->display) {
-        eglTerminate (context->display);
-        context->display = NULL;
+    if (GST_CLOCK_TIME_IS_VALID (timestamp))
+        running = gst_segment_to_running_time (
+                      &GST_BASE_SINK (sink)->segment, GST_FORMAT_TIME,
+                      timestamp);
+
+    if (valid && GST_CLOCK_TIME_IS_VALID (running) &&
+        GST_CLOCK_TIME_IS_VALID (thread->blend_running) &&
+        running > thread->blend_running &&
+        running - thread->blend_running <= GST_GLES_BLEND_MAX_INTERVAL) {
+        thread->blend_interval = running - thread->blend_running;
+        thread->blend_weight = 0.0f;
     }
+    thread->blend_running = running;
+
+    return GST_GLES_ALLOC_OK;
+}
+
+/* share of the current frame in a picture reaching the screen at the
+ * clock running time shown, by its position between the previous and the
+ * next frame. a frame is on screen latency after its running time, so
+ * the pictures lag one frame behind and the current one is fully shown
+ * once the next one is due */
+static gfloat
+gl_blend_weight (GstGLESSink *sink, GstClockTime shown)
+{
+    GstGLESThread *thread = &sink->gl_thread;
+    GstClockTime latency = gst_base_sink_get_latency (GST_BASE_SINK (sink));
 
-    egl_close_handles (sink);
+    if (!GST_CLOCK_TIME_IS_VALID (shown) ||
+        shown <= thread->blend_running + latency)
+        return 0.0f;
 
-    context->initialized = FALSE;
+    return MIN ((gfloat) (shown - latency - thread->blend_running) /
+                thread->blend_interval, 1.0f);
 }
 
-static gint
-x11_init (GstGLESSink *sink, gint width, gint height)
+/* frames are dropped while the tiles and their blend textures don't fit
+ * into max-gpu-memory, the application is warned once each time this
+ * starts. the driver failing to allocate them is an error */
+static GstGLESAllocResult
+gl_update_memory (GstGLESSink *sink)
 {
-    Window root;
-    XSetWindowAttributes swa;
-    XWMHints hints;
+    GstGLESThread *thread = &sink->gl_thread;
+    GstGLESAllocResult res;
+
+    GST_OBJECT_LOCK (sink);
+    thread->memory.budget = MIN (sink->max_gpu_memory, G_MAXSIZE);
+    GST_OBJECT_UNLOCK (sink);
+
+    res = gl_update_tiles (sink);
+    if (res == GST_GLES_ALLOC_OK)
+        res = gl_update_blend (sink);
+
+    if (res == GST_GLES_ALLOC_NO_BUDGET && !thread->over_budget)
+        GST_ELEMENT_WARNING (sink, RESOURCE, NO_SPACE_LEFT,
+                             ("Not enough GPU memory"),
+                             ("%" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT
+                              " bytes in use, dropping frames",
+                              thread->memory.allocated,
+                              thread->memory.budget));
+    else if (res == GST_GLES_ALLOC_FAILED)
+        GST_ELEMENT_ERROR (sink, RESOURCE, FAILED,
+                           ("Could not allocate textures"),
+                           ("%dx%d frame in %u tiles",
+                            thread->crop.width, thread->crop.height,
+                            thread->gles.n_tiles));
+    thread->over_budget = res == GST_GLES_ALLOC_NO_BUDGET;
+
+    return res;
+}
+
+/* presentation feedback */
 
-    sink->x11.display = XOpenDisplay (NULL);
-    if(!sink->x11.display) {
-        GST_ERROR_OBJECT(sink, "Could not create X display");
-        return -1;
+/* turns the monotonic time a frame reached the screen into running time
+ * and posts the delay against the buffer's running time, every frame or
+ * aggregated over present-interval frames */
+static void
+gl_present_resolve (GstGLESSink *sink, GstClockTime present)
+{
+    GstGLESPresentStats *stats = &sink->gl_thread.present;
+    GstStructure *structure;
+    GstClockTime now, running;
+    GstClockTimeDiff delay;
+    GstClock *clock;
+
+    clock = gst_element_get_clock (GST_ELEMENT (sink));
+    if (!clock)
+        return;
+    now = gst_clock_get_time (clock);
+    gst_object_unref (clock);
+
+    running = now - gst_element_get_base_time (GST_ELEMENT (sink)) -
+              (gst_util_get_timestamp () - present);
+    delay = GST_CLOCK_DIFF (stats->running_time, running);
+
+    if (!stats->count) {
+        stats->sum = 0;
+        stats->min = delay;
+        stats->max = delay;
     }
+    stats->count++;
+    stats->sum += delay;
+    stats->min = MIN (stats->min, delay);
+    stats->max = MAX (stats->max, delay);
+
+    if (stats->count < sink->present_interval)
+        return;
+
+    structure = gst_structure_new ("GstGLESSinkPresentation",
+            "running-time", G_TYPE_UINT64, stats->running_time,
+            "present-time", G_TYPE_UINT64, running,
+            "delay", G_TYPE_INT64, delay,
+            "frames", G_TYPE_UINT, stats->count,
+            "mean-delay", G_TYPE_INT64, stats->sum / stats->count,
+            "min-delay", G_TYPE_INT64, stats->min,
+            "max-delay", G_TYPE_INT64, stats->max,
+            NULL);
+    gst_element_post_message (GST_ELEMENT (sink),
+            gst_message_new_element (GST_OBJECT (sink), structure));
+    stats->count = 0;
+}
 
-    XLockDisplay (sink->x11.display);
-    root = DefaultRootWindow (sink->x11.display);
-    swa.event_mask =
-            StructureNotifyMask | ExposureMask | VisibilityChangeMask;
+/* the presentation time of the previous frame is known once the next one
+ * is about to be drawn. windows without presentation feedback fall back
+ * to the time the swap returned, which blocks until vblank with vsync */
+static void
+gl_present_check (GstGLESSink *sink)
+{
+    GstGLESPresentStats *stats = &sink->gl_thread.present;
+    GstClockTime presented = sink->x11.presentation_time;
 
-    if (!sink->x11.window) {
-        sink->x11.window = XCreateWindow (
-                    sink->x11.display, root,
-                    0, 0, width, height, 0,
-                    CopyFromParent, InputOutput,
-                    CopyFromParent, CWEventMask,
-                    &swa);
+    if (!GST_CLOCK_TIME_IS_VALID (stats->swap_time))
+        return;
 
-        XSetWindowBackgroundPixmap (sink->x11.display, sink->x11.window,
-                                    None);
+    if (GST_CLOCK_TIME_IS_VALID (presented) &&
+        presented != stats->last_presented) {
+        stats->last_presented = presented;
+        gl_present_resolve (sink, presented);
+    } else {
+        gl_present_resolve (sink, stats->swap_time);
+    }
+    stats->swap_time = GST_CLOCK_TIME_NONE;
+}
 
-        hints.input = True;
-        hints.flags = InputHint;
-        XSetWMHints(sink->x11.display, sink->x11.window, &hints);
+static void
+gl_present_queue (GstGLESSink *sink, GstBuffer *buf)
+{
+    GstGLESPresentStats *stats = &sink->gl_thread.present;
+    GstClockTime timestamp = GST_BUFFER_TIMESTAMP (buf);
 
-        XMapWindow (sink->x11.display, sink->x11.window);
-        XStoreName (sink->x11.display, sink->x11.window, "GLESSink");
-    } else {
-        guint border, depth;
-        int x, y;
-        /* change event mask, so we get resize notifications */
-        XSelectInput (sink->x11.display, sink->x11.window,
-                      ExposureMask | StructureNotifyMask |
-                      PointerMotionMask | KeyPressMask |
-                      KeyReleaseMask);
+    if (!GST_CLOCK_TIME_IS_VALID (timestamp))
+        return;
 
-        /* retrieve the current window geometry */
-        XGetGeometry (sink->x11.display, sink->x11.window, &root,
-                      &x, &y, (uint*)&sink->x11.width, (uint*)&sink->x11.height,
-                      &border, &depth);
-    }
+    stats->running_time = gst_segment_to_running_time (
+                              &GST_BASE_SINK (sink)->segment,
+                              GST_FORMAT_TIME, timestamp);
+    if (GST_CLOCK_TIME_IS_VALID (stats->running_time))
+        stats->swap_time = gst_util_get_timestamp ();
+}
 
-    XUnlockDisplay (sink->x11.display);
+/* render thread jobs */
 
-    return 0;
+static void
+gl_setup_job (gpointer data)
+{
+    GstGLESSink *sink = GST_GLES_SINK (data);
+
+    GST_DEBUG_OBJECT(sink, "Init GL context");
+    sink->gl_thread.running = setup_gl_context (sink) == 0;
 }
 
 static void
-x11_close (GstGLESSink *sink)
+gl_render_job (gpointer data)
 {
-    if (sink->x11.display) {
-        XLockDisplay (sink->x11.display);
+    GstGLESSink *sink = GST_GLES_SINK (data);
+    GstGLESThread *thread = &sink->gl_thread;
+    GstGLESTimelineRecord *record = NULL;
+    GstGLESAllocResult res;
+    guint i;
+
+    if (thread->timeline)
+        record = thread->timeline->current;
+    /* a dropped frame is not refreshed either */
+    thread->blend_interval = GST_CLOCK_TIME_NONE;
+    thread->blend_swap = GST_CLOCK_TIME_NONE;
+
+    /* other sinks may have used the thread in the meantime */
+    if (!gst_gles_render_thread_make_current (thread->render,
+                                              sink->x11.surface))
+        return;
+
+    /* the frame is redrawn anyway, just track the window size */
+    window_handle_events (GST_ELEMENT (sink), &sink->x11);
+
+    /* the compositor has not shown the previous frame yet, or the
+       window of a shared thread was swapped less than a refresh ago.
+       queueing another one would only add latency */
+    if (!window_frame_ready (&sink->x11, thread->render->vsync)) {
+        GST_LOG_OBJECT (sink, "Window not ready, dropping frame");
+        if (record)
+            record->drop = GST_GLES_TIMELINE_DROP_NOT_READY;
+        return;
+    }
+
+    if (sink->present_interval)
+        gl_present_check (sink);
 
-        /* only destroy the window if we created it, windows
-          owned by the application stay untouched */
-        if (!sink->x11.external_window) {
-            XDestroyWindow (sink->x11.display, sink->x11.window);
-            sink->x11.window = 0;
-        } else
-            XSelectInput (sink->x11.display, sink->x11.window, 0);
+    /* this is the first frame of new caps */
+    if (thread->reconfigure)
+        gl_apply_caps (sink);
+
+    /* crop changes take effect here, between two frames */
+    gl_update_crop (sink, thread->buf);
+
+    /* only the visible part is uploaded and deinterlaced */
+    res = gl_update_memory (sink);
+    if (res != GST_GLES_ALLOC_OK) {
+        if (record)
+            record->drop = res == GST_GLES_ALLOC_NO_BUDGET ?
+                           GST_GLES_TIMELINE_DROP_NO_MEMORY :
+                           GST_GLES_TIMELINE_DROP_ERROR;
+        return;
+    }
+    gl_update_balance (sink);
 
-        XSync (sink->x11.display, FALSE);
-        XUnlockDisplay (sink->x11.display);
-        XCloseDisplay(sink->x11.display);
-        sink->x11.display = NULL;
+#if GST_CHECK_VERSION(1, 0, 0)
+    gl_update_overlays (sink, thread->buf);
+#endif
+    if (record)
+        record->upload_start = gst_util_get_timestamp ();
+    for (i = 0; i < thread->gles.n_tiles; i++) {
+        gl_stream_draw_fbo (GST_ELEMENT (sink), &thread->gles.tiles[i].stream,
+                            &thread->gles.deinterlace, thread->buf);
+        if (record)
+            record->upload_bytes += thread->gles.tiles[i].stream.uploaded;
     }
+    if (record)
+        record->upload_end = gst_util_get_timestamp ();
+    /* the swap shows the picture with the next vblank */
+    if (GST_CLOCK_TIME_IS_VALID (thread->blend_interval))
+        thread->blend_weight = gl_blend_weight (sink,
+                                                gl_get_running_time (sink));
+    gl_draw_onscreen (sink);
+    if (record)
+        record->draw_end = gst_util_get_timestamp ();
+    window_swap_buffers (&sink->x11);
+    if (record)
+        record->swap_end = gst_util_get_timestamp ();
+    thread->blend_swap = gl_get_running_time (sink);
+    if (sink->present_interval)
+        gl_present_queue (sink, thread->buf);
+
+    /* redraws show the current frame */
+    thread->blend_weight = 1.0f;
+
+    /* snapshots are drawn and read back in between the frames */
+    gl_snapshot_finish (sink, FALSE);
+    gl_snapshot_start (sink);
 }
 
+/* draws the blend of the current frame once more, it reaches the screen
+ * with the vblank after the last swap */
 static void
-x11_handle_events (gpointer data)
+gl_blend_refresh_job (gpointer data)
 {
     GstGLESSink *sink = GST_GLES_SINK (data);
-
-    XLockDisplay (sink->x11.display);
-    while (XPending (sink->x11.display)) {
-        XEvent  xev;
-        XNextEvent(sink->x11.display, &xev);
-
-        switch (xev.type) {
-        case ConfigureRequest:
-            g_print("XConfigure* Request\n");
-        case ConfigureNotify:
-            GST_DEBUG_OBJECT(sink, "XConfigure* Event: wxh: %dx%d",
-                             xev.xconfigure.width,
-                             xev.xconfigure.height);
-            g_print("XConfigure* Event: wxh: %dx%d\n",
-                             xev.xconfigure.width,
-                             xev.xconfigure.height);
-            sink->x11.width = xev.xconfigure.width;
-            sink->x11.height = xev.xconfigure.height;
-
-            gl_draw_onscreen (sink);
-            break;
-        default:
-            break;
-        }
+    GstGLESThread *thread = &sink->gl_thread;
+    GstClockTime shown, now;
+
+    thread->blend_drawn = FALSE;
+    if (!gst_gles_render_thread_make_current (thread->render,
+                                              sink->x11.surface) ||
+        !window_frame_ready (&sink->x11, thread->render->vsync))
+        return;
+
+    shown = GST_CLOCK_TIME_IS_VALID (thread->refresh_period) ?
+            thread->blend_swap + thread->refresh_period :
+            gl_get_running_time (sink);
+    thread->blend_weight = gl_blend_weight (sink, shown);
+    gl_draw_onscreen (sink);
+    window_swap_buffers (&sink->x11);
+
+    /* with vsync the swap returns at vblank, which gives the refresh
+       period of the display. otherwise only the display server knows */
+    now = gl_get_running_time (sink);
+    if (!thread->render->vsync) {
+        thread->refresh_period = sink->x11.refresh_period;
+    } else if (GST_CLOCK_TIME_IS_VALID (now) && now > thread->blend_swap) {
+        if (!GST_CLOCK_TIME_IS_VALID (thread->refresh_period))
+            thread->refresh_period = now - thread->blend_swap;
+        else
+            thread->refresh_period = (7 * thread->refresh_period + now -
+                                      thread->blend_swap) / 8;
     }
-    XUnlockDisplay (sink->x11.display);
+    thread->blend_swap = now;
+    thread->blend_drawn = TRUE;
+    thread->blend_weight = 1.0f;
+}
+
+static void
+gl_close_job (gpointer data)
+{
+    GstGLESSink *sink = GST_GLES_SINK (data);
 
+    gst_gles_render_thread_make_current (sink->gl_thread.render,
+                                         sink->x11.surface);
+    gl_close (sink);
+    window_close (GST_ELEMENT (sink), &sink->x11);
 }
 
 static gboolean
 gl_thread_init (GstGLESSink *sink)
 {
     GstGLESThread *thread = &sink->gl_thread;
-    GError *error = NULL;
 
-    thread->handle = g_thread_try_new ("gl_thread", gl_thread_proc, sink, &error);
-    if (!thread->handle) {
-        GST_ERROR_OBJECT (sink, "Can't create render-thread: %s",
-                          error ? error->message : "(unknown)");
-        g_clear_error (&error);
+    thread->display = gst_gles_display_ref_default (GST_ELEMENT (sink),
+                                                    sink->backend);
+    if (!thread->display)
         return FALSE;
+    if (sink->close_driver_fds)
+        gst_gles_display_force_fd_cleanup (thread->display);
+
+    thread->render = gst_gles_display_acquire_thread (thread->display,
+                                                      GST_ELEMENT (sink));
+    if (!thread->render)
+        goto fail;
+
+    gst_gles_render_thread_invoke (thread->render, gl_setup_job, sink);
+    if (!thread->running) {
+        gst_gles_display_release_thread (thread->display, thread->render);
+        thread->render = NULL;
+        goto fail;
     }
+
     return TRUE;
+
+fail:
+    gst_gles_display_unref (thread->display);
+    thread->display = NULL;
+    return FALSE;
+}
+
+static gpointer
+gl_thread_prewarm_proc (gpointer data)
+{
+    GstGLESSink *sink = GST_GLES_SINK (data);
+    GstGLESThread *thread = &sink->gl_thread;
+    GstClockTime start = gst_util_get_timestamp ();
+    gboolean ret;
+
+    ret = gl_thread_init (sink);
+
+    g_mutex_lock (&thread->lock);
+    thread->init_time = gst_util_get_timestamp () - start;
+    thread->init_state = ret ? GST_GLES_INIT_READY : GST_GLES_INIT_FAILED;
+    g_cond_broadcast (&thread->init_cond);
+    g_mutex_unlock (&thread->lock);
+
+    GST_DEBUG_OBJECT (sink, "Setup %s after %" GST_TIME_FORMAT,
+                      ret ? "completed" : "failed",
+                      GST_TIME_ARGS (thread->init_time));
+    gst_object_unref (sink);
+
+    return NULL;
+}
+
+/* creates the window, the context and the programs on a helper thread,
+ * the window handle of the application is asked for first */
+static void
+gl_thread_prewarm (GstGLESSink *sink)
+{
+    GstGLESThread *thread = &sink->gl_thread;
+    GError *error = NULL;
+    GThread *prewarm;
+
+    if (thread->running || thread->init_state == GST_GLES_INIT_PENDING)
+        return;
+
+#if GST_CHECK_VERSION(1, 0, 0)
+    gst_video_overlay_prepare_window_handle (GST_VIDEO_OVERLAY (sink));
+#else
+    gst_x_overlay_prepare_xwindow_id (GST_X_OVERLAY (sink));
+#endif
+
+    thread->init_state = GST_GLES_INIT_PENDING;
+    thread->init_wait = 0;
+    prewarm = g_thread_try_new ("gles-prewarm", gl_thread_prewarm_proc,
+                                gst_object_ref (sink), &error);
+    if (!prewarm) {
+        /* the first frame sets up everything as usual */
+        GST_WARNING_OBJECT (sink, "Can't start setup thread: %s",
+                            error ? error->message : "(unknown)");
+        g_clear_error (&error);
+        thread->init_state = GST_GLES_INIT_NONE;
+        gst_object_unref (sink);
+        return;
+    }
+    g_thread_unref (prewarm);
+}
+
+/* blocks while the setup started in start() is still running, unless
+ * called from the setup itself, e.g. by a sync handler of the window
+ * handle message */
+static void
+gl_thread_wait_init (GstGLESSink *sink)
+{
+    GstGLESThread *thread = &sink->gl_thread;
+    GstClockTime start;
+
+    g_mutex_lock (&thread->lock);
+    if (thread->init_state == GST_GLES_INIT_PENDING &&
+        !(thread->render && thread->render->handle == g_thread_self ())) {
+        start = gst_util_get_timestamp ();
+        while (thread->init_state == GST_GLES_INIT_PENDING)
+            g_cond_wait (&thread->init_cond, &thread->lock);
+        thread->init_wait = gst_util_get_timestamp () - start;
+    }
+    g_mutex_unlock (&thread->lock);
+}
+
+static GstStructure *
+gl_thread_init_stats (GstGLESSink *sink)
+{
+    static const gchar *states[] = { "none", "pending", "ready", "failed" };
+    GstGLESThread *thread = &sink->gl_thread;
+    GstStructure *stats;
+
+    g_mutex_lock (&thread->lock);
+    stats = gst_structure_new ("GstGLESSinkInitStats",
+            "state", G_TYPE_STRING, states[thread->init_state],
+            "setup-time", G_TYPE_UINT64, thread->init_time,
+            "wait-time", G_TYPE_UINT64, thread->init_wait,
+            "parallel-compile", G_TYPE_BOOLEAN, thread->display &&
+            thread->display->features.parallel_compile,
+            NULL);
+    g_mutex_unlock (&thread->lock);
+
+    return stats;
+}
+
+static GstStructure *
+gl_thread_memory_stats (GstGLESSink *sink)
+{
+    GstGLESThread *thread = &sink->gl_thread;
+    guint64 total = 0;
+    guint64 cached = 0;
+    GstStructure *stats;
+
+    g_mutex_lock (&thread->lock);
+    if (thread->display) {
+        g_mutex_lock (&thread->display->textures.lock);
+        total = thread->display->textures.allocated;
+        cached = thread->display->textures.cached;
+        g_mutex_unlock (&thread->display->textures.lock);
+    }
+    stats = gst_structure_new ("GstGLESSinkMemoryStats",
+            "allocated", G_TYPE_UINT64, (guint64) thread->memory.allocated,
+            "over-budget", G_TYPE_BOOLEAN, thread->over_budget,
+            "total-allocated", G_TYPE_UINT64, total,
+            "total-cached", G_TYPE_UINT64, cached,
+            NULL);
+    g_mutex_unlock (&thread->lock);
+
+    return stats;
 }
 
 static void
 gl_thread_stop (GstGLESSink *sink)
 {
-    if (sink->gl_thread.running) {
-        sink->gl_thread.running = FALSE;
-        g_mutex_lock (&sink->gl_thread.data_lock);
-        sink->gl_thread.buf = NULL;
+    GstGLESThread *thread = &sink->gl_thread;
+
+    gl_thread_wait_init (sink);
 
-        g_cond_signal (&sink->gl_thread.data_signal);
-        g_mutex_unlock (&sink->gl_thread.data_lock);
+    g_mutex_lock (&thread->lock);
+    if (thread->running) {
+        thread->running = FALSE;
+        gst_gles_render_thread_invoke (thread->render, gl_close_job, sink);
 
-        g_thread_join(sink->gl_thread.handle);
+        gst_gles_display_release_thread (thread->display, thread->render);
+        thread->render = NULL;
+        gst_gles_display_unref (thread->display);
+        thread->display = NULL;
     }
+    g_mutex_unlock (&thread->lock);
+
+    /* a snapshot nobody picked up is dropped with the context */
+    GST_OBJECT_LOCK (sink);
+    thread->snapshot.requested = FALSE;
+    if (thread->snapshot.result)
+#if GST_CHECK_VERSION(1, 0, 0)
+        gst_sample_unref (thread->snapshot.result);
+#else
+        gst_buffer_unref (thread->snapshot.result);
+#endif
+    thread->snapshot.result = NULL;
+    GST_OBJECT_UNLOCK (sink);
 }
 
-/* gl thread main function */
-static gpointer
-gl_thread_proc (gpointer data)
+/* draws the last frame again, e.g. after the window changed */
+static void
+gl_redraw (GstGLESSink *sink)
+{
+    if (!sink->gl_thread.gles.tiles[0].stream.initialized ||
+        !gst_gles_render_thread_make_current (sink->gl_thread.render,
+                                              sink->x11.surface))
+        return;
+
+    gl_draw_onscreen (sink);
+    window_swap_buffers (&sink->x11);
+}
+
+typedef struct
+{
+    GstGLESSink *sink;
+    guintptr handle;
+    GstVideoRectangle rect;
+} GstGLESWindowChange;
+
+/* moves rendering to another window. only the EGL surface is replaced,
+ * the context with its programs and textures stays as it is, so the last
+ * frame is shown on the new window right away */
+static void
+gl_set_window_job (gpointer data)
+{
+    GstGLESWindowChange *change = data;
+    GstGLESSink *sink = change->sink;
+    GstGLESDisplay *display = sink->gl_thread.display;
+
+    gst_gles_render_thread_release_current (sink->gl_thread.render);
+    egl_close_surface (GST_ELEMENT (sink), &sink->x11);
+    window_close (GST_ELEMENT (sink), &sink->x11);
+
+    sink->x11.window = change->handle;
+    sink->x11.external_window = change->handle != 0;
+
+    if (window_init (GST_ELEMENT (sink), &sink->x11, display->backend,
+                     display->native_display, sink->x11.width,
+                     sink->x11.height) < 0 ||
+        egl_init_surface (GST_ELEMENT (sink), &sink->x11,
+                          display->config) < 0) {
+        GST_ERROR_OBJECT (sink, "Could not switch to window %" G_GUINTPTR_FORMAT,
+                          change->handle);
+        egl_close_surface (GST_ELEMENT (sink), &sink->x11);
+        return;
+    }
+
+    if (!sink->x11.external_window && sink->x11.window)
+#if GST_CHECK_VERSION(1, 0, 0)
+        gst_video_overlay_got_window_handle (GST_VIDEO_OVERLAY (sink),
+                                             sink->x11.window);
+#else
+        gst_x_overlay_got_window_handle (GST_X_OVERLAY (sink),
+                                         sink->x11.window);
+#endif
+
+    gl_redraw (sink);
+}
+
+static void
+gl_set_render_rect_job (gpointer data)
+{
+    GstGLESWindowChange *change = data;
+
+    change->sink->render_rect = change->rect;
+    gl_redraw (change->sink);
+}
+
+static void
+gl_redraw_job (gpointer data)
+{
+    gl_redraw (GST_GLES_SINK (data));
+}
+
+/* takes a requested snapshot while no frames arrive */
+static void
+gl_snapshot_job (gpointer data)
 {
     GstGLESSink *sink = GST_GLES_SINK (data);
+
+    if (!gst_gles_render_thread_make_current (sink->gl_thread.render,
+                                              sink->x11.surface))
+        return;
+
+    gl_snapshot_start (sink);
+    gl_snapshot_finish (sink, TRUE);
+}
+
+/* emits snapshot-ready for a finished snapshot, with no lock held */
+static void
+gl_thread_snapshot_ready (GstGLESSink *sink)
+{
+    GstGLESSnapshot *snapshot = &sink->gl_thread.snapshot;
+#if GST_CHECK_VERSION(1, 0, 0)
+    GstSample *result;
+#else
+    GstBuffer *result;
+#endif
+
+    GST_OBJECT_LOCK (sink);
+    result = snapshot->result;
+    snapshot->result = NULL;
+    GST_OBJECT_UNLOCK (sink);
+
+    if (!result)
+        return;
+
+    g_signal_emit (sink, gst_gles_sink_signals[SIGNAL_SNAPSHOT_READY], 0,
+                   result);
+#if GST_CHECK_VERSION(1, 0, 0)
+    gst_sample_unref (result);
+#else
+    gst_buffer_unref (result);
+#endif
+}
+
+/* shows the last frame again after a property affecting it changed */
+static void
+gl_thread_redraw (GstGLESSink *sink)
+{
     GstGLESThread *thread = &sink->gl_thread;
 
-    GST_DEBUG_OBJECT(sink, "Init GL context (no timedwait)");
-    thread->running = setup_gl_context (sink) == 0;
+    g_mutex_lock (&thread->lock);
+    if (thread->running)
+        gst_gles_render_thread_invoke (thread->render, gl_redraw_job, sink);
+    g_mutex_unlock (&thread->lock);
+}
 
-    GST_DEBUG_OBJECT(sink, "Init GL context done, send signal");
-    /* signal gst_gles_sink_render that we are done */
-    g_mutex_lock (&thread->render_lock);
-    g_cond_signal (&thread->render_signal);
-    g_mutex_unlock (&thread->render_lock);
+/* hands the buffer to the render thread and waits until it is shown */
+static void
+gl_thread_render (GstGLESSink *sink, GstBuffer *buf)
+{
+    GstGLESThread *thread = &sink->gl_thread;
+    guint i;
+
+    /* the copy into the upload buffers runs here on the streaming
+       thread, so a render thread shared with other sinks only starts
+       the transfers. the tiles only get the geometry of new caps in the
+       job, until then the frame is copied there */
+    if (!thread->reconfigure) {
+        for (i = 0; i < thread->gles.n_tiles; i++)
+            gl_stream_fill_upload (&thread->gles.tiles[i].stream, buf);
+    }
 
-    while (thread->running) {
-        x11_handle_events (sink);
+    thread->buf = buf;
+    gst_gles_render_thread_invoke (thread->render, gl_render_job, sink);
+    thread->buf = NULL;
+    thread->last_timestamp = GST_BUFFER_TIMESTAMP (buf);
 
-        g_mutex_lock (&thread->data_lock);
-        /* wait till gst_gles_sink_render has some data for us */
-        while (!thread->buf && thread->running) {
-            g_cond_wait (&thread->data_signal, &thread->data_lock);
-        }
+    gl_thread_snapshot_ready (sink);
+}
 
-        if (thread->buf) {
-            if (!thread->gles.initialized) {
-                /* generate the framebuffer object */
-                gl_gen_framebuffer (sink);
-                thread->gles.initialized = TRUE;
-            }
+/* draws the blend again at the refreshes before the next frame is due.
+ * every refresh is a job of its own, so a render thread shared with other
+ * sinks serves them in between. the streaming thread waits on the clock
+ * until half a refresh period before the vblank, and stops once a refresh
+ * would delay the render of the next frame */
+static void
+gl_thread_blend_refreshes (GstGLESSink *sink)
+{
+    GstBaseSink *basesink = GST_BASE_SINK (sink);
+    GstGLESThread *thread = &sink->gl_thread;
+    GstClockTime latency, delay, due, period, next;
+    GstClockReturn ret;
+    guint i;
+
+    if (!GST_CLOCK_TIME_IS_VALID (thread->blend_interval))
+        return;
+
+    /* basesink starts to render the next frame at due */
+    latency = gst_base_sink_get_latency (basesink);
+    delay = gst_base_sink_get_render_delay (basesink);
+    due = thread->blend_running + thread->blend_interval + latency;
+    due = due > delay ? due - delay : 0;
+
+    for (i = 0; i < GST_GLES_BLEND_MAX_REFRESHES; i++) {
+        period = thread->refresh_period;
+        if (!GST_CLOCK_TIME_IS_VALID (thread->blend_swap))
+            break;
 
-            XLockDisplay (sink->x11.display);
-            gl_draw_fbo (sink, thread->buf);
-            gl_draw_onscreen (sink);
-            thread->buf = NULL;
-            XUnlockDisplay (sink->x11.display);
-	    thread->render_done = TRUE;
+        if (GST_CLOCK_TIME_IS_VALID (period)) {
+            next = thread->blend_swap + period;
+            if (next >= due)
+                break;
+            ret = gst_base_sink_wait_clock (basesink, next - period / 2,
+                                            NULL);
+            if (ret != GST_CLOCK_OK && ret != GST_CLOCK_EARLY)
+                break;
+        } else if (gl_get_running_time (sink) >= due) {
+            break;
         }
 
-        g_mutex_unlock (&thread->data_lock);
-
-        /* signal gst_gles_sink_render that we are done */
-        g_mutex_lock (&thread->render_lock);
-        g_cond_signal (&thread->render_signal);
-        g_mutex_unlock (&thread->render_lock);
+        gst_gles_render_thread_invoke (thread->render, gl_blend_refresh_job,
+                                       sink);
+        if (!thread->blend_drawn)
+            break;
     }
-
-    egl_close(sink);
-    x11_close(sink);
-    return 0;
 }
 
 static gint
 setup_gl_context (GstGLESSink *sink)
 {
+    static const GstGLESShaderTypes shader_types[] = {
+        SHADER_DEINT_LINEAR,
+        SHADER_COPY,
+    };
     GstGLESContext *gles = &sink->gl_thread.gles;
+    GstGLESDisplay *display = sink->gl_thread.display;
     gint ret;
 
+    sink->x11.egl_display = display->egl_display;
     sink->x11.width = 720;
     sink->x11.height = 576;
-    if (x11_init (sink, sink->x11.width, sink->x11.height) < 0) {
-        GST_ERROR_OBJECT (sink, "X11 init failed, abort");
+    if (window_init (GST_ELEMENT (sink), &sink->x11, display->backend,
+                     display->native_display, sink->x11.width,
+                     sink->x11.height) < 0) {
+        GST_ERROR_OBJECT (sink, "Window init failed, abort");
         return -ENOMEM;
     }
 
-    if (egl_init (sink) < 0) {
+    if (egl_init_surface (GST_ELEMENT (sink), &sink->x11,
+                          display->config) < 0 ||
+        !gst_gles_render_thread_make_current (sink->gl_thread.render,
+                                              sink->x11.surface)) {
         GST_ERROR_OBJECT (sink, "EGL init failed, abort");
-        x11_close (sink);
+        egl_close_surface (GST_ELEMENT (sink), &sink->x11);
+        window_close (GST_ELEMENT (sink), &sink->x11);
+        return -ENOMEM;
+    }
+
+    /* with parallel compiles the shaders are built side by side */
+    ret = gst_gles_display_compile_shaders (display, GST_ELEMENT (sink),
+                                            shader_types,
+                                            G_N_ELEMENTS (shader_types));
+    if (ret < 0) {
+        GST_ERROR_OBJECT (sink, "Could not compile shaders: %d", ret);
+        gl_close (sink);
+        window_close (GST_ELEMENT (sink), &sink->x11);
         return -ENOMEM;
     }
 
-    ret = gl_init_shader (GST_ELEMENT (sink), &gles->deinterlace,
-                          SHADER_DEINT_LINEAR);
+    ret = gst_gles_display_link_shader (display, GST_ELEMENT (sink),
+                                        &gles->deinterlace,
+                                        SHADER_DEINT_LINEAR);
     if (ret < 0) {
         GST_ERROR_OBJECT (sink, "Could not initialize shader: %d", ret);
-        egl_close (sink);
-        x11_close (sink);
+        gl_close (sink);
+        window_close (GST_ELEMENT (sink), &sink->x11);
         return -ENOMEM;
     }
-    gles->y_tex.loc = glGetUniformLocation(gles->deinterlace.program,
-                                           "s_ytex");
-    gles->u_tex.loc = glGetUniformLocation(gles->deinterlace.program,
-                                           "s_utex");
-    gles->v_tex.loc = glGetUniformLocation(gles->deinterlace.program,
-                                           "s_vtex");
 
-    ret = gl_init_shader (GST_ELEMENT (sink), &gles->scale, SHADER_COPY);
+    ret = gst_gles_display_link_shader (display, GST_ELEMENT (sink),
+                                        &gles->scale, SHADER_COPY);
     if (ret < 0) {
         GST_ERROR_OBJECT (sink, "Could not initialize shader: %d", ret);
-        egl_close (sink);
-        x11_close (sink);
+        gl_close (sink);
+        window_close (GST_ELEMENT (sink), &sink->x11);
         return -ENOMEM;
     }
-    gles->rgb_tex.loc = glGetUniformLocation(gles->scale.program, "s_tex");
-    gl_init_textures (sink);
 
     /* finally announce the window handle to controling app */
-    if (!sink->x11.external_window)
+    if (!sink->x11.external_window && sink->x11.window)
 #if GST_CHECK_VERSION(1, 0, 0)
         gst_video_overlay_got_window_handle (GST_VIDEO_OVERLAY (sink),
                                          sink->x11.window);
@@ -819,6 +2080,47 @@ setup_gl_context (GstGLESSink *sink)
 }
 
 
+/* runs from the application thread. the request is taken up by the
+ * render thread after the next frame, the result is handed out with
+ * snapshot-ready. while no frames arrive it is taken right away */
+static gboolean
+gst_gles_sink_snapshot (GstGLESSink *sink, gint width, gint height,
+                        const gchar *format)
+{
+    GstGLESThread *thread = &sink->gl_thread;
+    GstGLESSnapshot *snapshot = &thread->snapshot;
+    gboolean i420 = FALSE;
+    gboolean playing;
+
+    if (format && g_str_equal (format, "I420")) {
+        i420 = TRUE;
+    } else if (format && !g_str_equal (format, "RGBA")) {
+        GST_WARNING_OBJECT (sink, "Unsupported snapshot format %s", format);
+        return FALSE;
+    }
+
+    GST_OBJECT_LOCK (sink);
+    snapshot->requested = TRUE;
+    snapshot->request_width = width;
+    snapshot->request_height = height;
+    snapshot->request_i420 = i420;
+    playing = GST_STATE (sink) == GST_STATE_PLAYING;
+    GST_OBJECT_UNLOCK (sink);
+
+    if (playing)
+        return TRUE;
+
+    gl_thread_wait_init (sink);
+    g_mutex_lock (&thread->lock);
+    if (thread->running)
+        gst_gles_render_thread_invoke (thread->render, gl_snapshot_job,
+                                       sink);
+    g_mutex_unlock (&thread->lock);
+
+    gl_thread_snapshot_ready (sink);
+    return TRUE;
+}
+
 #if !GST_CHECK_VERSION(1, 0, 0)
 /* GObject vmethod implementations */
 
@@ -880,12 +2182,144 @@ gst_gles_sink_class_init (GstGLESSinkClass * klass)
 	"first frame is drawn, drop n frames.", 0, G_MAXUINT, 0,
 	  G_PARAM_READWRITE));
 
+  g_object_class_install_property (gobject_class, PROP_BACKEND,
+      g_param_spec_enum ("backend", "Window system backend", "Window system "
+        "to render on, takes effect on the next start.",
+        GST_TYPE_GLES_WINDOW_BACKEND, GST_GLES_WINDOW_BACKEND_X11,
+	  G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_PERSISTENT,
+      g_param_spec_boolean ("persistent", "Persistent", "Keep the window and "
+        "GL context when going to READY, they are only released in NULL.",
+        FALSE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_CLOSE_DRIVER_FDS,
+      g_param_spec_boolean ("close-driver-fds", "Close driver handles",
+        "Close the device handles the EGL driver opened once the display "
+        "is terminated, which is done anyway for tegra devices.", FALSE,
+        G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_GPU_MEMORY,
+      g_param_spec_uint64 ("max-gpu-memory", "Maximum GPU memory",
+        "Drop frames instead of allocating textures and buffers beyond "
+        "n bytes, 0 is unlimited.", 0, G_MAXUINT64, 0,
+        G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_MEMORY_STATS,
+      g_param_spec_boxed ("memory-stats", "GPU memory statistics",
+        "GPU memory held by this element and by all elements sharing the "
+        "display, including the textures kept for reuse.",
+        GST_TYPE_STRUCTURE, G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_FRAME_BLENDING,
+      g_param_spec_boolean ("frame-blending", "Frame blending", "Convert "
+        "the frame rate to the refresh rate of the display by blending "
+        "each frame over the previous one at every refresh, pictures are "
+        "shown one frame later.", FALSE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_FPS,
+      g_param_spec_uint ("max-fps", "Maximum frame rate", "Drop frames "
+        "before they are uploaded to show at most n frames per second, "
+        "0 shows all frames.", 0, G_MAXUINT, 0,
+	  G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_TIMELINE,
+      g_param_spec_boolean ("timeline", "Frame timeline", "Publish the "
+        "timing of every frame in " GST_GLES_TIMELINE_PREFIX "<pid>-<name>, "
+        "takes effect on the next start.", FALSE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_PRESENT_INTERVAL,
+      g_param_spec_uint ("present-interval", "Presentation messages",
+        "Post a GstGLESSinkPresentation element message with the delay "
+        "between running time and the time frames reached the screen, "
+        "aggregated over n frames, 0 disables them.", 0, G_MAXUINT, 0,
+	  G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_BRIGHTNESS,
+      g_param_spec_int ("brightness", "Brightness", "The brightness of the "
+        "video.", -1000, 1000, 0, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_CONTRAST,
+      g_param_spec_int ("contrast", "Contrast", "The contrast of the "
+        "video.", -1000, 1000, 0, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_HUE,
+      g_param_spec_int ("hue", "Hue", "The hue of the video.", -1000, 1000,
+        0, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_SATURATION,
+      g_param_spec_int ("saturation", "Saturation", "The saturation of the "
+        "video.", -1000, 1000, 0, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_INIT_STATS,
+      g_param_spec_boxed ("init-stats", "Initialisation statistics",
+        "State of the window and GL setup started ahead of the first frame, "
+        "its duration and how long the first frame waited for it.",
+        GST_TYPE_STRUCTURE, G_PARAM_READABLE));
+
+#if GST_CHECK_VERSION(1, 10, 0)
+  g_object_class_override_property (gobject_class, PROP_VIDEO_DIRECTION,
+      "video-direction");
+#endif
+
+  /**
+   * GstGLESSink::snapshot:
+   * @sink: the sink
+   * @width: width of the snapshot, 0 for the size shown on screen
+   * @height: height of the snapshot, 0 for the size shown on screen
+   * @format: "RGBA" or "I420", NULL for RGBA
+   *
+   * Requests a snapshot of the picture as it is shown, scaled and
+   * converted on the GPU. It is taken after the next frame, or right away
+   * while no frames arrive, and handed out with #GstGLESSink::snapshot-ready.
+   * Sizes are limited to the maximum texture size, I420 ones are rounded
+   * down to multiples of 8x4. Returns FALSE for unsupported formats.
+   */
+  gst_gles_sink_signals[SIGNAL_SNAPSHOT] =
+      g_signal_new ("snapshot", G_TYPE_FROM_CLASS (klass),
+          G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+          G_STRUCT_OFFSET (GstGLESSinkClass, snapshot), NULL, NULL,
+          g_cclosure_marshal_generic, G_TYPE_BOOLEAN,
+          3, G_TYPE_INT, G_TYPE_INT, G_TYPE_STRING);
+
+  /**
+   * GstGLESSink::snapshot-ready:
+   * @sink: the sink
+   * @snapshot: a #GstSample (a #GstBuffer with caps on 0.10)
+   *
+   * Emitted from the streaming thread once a requested snapshot has been
+   * read back, or from the thread requesting it while no frames arrive.
+   */
+  gst_gles_sink_signals[SIGNAL_SNAPSHOT_READY] =
+      g_signal_new ("snapshot-ready", G_TYPE_FROM_CLASS (klass),
+          G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+          g_cclosure_marshal_generic, G_TYPE_NONE, 1,
+#if GST_CHECK_VERSION(1, 0, 0)
+          GST_TYPE_SAMPLE);
+#else
+          GST_TYPE_BUFFER);
+#endif
+
+  klass->snapshot = gst_gles_sink_snapshot;
+
   /* initialise virtual methods */
+  element_class->change_state = GST_DEBUG_FUNCPTR (gst_gles_sink_change_state);
   basesink_class->start = GST_DEBUG_FUNCPTR (gst_gles_sink_start);
   basesink_class->stop = GST_DEBUG_FUNCPTR (gst_gles_sink_stop);
   basesink_class->render = GST_DEBUG_FUNCPTR (gst_gles_sink_render);
   basesink_class->preroll = GST_DEBUG_FUNCPTR (gst_gles_sink_preroll);
+  basesink_class->get_caps = GST_DEBUG_FUNCPTR (gst_gles_sink_get_caps);
   basesink_class->set_caps = GST_DEBUG_FUNCPTR (gst_gles_sink_set_caps);
+#if GST_CHECK_VERSION(1, 2, 0) && defined(HAVE_WAYLAND)
+  element_class->set_context = GST_DEBUG_FUNCPTR (gst_gles_sink_set_context);
+#endif
+#if GST_CHECK_VERSION(1, 10, 0)
+  basesink_class->event = GST_DEBUG_FUNCPTR (gst_gles_sink_event);
+#endif
+#if GST_CHECK_VERSION(1, 0, 0)
+  basesink_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_gles_sink_propose_allocation);
+#endif
 
 #if GST_CHECK_VERSION(1, 0, 0)
   gst_element_class_set_details_simple(element_class,
@@ -912,16 +2346,25 @@ gst_gles_sink_init (GstGLESSink * sink,
     GstGLESSinkClass * gclass)
 #endif
 {
-    GstGLESThread *thread = &sink->gl_thread;
     Status ret;
 
     sink->silent = FALSE;
-    sink->gl_thread.gles.initialized = FALSE;
-
-    g_mutex_init(&thread->data_lock);
-    g_mutex_init(&thread->render_lock);
-    g_cond_init(&thread->data_signal);
-    g_cond_init(&thread->render_signal);
+    g_mutex_init (&sink->gl_thread.lock);
+    g_cond_init (&sink->gl_thread.init_cond);
+    sink->gl_thread.avg_render = GST_CLOCK_TIME_NONE;
+    sink->gl_thread.next_frame = GST_CLOCK_TIME_NONE;
+    sink->gl_thread.blend_running = GST_CLOCK_TIME_NONE;
+    sink->gl_thread.blend_interval = GST_CLOCK_TIME_NONE;
+    sink->gl_thread.blend_weight = 1.0f;
+    sink->gl_thread.blend_swap = GST_CLOCK_TIME_NONE;
+    sink->gl_thread.refresh_period = GST_CLOCK_TIME_NONE;
+    sink->gl_thread.present.swap_time = GST_CLOCK_TIME_NONE;
+    sink->gl_thread.present.last_presented = GST_CLOCK_TIME_NONE;
+    sink->gl_thread.gles.overlays = g_array_new (FALSE, TRUE,
+                                                 sizeof (GstGLESOverlay));
+#if GST_CHECK_VERSION(1, 0, 0)
+    gl_init_balance_channels (sink);
+#endif
 
     ret = XInitThreads();
     if (ret == 0) {
@@ -943,20 +2386,69 @@ gst_gles_sink_set_property (GObject * object, guint prop_id,
       filter->silent = g_value_get_boolean (value);
       break;
     case PROP_CROP_TOP:
+      GST_OBJECT_LOCK (filter);
       filter->crop_top = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (filter);
       break;
     case PROP_CROP_BOTTOM:
+      GST_OBJECT_LOCK (filter);
       filter->crop_bottom = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (filter);
       break;
     case PROP_CROP_LEFT:
+      GST_OBJECT_LOCK (filter);
       filter->crop_left = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (filter);
       break;
     case PROP_CROP_RIGHT:
+      GST_OBJECT_LOCK (filter);
       filter->crop_right = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (filter);
       break;
     case PROP_DROP_FIRST:
       filter->drop_first = g_value_get_uint (value);
       break;
+    case PROP_BACKEND:
+      filter->backend = g_value_get_enum (value);
+      break;
+    case PROP_PERSISTENT:
+      filter->persistent = g_value_get_boolean (value);
+      break;
+    case PROP_CLOSE_DRIVER_FDS:
+      filter->close_driver_fds = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_GPU_MEMORY:
+      GST_OBJECT_LOCK (filter);
+      filter->max_gpu_memory = g_value_get_uint64 (value);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_FRAME_BLENDING:
+      filter->frame_blending = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_FPS:
+      filter->max_fps = g_value_get_uint (value);
+      break;
+    case PROP_TIMELINE:
+      filter->timeline = g_value_get_boolean (value);
+      break;
+    case PROP_PRESENT_INTERVAL:
+      filter->present_interval = g_value_get_uint (value);
+      break;
+    case PROP_BRIGHTNESS:
+    case PROP_CONTRAST:
+    case PROP_HUE:
+    case PROP_SATURATION:
+      gl_set_balance (filter, prop_id - PROP_BRIGHTNESS,
+                      g_value_get_int (value));
+      break;
+#if GST_CHECK_VERSION(1, 10, 0)
+    case PROP_VIDEO_DIRECTION:
+      GST_OBJECT_LOCK (filter);
+      filter->direction = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (filter);
+      gl_thread_redraw (filter);
+      break;
+#endif
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -988,6 +2480,51 @@ gst_gles_sink_get_property (GObject * object, guint prop_id,
     case PROP_DROP_FIRST:
       g_value_set_uint (value, filter->drop_first);
       break;
+    case PROP_BACKEND:
+      g_value_set_enum (value, filter->backend);
+      break;
+    case PROP_PERSISTENT:
+      g_value_set_boolean (value, filter->persistent);
+      break;
+    case PROP_CLOSE_DRIVER_FDS:
+      g_value_set_boolean (value, filter->close_driver_fds);
+      break;
+    case PROP_MAX_GPU_MEMORY:
+      GST_OBJECT_LOCK (filter);
+      g_value_set_uint64 (value, filter->max_gpu_memory);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_MEMORY_STATS:
+      g_value_take_boxed (value, gl_thread_memory_stats (filter));
+      break;
+    case PROP_FRAME_BLENDING:
+      g_value_set_boolean (value, filter->frame_blending);
+      break;
+    case PROP_MAX_FPS:
+      g_value_set_uint (value, filter->max_fps);
+      break;
+    case PROP_TIMELINE:
+      g_value_set_boolean (value, filter->timeline);
+      break;
+    case PROP_PRESENT_INTERVAL:
+      g_value_set_uint (value, filter->present_interval);
+      break;
+    case PROP_BRIGHTNESS:
+    case PROP_CONTRAST:
+    case PROP_HUE:
+    case PROP_SATURATION:
+      GST_OBJECT_LOCK (filter);
+      g_value_set_int (value, filter->balance[prop_id - PROP_BRIGHTNESS]);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_INIT_STATS:
+      g_value_take_boxed (value, gl_thread_init_stats (filter));
+      break;
+#if GST_CHECK_VERSION(1, 10, 0)
+    case PROP_VIDEO_DIRECTION:
+      g_value_set_enum (value, filter->direction);
+      break;
+#endif
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -997,9 +2534,43 @@ gst_gles_sink_get_property (GObject * object, guint prop_id,
 /* GstElement vmethod implementations */
 
 /* initialisation code */
+static GstStateChangeReturn
+gst_gles_sink_change_state (GstElement *element, GstStateChange transition)
+{
+    GstGLESSink *sink = GST_GLES_SINK (element);
+    GstStateChangeReturn ret;
+
+    ret = GST_ELEMENT_CLASS (parent_class)->change_state (element,
+                                                          transition);
+
+    switch (transition) {
+      case GST_STATE_CHANGE_READY_TO_NULL:
+        gl_thread_stop (sink);
+        if (sink->gl_thread.timeline) {
+            gst_gles_timeline_close (sink->gl_thread.timeline);
+            sink->gl_thread.timeline = NULL;
+        }
+        break;
+      default:
+        break;
+    }
+
+    return ret;
+}
+
 static gboolean
 gst_gles_sink_start (GstBaseSink *basesink)
 {
+    GstGLESSink *sink = GST_GLES_SINK (basesink);
+
+    if (sink->timeline && !sink->gl_thread.timeline)
+        sink->gl_thread.timeline = gst_gles_timeline_open (
+                    GST_ELEMENT (sink), GST_GLES_TIMELINE_RECORDS);
+
+    /* the window and the shaders are prepared while the caps are still
+       being negotiated, the first frame only waits for what is left */
+    gl_thread_prewarm (sink);
+
     return TRUE;
 }
 
@@ -1008,25 +2579,106 @@ static gboolean
 gst_gles_sink_stop (GstBaseSink *basesink)
 {
     GstGLESSink *sink = GST_GLES_SINK (basesink);
+    GstGLESThread *thread = &sink->gl_thread;
+
+    /* in persistent mode everything is kept, the stream textures are
+       resized if the next stream comes with another size */
+    if (sink->persistent)
+        return TRUE;
 
     gl_thread_stop (sink);
 
+    thread->init_state = GST_GLES_INIT_NONE;
+    thread->over_budget = FALSE;
+    thread->reconfigure = FALSE;
+    thread->avg_render = GST_CLOCK_TIME_NONE;
+    thread->next_frame = GST_CLOCK_TIME_NONE;
+    thread->blend_running = GST_CLOCK_TIME_NONE;
+    thread->blend_interval = GST_CLOCK_TIME_NONE;
+    thread->blend_weight = 1.0f;
+    thread->blend_swap = GST_CLOCK_TIME_NONE;
+    thread->refresh_period = GST_CLOCK_TIME_NONE;
+    thread->present.swap_time = GST_CLOCK_TIME_NONE;
+    thread->present.count = 0;
     GST_VIDEO_SINK_WIDTH (sink) = 0;
     GST_VIDEO_SINK_HEIGHT (sink)  = 0;
 
     return TRUE;
 }
 
+/* the template caps the probed features of the backend support, limited
+ * to the frame size which still fits in the tiles. the features are
+ * cached, so only the first instance negotiates without them */
+static GstCaps *
+#if GST_CHECK_VERSION(1, 0, 0)
+gst_gles_sink_get_caps (GstBaseSink *basesink, GstCaps *filter)
+#else
+gst_gles_sink_get_caps (GstBaseSink *basesink)
+#endif
+{
+  GstGLESSink *sink = GST_GLES_SINK (basesink);
+  GstGLESFeatures features;
+  GstCaps *caps;
+  gint max_size;
+  guint i;
+
+#if GST_CHECK_VERSION(1, 0, 0)
+  {
+      GstCaps *templ = gst_pad_get_pad_template_caps (
+              GST_BASE_SINK_PAD (basesink));
+
+      caps = gst_caps_copy (templ);
+      gst_caps_unref (templ);
+  }
+#else
+  caps = gst_caps_copy (gst_pad_get_pad_template_caps (
+                        GST_BASE_SINK_PAD (basesink)));
+#endif
+
+  if (gst_gles_display_get_probed_features (sink->backend, &features) &&
+      features.max_texture_size > 0) {
+      /* a single row or column of tiles, set_caps checks the number of
+         tiles the whole frame needs */
+      max_size = GST_GLES_MAX_TILES *
+                 gl_tile_size (features.max_texture_size);
+      max_size = CLAMP (max_size, GST_GLES_MIN_SIZE, GST_GLES_MAX_SIZE);
+
+      for (i = 0; i < gst_caps_get_size (caps); i++)
+          gst_structure_set (gst_caps_get_structure (caps, i),
+                             "width", GST_TYPE_INT_RANGE, GST_GLES_MIN_SIZE,
+                             max_size,
+                             "height", GST_TYPE_INT_RANGE, GST_GLES_MIN_SIZE,
+                             max_size, NULL);
+  }
+
+#if GST_CHECK_VERSION(1, 0, 0)
+  if (filter) {
+      GstCaps *intersection;
+
+      intersection = gst_caps_intersect_full (filter, caps,
+                                              GST_CAPS_INTERSECT_FIRST);
+      gst_caps_unref (caps);
+      caps = intersection;
+  }
+#endif
+
+  return caps;
+}
+
 /* this function handles the link with other elements */
 static gboolean
 gst_gles_sink_set_caps (GstBaseSink *basesink, GstCaps *caps)
 {
   GstGLESSink *sink = GST_GLES_SINK (basesink);
+  GstGLESThread *thread = &sink->gl_thread;
+  GstGLESFeatures features;
   GstVideoFormat fmt;
   guint display_par_n;
   guint display_par_d;
   gint par_n;
   gint par_d;
+  gint columns;
+  gint rows;
   gint w;
   gint h;
 
@@ -1057,10 +2709,17 @@ gst_gles_sink_set_caps (GstBaseSink *basesink, GstCaps *caps)
 #endif
   g_assert ((fmt == GST_VIDEO_FORMAT_I420));
 
-  sink->video_width = w;
-  sink->video_height = h;
-  GST_VIDEO_SINK_WIDTH (sink) = w;
-  GST_VIDEO_SINK_HEIGHT (sink) = h;
+  /* the limit on the number of tiles can't be expressed in the caps */
+  gl_thread_wait_init (sink);
+  if (gst_gles_display_get_probed_features (sink->backend, &features)) {
+      gl_tile_grid (features.max_texture_size, w, h, &columns, &rows);
+      if (columns * rows > GST_GLES_MAX_TILES) {
+          GST_WARNING_OBJECT (sink, "%dx%d needs %dx%d tiles, at most %d "
+                              "are supported", w, h, columns, rows,
+                              GST_GLES_MAX_TILES);
+          return FALSE;
+      }
+  }
 
   /* calculate actual rendering pixel aspect ratio based on video pixel
    * aspect ratio and display pixel aspect ratio */
@@ -1070,41 +2729,224 @@ gst_gles_sink_set_caps (GstBaseSink *basesink, GstCaps *caps)
 
   gst_video_calculate_display_ratio ((guint*)&sink->par_n,
                                      (guint*)&sink->par_d,
-                                     GST_VIDEO_SINK_WIDTH (sink),
-                                     GST_VIDEO_SINK_HEIGHT (sink),
+                                     w, h,
                                      (guint) par_n, (guint) par_d,
                                      display_par_n, display_par_d);
 
-  sink->video_width = sink->video_width * par_n / par_d;
+  /* the render thread picks the new size up with the next buffer, so
+     frames of the old caps which are still queued are drawn unchanged */
+  g_mutex_lock (&thread->lock);
+  thread->width = w;
+  thread->height = h;
+  thread->video_width = w * par_n / par_d;
+  thread->reconfigure = TRUE;
+  if (!thread->running)
+      gl_apply_caps (sink);
+  g_mutex_unlock (&thread->lock);
 
   return TRUE;
 }
 
+#if GST_CHECK_VERSION(1, 0, 0)
+static gboolean
+gst_gles_sink_propose_allocation (GstBaseSink *basesink, GstQuery *query)
+{
+    /* subtitles and osd are blended on the gpu instead of being burned
+       into the frame by upstream */
+    gst_query_add_allocation_meta (query,
+                                   GST_VIDEO_OVERLAY_COMPOSITION_META_API_TYPE,
+                                   NULL);
+    /* cropping is free, it only reduces what is uploaded */
+    gst_query_add_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE, NULL);
+    return TRUE;
+}
+#endif
+
+#if GST_CHECK_VERSION(1, 10, 0)
+/* image-orientation tag values in the order of GstVideoOrientationMethod */
+static const gchar *gl_orientations[] =
+{
+    "rotate-0",
+    "rotate-90",
+    "rotate-180",
+    "rotate-270",
+    "flip-rotate-0",
+    "flip-rotate-180",
+    "flip-rotate-90",
+    "flip-rotate-270",
+};
+
+/* remembers the orientation of the stream for video-direction=auto */
+static gboolean
+gst_gles_sink_event (GstBaseSink *basesink, GstEvent *event)
+{
+    GstGLESSink *sink = GST_GLES_SINK (basesink);
+    GstTagList *taglist;
+    gchar *orientation;
+    guint i;
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_TAG) {
+        gst_event_parse_tag (event, &taglist);
+        if (gst_tag_list_get_string (taglist, GST_TAG_IMAGE_ORIENTATION,
+                                     &orientation)) {
+            for (i = 0; i < G_N_ELEMENTS (gl_orientations); i++) {
+                if (g_str_equal (orientation, gl_orientations[i]))
+                    break;
+            }
+
+            if (i < G_N_ELEMENTS (gl_orientations)) {
+                GST_DEBUG_OBJECT (sink, "Image orientation %s", orientation);
+                GST_OBJECT_LOCK (sink);
+                sink->tag_direction = i;
+                GST_OBJECT_UNLOCK (sink);
+            } else {
+                GST_WARNING_OBJECT (sink, "Unknown image orientation %s",
+                                    orientation);
+            }
+            g_free (orientation);
+        }
+    }
+
+    return GST_BASE_SINK_CLASS (parent_class)->event (basesink, event);
+}
+#endif
+
+#if GST_CHECK_VERSION(1, 2, 0) && defined(HAVE_WAYLAND)
+static void
+gst_gles_sink_set_context (GstElement *element, GstContext *context)
+{
+    const GstStructure *s;
+    gpointer handle;
+
+    /* an embedding application has to share its wl_display, surfaces
+       of different connections can't be related to each other */
+    if (g_str_equal (gst_context_get_context_type (context),
+                     "GstWaylandDisplayHandleContextType")) {
+        s = gst_context_get_structure (context);
+        if (gst_structure_get (s, "handle", G_TYPE_POINTER, &handle, NULL)) {
+            GST_DEBUG_OBJECT (element, "Using application wl_display %p",
+                              handle);
+            window_wayland_set_display (handle);
+        }
+    }
+
+    GST_ELEMENT_CLASS (parent_class)->set_context (element, context);
+}
+#endif
+
+static void
+gl_send_qos (GstGLESSink *sink, gboolean throttle, gdouble proportion,
+             GstClockTimeDiff diff, GstClockTime running_time)
+{
+    GstEvent *event;
+
+#if GST_CHECK_VERSION(1, 0, 0)
+    event = gst_event_new_qos (throttle ? GST_QOS_TYPE_THROTTLE :
+                               GST_QOS_TYPE_UNDERFLOW, proportion, diff,
+                               running_time);
+#else
+    event = gst_event_new_qos (proportion, diff, running_time);
+#endif
+    gst_pad_push_event (GST_BASE_SINK_PAD (sink), event);
+}
+
+/* keeps a running average of the time it takes to upload, draw and swap
+ * a frame, including the wait for a render thread shared with other
+ * sinks. basesink syncs that much earlier so frames still make it, and
+ * its QoS drops and reports the frames which would be late anyway */
+static void
+gl_update_render_cost (GstGLESSink *sink, GstClockTime cost)
+{
+    GstGLESThread *thread = &sink->gl_thread;
+    GstClockTimeDiff change;
+
+    if (!GST_CLOCK_TIME_IS_VALID (thread->avg_render))
+        thread->avg_render = cost;
+    else
+        thread->avg_render = (7 * thread->avg_render + cost) / 8;
+
+    /* every change makes the pipeline recalculate its latency, so only
+       announce the delay when it changed noticeably */
+    change = GST_CLOCK_DIFF (gst_base_sink_get_render_delay (
+                                 GST_BASE_SINK (sink)), thread->avg_render);
+    if (ABS (change) > GST_MSECOND) {
+        GST_DEBUG_OBJECT (sink, "Render delay %" GST_TIME_FORMAT,
+                          GST_TIME_ARGS (thread->avg_render));
+        gst_base_sink_set_render_delay (GST_BASE_SINK (sink),
+                                        thread->avg_render);
+    }
+}
+
+/* drops frames which follow the last shown one closer than max-fps
+ * allows, the shown frames are kept on a fixed grid so the output rate
+ * does not drift below the limit */
+static gboolean
+gl_frame_is_decimated (GstGLESSink *sink, GstBuffer *buf)
+{
+    GstGLESThread *thread = &sink->gl_thread;
+    GstClockTime timestamp = GST_BUFFER_TIMESTAMP (buf);
+    GstClockTime duration = GST_BUFFER_DURATION (buf);
+    GstClockTime running_time;
+    GstClockTime interval;
+
+    if (!sink->max_fps || !GST_CLOCK_TIME_IS_VALID (timestamp))
+        return FALSE;
+
+    interval = GST_SECOND / sink->max_fps;
+
+    if (!GST_CLOCK_TIME_IS_VALID (thread->next_frame) ||
+        timestamp + interval < thread->next_frame) {
+        /* first frame or the stream jumped back */
+        thread->next_frame = timestamp + interval;
+        return FALSE;
+    } else if (timestamp >= thread->next_frame) {
+        if (timestamp < thread->next_frame + interval)
+            thread->next_frame += interval;
+        else
+            thread->next_frame = timestamp + interval;
+        return FALSE;
+    }
+
+    GST_LOG_OBJECT (sink, "Decimating frame %" GST_TIME_FORMAT,
+                    GST_TIME_ARGS (timestamp));
+
+    /* let upstream skip everything up to the next frame we show, decoders
+       expect the next useful frame at timestamp + 2 * diff + duration */
+    if (GST_CLOCK_TIME_IS_VALID (duration) &&
+        timestamp + duration < thread->next_frame) {
+        running_time = gst_segment_to_running_time (
+                           &GST_BASE_SINK (sink)->segment, GST_FORMAT_TIME,
+                           timestamp);
+        if (GST_CLOCK_TIME_IS_VALID (running_time))
+            gl_send_qos (sink, TRUE, (gdouble) interval / MAX (duration, 1),
+                         (thread->next_frame - timestamp - duration) / 2,
+                         running_time);
+    }
+
+    return TRUE;
+}
+
 static GstFlowReturn
 gst_gles_sink_preroll (GstBaseSink * basesink, GstBuffer * buf)
 {
     GstGLESSink *sink = GST_GLES_SINK (basesink);
     GstGLESThread *thread = &sink->gl_thread;
 
+    gl_thread_wait_init (sink);
+
     if (!thread->running) {
-        /* give the application the opportunity to head in a
-           xwindow id to use as render target */
+        /* without a setup running ahead, e.g. because it failed, give
+           the application the opportunity to head in a xwindow id to
+           use as render target */
+        if (thread->init_state == GST_GLES_INIT_NONE)
 #if GST_CHECK_VERSION(1, 0, 0)
-        gst_video_overlay_prepare_window_handle (GST_VIDEO_OVERLAY (sink));
+            gst_video_overlay_prepare_window_handle (GST_VIDEO_OVERLAY (sink));
 #else
-        gst_x_overlay_prepare_xwindow_id (GST_X_OVERLAY (sink));
+            gst_x_overlay_prepare_xwindow_id (GST_X_OVERLAY (sink));
 #endif
 
-        g_mutex_lock (&thread->render_lock);
-        if (!gl_thread_init (sink)) {
-            g_mutex_unlock (&thread->render_lock);
+        if (!gl_thread_init (sink))
             goto fail;
-        }
-        GST_DEBUG_OBJECT(sink, "Wait for init GL context");
-	if (!thread->running) {
-            g_cond_wait (&thread->render_signal, &thread->render_lock);
-            g_mutex_unlock (&thread->render_lock);
-	}
         GST_DEBUG_OBJECT(sink, "Init completed");
     }
 
@@ -1113,17 +2955,7 @@ gst_gles_sink_preroll (GstBaseSink * basesink, GstBuffer * buf)
         goto done;
     }
 
-    g_mutex_lock (&thread->data_lock);
-    thread->render_done = FALSE;
-    thread->buf = buf;
-    g_cond_signal (&thread->data_signal);
-    g_mutex_unlock (&thread->data_lock);
-
-    if (!thread->render_done) {
-        g_mutex_lock (&thread->render_lock);
-        g_cond_wait (&thread->render_signal, &thread->render_lock);
-        g_mutex_unlock (&thread->render_lock);
-    }
+    gl_thread_render (sink, buf);
 
 done:
     return GST_FLOW_OK;
@@ -1137,30 +2969,41 @@ static GstFlowReturn
 gst_gles_sink_render (GstBaseSink *basesink, GstBuffer *buf)
 {
     GstGLESSink *sink = GST_GLES_SINK (basesink);
-    GstGLESThread *thread = &sink->gl_thread;
+    GstGLESTimeline *timeline = sink->gl_thread.timeline;
+    GstGLESTimelineRecord *record = NULL;
 
     GstClockTime start, stop;
 
     start = gst_util_get_timestamp();
 
+    if (timeline) {
+        record = gst_gles_timeline_begin (timeline);
+        record->pts = GST_BUFFER_TIMESTAMP (buf);
+        record->arrival = start;
+    }
+
     if (sink->dropped < sink->drop_first) {
         sink->dropped++;
+        if (record)
+            record->drop = GST_GLES_TIMELINE_DROP_FIRST;
         goto done;
     }
 
-    g_mutex_lock (&thread->data_lock);
-    thread->render_done = FALSE;
-    thread->buf = buf;
-    g_cond_signal (&thread->data_signal);
-    g_mutex_unlock (&thread->data_lock);
-
-    if (!thread->render_done) {
-        g_mutex_lock (&thread->render_lock);
-        g_cond_wait (&thread->render_signal, &thread->render_lock);
-        g_mutex_unlock (&thread->render_lock);
+    /* don't waste an upload on a frame which won't be shown */
+    if (gl_frame_is_decimated (sink, buf)) {
+        if (record)
+            record->drop = GST_GLES_TIMELINE_DROP_DECIMATED;
+        goto done;
     }
 
+    gl_thread_render (sink, buf);
+    gl_update_render_cost (sink, gst_util_get_timestamp () - start);
+    gl_thread_blend_refreshes (sink);
+
 done:
+    if (timeline)
+        gst_gles_timeline_commit (timeline);
+
     stop = gst_util_get_timestamp();
     GST_DEBUG_OBJECT (basesink, "Render took %llu ms",
                         stop/GST_MSECOND - start/GST_MSECOND);
@@ -1174,6 +3017,11 @@ gst_gles_sink_finalize (GObject *gobject)
     GstGLESSink *plugin = (GstGLESSink *)gobject;
 
     gl_thread_stop (plugin);
+    if (plugin->gl_thread.timeline)
+        gst_gles_timeline_close (plugin->gl_thread.timeline);
+    g_array_free (plugin->gl_thread.gles.overlays, TRUE);
+    g_list_free_full (plugin->channels, g_object_unref);
+    g_cond_clear (&plugin->gl_thread.init_cond);
 }
 
 /* Overlay Interface implementation */
@@ -1186,17 +3034,58 @@ gst_gles_xoverlay_set_window_handle (GstXOverlay *overlay, guintptr handle)
 #endif
 {
     GstGLESSink *sink = GST_GLES_SINK (overlay);
+    GstGLESThread *thread = &sink->gl_thread;
+    GstGLESWindowChange change = { sink, handle, };
 
-    /* if we have not created a window yet, we'll use the application
-      provided one. runtime switching is not yet supported */
-    GST_DEBUG_OBJECT (sink, "Setting window handle");
-    if (sink->x11.window == 0) {
-        GST_DEBUG_OBJECT (sink, "register new window id: %d", handle);
+    GST_DEBUG_OBJECT (sink, "Setting window handle %" G_GUINTPTR_FORMAT,
+                      handle);
+
+    /* before the first frame the handle is just picked up by the setup,
+       afterwards the render thread switches over between two frames */
+    gl_thread_wait_init (sink);
+    g_mutex_lock (&thread->lock);
+    if (!thread->running) {
         sink->x11.window = handle;
-        sink->x11.external_window = TRUE;
-    } else {
-        GST_ERROR_OBJECT (sink, "Changing window handle is not yet supported.");
+        sink->x11.external_window = handle != 0;
+    } else if (handle != sink->x11.window) {
+        gst_gles_render_thread_invoke (thread->render, gl_set_window_job,
+                                       &change);
     }
+    g_mutex_unlock (&thread->lock);
+}
+
+#if GST_CHECK_VERSION(1, 0, 0)
+static void
+gst_gles_video_overlay_set_render_rectangle (GstVideoOverlay *overlay,
+                                             gint x, gint y, gint width,
+                                             gint height)
+#else
+static void
+gst_gles_xoverlay_set_render_rectangle (GstXOverlay *overlay, gint x, gint y,
+                                        gint width, gint height)
+#endif
+{
+    GstGLESSink *sink = GST_GLES_SINK (overlay);
+    GstGLESThread *thread = &sink->gl_thread;
+    GstGLESWindowChange change = { sink, 0, };
+
+    GST_DEBUG_OBJECT (sink, "Render rectangle %d,%d %dx%d", x, y, width,
+                      height);
+
+    /* -1 for width and height resets to the whole window */
+    change.rect.x = x;
+    change.rect.y = y;
+    change.rect.w = MAX (width, 0);
+    change.rect.h = MAX (height, 0);
+
+    gl_thread_wait_init (sink);
+    g_mutex_lock (&thread->lock);
+    if (thread->running)
+        gst_gles_render_thread_invoke (thread->render,
+                                       gl_set_render_rect_job, &change);
+    else
+        sink->render_rect = change.rect;
+    g_mutex_unlock (&thread->lock);
 }
 
 #if GST_CHECK_VERSION(1, 0, 0)
@@ -1204,12 +3093,89 @@ static void
 gst_gles_video_overlay_init (GstVideoOverlayInterface * iface)
 {
     iface->set_window_handle = gst_gles_video_overlay_set_handle;
+    iface->set_render_rectangle = gst_gles_video_overlay_set_render_rectangle;
+}
+
+/* Color Balance Interface implementation */
+static guint
+gst_gles_color_balance_index (GstColorBalanceChannel *channel)
+{
+    guint i;
+
+    for (i = 0; i < GST_GLES_BALANCE_COUNT; i++) {
+        if (g_str_equal (channel->label, gl_balance_labels[i]))
+            break;
+    }
+
+    return i;
+}
+
+static const GList *
+gst_gles_color_balance_list_channels (GstColorBalance *balance)
+{
+    return GST_GLES_SINK (balance)->channels;
+}
+
+static void
+gst_gles_color_balance_set_value (GstColorBalance *balance,
+                                  GstColorBalanceChannel *channel,
+                                  gint value)
+{
+    GstGLESSink *sink = GST_GLES_SINK (balance);
+    guint index = gst_gles_color_balance_index (channel);
+
+    g_return_if_fail (index < GST_GLES_BALANCE_COUNT);
+
+    gl_set_balance (sink, index, value);
+}
+
+static gint
+gst_gles_color_balance_get_value (GstColorBalance *balance,
+                                  GstColorBalanceChannel *channel)
+{
+    GstGLESSink *sink = GST_GLES_SINK (balance);
+    guint index = gst_gles_color_balance_index (channel);
+    gint value;
+
+    g_return_val_if_fail (index < GST_GLES_BALANCE_COUNT, 0);
+
+    GST_OBJECT_LOCK (sink);
+    value = sink->balance[index];
+    GST_OBJECT_UNLOCK (sink);
+
+    return value;
 }
+
+/* applied as part of the colour conversion, so it is free */
+static GstColorBalanceType
+gst_gles_color_balance_get_balance_type (GstColorBalance *balance)
+{
+    return GST_COLOR_BALANCE_HARDWARE;
+}
+
+static void
+gst_gles_color_balance_init (GstColorBalanceInterface * iface)
+{
+    iface->list_channels = gst_gles_color_balance_list_channels;
+    iface->set_value = gst_gles_color_balance_set_value;
+    iface->get_value = gst_gles_color_balance_get_value;
+    iface->get_balance_type = gst_gles_color_balance_get_balance_type;
+}
+
+#if GST_CHECK_VERSION(1, 10, 0)
+/* video-direction is all there is to the interface */
+static void
+gst_gles_video_direction_init (GstVideoDirectionInterface * iface)
+{
+}
+#endif
 #else
 static void
 gst_gles_xoverlay_interface_init (GstXOverlayClass *overlay_klass)
 {
     overlay_klass->set_window_handle = gst_gles_xoverlay_set_window_handle;
+    overlay_klass->set_render_rectangle =
+        gst_gles_xoverlay_set_render_rectangle;
 }
 #endif
 
@@ -1224,50 +3190,3 @@ gst_gles_xoverlay_supported (GstGLESSink *sink,
     return TRUE;
 }
 #endif
-
-/* entry point to initialize the plug-in
- * initialize the plug-in itself
- * register the element factories and other features
- */
-static gboolean
-plugin_init (GstPlugin * plugin)
-{
-  /* debug category for fltering log messages
-   *
-   * exchange the string 'Template plugin' with your description
-   */
-  GST_DEBUG_CATEGORY_INIT (gst_gles_sink_debug, "glesplugin",
-      0, "OpenGL ES 2.0 plugin");
-
-  return gst_element_register (plugin, "glessink", GST_RANK_NONE,
-      GST_TYPE_GLES_SINK);
-}
-
-/* PACKAGE: this is usually set by autotools depending on some _INIT macro
- * in configure.ac and then written into and defined in config.h, but we can
- * just set it ourselves here in case someone doesn't use autotools to
- * compile this code. GST_PLUGIN_DEFINE needs PACKAGE to be defined.
- */
-#ifndef PACKAGE
-#define PACKAGE "glesplugin"
-#endif
-
-/* gstreamer looks for this structure to register plugins
- *
- * exchange the string 'Template plugin' with your plugin description
- */
-GST_PLUGIN_DEFINE (
-    GST_VERSION_MAJOR,
-    GST_VERSION_MINOR,
-#if GST_CHECK_VERSION(1, 0, 0)
-    glesplugin,
-#else
-    "glesplugin",
-#endif
-    "Open GL ES 2.0 plugin",
-    plugin_init,
-    VERSION,
-    "LGPL",
-    "Avionic Design",
-    "http://avionic-design.de/"
-)
@@ -25,14 +25,16 @@
 #define _GST_GLES_SINK_H__
 
 #include <GLES2/gl2.h>
-#include <EGL/egl.h>
-
-#include <X11/Xlib.h>
 
 #include <gst/gst.h>
 #include <gst/video/gstvideosink.h>
+#include <gst/video/video.h>
 
+#include "display.h"
 #include "shader.h"
+#include "render.h"
+#include "timeline.h"
+#include "window.h"
 
 GST_DEBUG_CATEGORY_EXTERN (gst_gles_sink_debug);
 #define GST_CAT_DEFAULT gst_gles_sink_debug
@@ -54,64 +56,205 @@ G_BEGIN_DECLS
 typedef struct _GstGLESSink        GstGLESSink;
 typedef struct _GstGLESSinkClass   GstGLESSinkClass;
 
-typedef struct _GstGLESWindow      GstGLESWindow;
 typedef struct _GstGLESContext     GstGLESContext;
-typedef struct _GstGLESThread      GstGLESThread;
 
-struct _GstGLESWindow
+/* colour balance channels, in the order of their properties */
+enum
 {
-    /* thread context */
-    GThread *thread;
-    volatile gboolean running;
+  GST_GLES_BALANCE_BRIGHTNESS,
+  GST_GLES_BALANCE_CONTRAST,
+  GST_GLES_BALANCE_HUE,
+  GST_GLES_BALANCE_SATURATION,
+  GST_GLES_BALANCE_COUNT
+};
 
-    gint width;
-    gint height;
+typedef struct _GstGLESThread      GstGLESThread;
+typedef struct _GstGLESOverlay     GstGLESOverlay;
+typedef struct _GstGLESTile        GstGLESTile;
+typedef struct _GstGLESPresentStats GstGLESPresentStats;
+typedef struct _GstGLESSnapshot    GstGLESSnapshot;
 
-    /* x11 context */
-    Display *display;
-    Window window;
-    gboolean external_window;
+/* cached texture of a single overlay composition rectangle */
+struct _GstGLESOverlay
+{
+    guint seqnum;
+    GLuint tex;
+
+    /* render rectangle in video coordinates */
+    gint x;
+    gint y;
+    guint width;
+    guint height;
+    gfloat alpha;
 };
 
-struct _GstGLESContext
+/* frames larger than the maximum texture size are split into tiles, caps
+ * needing more are rejected. neighbours share a few pixels so filtering
+ * has no seams */
+#define GST_GLES_MAX_TILES 64
+#define GST_GLES_TILE_OVERLAP 4
+
+struct _GstGLESTile
 {
-    gboolean initialized;
+    /* uploads the area and the overlap with the neighbouring tiles */
+    GstGLESStream stream;
+    /* part of the visible picture shown by this tile, in frame pixels */
+    GstGLESCrop area;
+    /* rgb picture of the previous frame for frame blending, it changes
+       places with the texture of the stream with every frame */
+    GstGLESTexture previous;
+};
 
-    /* egl context */
-    EGLDisplay display;
-    EGLSurface surface;
-    EGLContext context;
+/* frames further apart are not blended, e.g. after a gap in the stream */
+#define GST_GLES_BLEND_MAX_INTERVAL (100 * GST_MSECOND)
+/* refreshes drawn for a single frame at most */
+#define GST_GLES_BLEND_MAX_REFRESHES 4
 
+struct _GstGLESContext
+{
     /* shader programs */
     GstGLESShader deinterlace;
     GstGLESShader scale;
+    GstGLESShader overlay;
+    GstGLESShader blend;
+
+    /* input textures and framebuffer objects, one per tile */
+    GstGLESTile tiles[GST_GLES_MAX_TILES];
+    guint n_tiles;
+
+    /* overlay composition rectangles, blended after scaling */
+    GArray *overlays;
+    GLint overlay_tex_loc;
+    GLint overlay_alpha_loc;
+    gboolean overlay_failed;
+
+    /* the current frame over the previous one with frame blending */
+    GLint blend_tex_loc;
+    GLint blend_alpha_loc;
+    gboolean blend_failed;
+
+    /* packs snapshots into I420 */
+    GstGLESShader snapshot_i420;
+    GLint snapshot_tex_loc;
+    GLint snapshot_size_loc;
+    gboolean snapshot_failed;
+};
 
-    /* textures for yuv input planes */
-    GstGLESTexture y_tex;
-    GstGLESTexture u_tex;
-    GstGLESTexture v_tex;
-
-    GstGLESTexture rgb_tex;
+/* a snapshot is requested from any thread with the object lock held and
+ * taken after the swap of the next frame. with GLES3 it is read into a
+ * pack buffer and picked up once the fence signalled, usually with the
+ * frame after. the streaming thread hands out the result */
+struct _GstGLESSnapshot
+{
+    /* request, sizes of 0 take the size shown on screen */
+    gboolean requested;
+    gint request_width;
+    gint request_height;
+    gboolean request_i420;
+
+    /* readback in flight, only touched on the render thread */
+    gboolean pending;
+    gint width;
+    gint height;
+    gboolean i420;
+    GstClockTime timestamp;
+    GLuint pbo;
+    gsize pbo_size;
+    gpointer fence;
+
+    /* finished snapshot, protected by the object lock */
+#if GST_CHECK_VERSION(1, 0, 0)
+    GstSample *result;
+#else
+    GstBuffer *result;
+#endif
+};
 
-    /* framebuffer object */
-    GLuint framebuffer;
+/* the last swapped frame and the delays aggregated for the next
+ * presentation message */
+struct _GstGLESPresentStats
+{
+    GstClockTime running_time;
+    GstClockTime swap_time;
+    GstClockTime last_presented;
+
+    guint count;
+    GstClockTimeDiff sum;
+    GstClockTimeDiff min;
+    GstClockTimeDiff max;
 };
 
+/* progress of the context setup started in start() */
+typedef enum
+{
+  GST_GLES_INIT_NONE,
+  GST_GLES_INIT_PENDING,
+  GST_GLES_INIT_READY,
+  GST_GLES_INIT_FAILED
+} GstGLESInitState;
+
 struct _GstGLESThread
 {
-    /* thread context */
-    GThread *handle;
-    GCond render_signal;
-    GCond data_signal;
-    GMutex render_lock;
-    GMutex data_lock;
-    volatile gboolean render_done;
+    /* shared display and the pooled thread rendering for us */
+    GstGLESDisplay *display;
+    GstGLESRenderThread *render;
     volatile gboolean running;
+    /* serializes teardown against calls from the application */
+    GMutex lock;
+
+    /* setup running ahead of the first frame, init_cond is signalled
+       with lock held once it left the pending state */
+    GstGLESInitState init_state;
+    GCond init_cond;
+    /* duration of the setup and how long the first frame waited for it */
+    GstClockTime init_time;
+    GstClockTime init_wait;
 
     GstGLESContext gles;
+    /* GPU memory of the streams, the budget is taken over from
+       max-gpu-memory with every frame. over_budget is set while frames
+       are dropped because of it */
+    GstGLESMemory memory;
+    gboolean over_budget;
+
+    /* size of the latest caps, taken over with their first buffer */
+    gboolean reconfigure;
+    gint width;
+    gint height;
+    gint video_width;
+
+    /* visible part of the frame being drawn, taken from the crop
+       properties and meta once per frame */
+    GstGLESCrop crop;
+
+    /* frame blending: running time of the last frame and the distance
+       to the one before, GST_CLOCK_TIME_NONE while it can't be blended.
+       blend_weight is the share of the current frame in the next draw.
+       blend_swap is the clock running time the last swap returned,
+       refresh_period the measured time between two vblanks and
+       blend_drawn tells if the last refresh job got to draw */
+    GstClockTime blend_running;
+    GstClockTime blend_interval;
+    gfloat blend_weight;
+    GstClockTime blend_swap;
+    GstClockTime refresh_period;
+    gboolean blend_drawn;
+
+    /* running average of upload, draw and swap of a frame */
+    GstClockTime avg_render;
+    /* earliest timestamp shown next with max-fps */
+    GstClockTime next_frame;
+
+    GstGLESPresentStats present;
+
+    /* per frame timing for external monitoring, may be NULL */
+    GstGLESTimeline *timeline;
+
+    GstGLESSnapshot snapshot;
 
     /* render data */
     GstBuffer *buf;
+    GstClockTime last_timestamp;
 };
 
 struct _GstGLESSink
@@ -127,6 +270,16 @@ struct _GstGLESSink
   gint video_width;
   gint video_height;
 
+  /* area of the window the video is scaled into, in window coordinates,
+     the whole window is used while the size is 0 */
+  GstVideoRectangle render_rect;
+
+  /* GstVideoOrientationMethod of video-direction and the one of the last
+     image-orientation tag, which is used for auto. both stay at identity
+     before GStreamer 1.10 */
+  guint direction;
+  guint tag_direction;
+
   /* properties */
   guint crop_top;
   guint crop_bottom;
@@ -137,11 +290,29 @@ struct _GstGLESSink
 
   guint drop_first;
   guint dropped;
+
+  GstGLESWindowBackendType backend;
+  gboolean persistent;
+  gboolean close_driver_fds;
+  guint64 max_gpu_memory;
+  gboolean frame_blending;
+  guint max_fps;
+  gboolean timeline;
+  guint present_interval;
+
+  /* colour balance values from -1000 to 1000, applied with the next
+     frame. channels holds the GstColorBalanceChannels on 1.0 */
+  gint balance[GST_GLES_BALANCE_COUNT];
+  GList *channels;
 };
 
 struct _GstGLESSinkClass
 {
   GstVideoSinkClass basesinkclass;
+
+  /* actions */
+  gboolean (*snapshot) (GstGLESSink *sink, gint width, gint height,
+                        const gchar *format);
 };
 
 GType gst_gles_sink_get_type (void);
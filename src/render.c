@@ -0,0 +1,1079 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+
+#define GST_USE_UNSTABLE_API
+#include <gst/gst.h>
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include "render.h"
+
+GST_DEBUG_CATEGORY_EXTERN (gst_gles_sink_debug);
+#define GST_CAT_DEFAULT gst_gles_sink_debug
+
+/* GLES 3.0 and EXT_buffer_storage tokens, not in the GLES2 headers */
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER        0x88EC
+#endif
+#ifndef GL_RED
+#define GL_RED                        0x1903
+#endif
+#ifndef GL_R8
+#define GL_R8                         0x8229
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT              0x0002
+#endif
+#ifndef GL_MAP_INVALIDATE_BUFFER_BIT
+#define GL_MAP_INVALIDATE_BUFFER_BIT  0x0008
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT_EXT
+#define GL_MAP_PERSISTENT_BIT_EXT     0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT_EXT
+#define GL_MAP_COHERENT_BIT_EXT       0x0080
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT    0x00000001
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW                0x88E0
+#endif
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH          0x0CF2
+#endif
+#ifndef GL_UNPACK_SKIP_PIXELS
+#define GL_UNPACK_SKIP_PIXELS         0x0CF4
+#endif
+
+void
+gl_probe_features (GstElement *element, GstGLESFeatures *features,
+                   gint gles_version)
+{
+    const gchar *extensions;
+    const gchar *egl_extensions;
+
+    memset (features, 0, sizeof (GstGLESFeatures));
+    features->probed = TRUE;
+
+    glGetIntegerv (GL_MAX_TEXTURE_SIZE, &features->max_texture_size);
+    GST_DEBUG_OBJECT (element, "Maximum texture size %d",
+                      features->max_texture_size);
+
+    /* let the driver pick the number of compiler threads */
+    extensions = (const gchar *) glGetString (GL_EXTENSIONS);
+    if (extensions && strstr (extensions, "GL_KHR_parallel_shader_compile")) {
+        GstGLESMaxShaderCompilerThreadsFunc MaxShaderCompilerThreads =
+                (GstGLESMaxShaderCompilerThreadsFunc)
+                eglGetProcAddress ("glMaxShaderCompilerThreadsKHR");
+
+        if (MaxShaderCompilerThreads) {
+            MaxShaderCompilerThreads (0xffffffff);
+            features->parallel_compile = TRUE;
+            GST_DEBUG_OBJECT (element, "Parallel shader compiles");
+        }
+    }
+
+    if (extensions) {
+        features->texture_rg = strstr (extensions, "GL_EXT_texture_rg") != NULL;
+        features->half_float =
+                strstr (extensions, "GL_OES_texture_half_float") != NULL;
+        features->image_external =
+                strstr (extensions, "GL_OES_EGL_image_external") != NULL;
+        features->binary_shaders =
+                strstr (extensions, "GL_NV_platform_binary") != NULL;
+    }
+    egl_extensions = eglQueryString (eglGetCurrentDisplay (), EGL_EXTENSIONS);
+    features->dmabuf_import = egl_extensions &&
+            strstr (egl_extensions, "EGL_EXT_image_dma_buf_import") != NULL;
+    GST_DEBUG_OBJECT (element, "RG textures %d, half float %d, external "
+                      "images %d, dma-buf import %d, binary shaders %d",
+                      features->texture_rg, features->half_float,
+                      features->image_external, features->dmabuf_import,
+                      features->binary_shaders);
+
+    /* GLES 3.0 has the first two in core */
+    if (gles_version < 3)
+        return;
+
+    features->texture_rg = TRUE;
+    features->half_float = TRUE;
+    features->TexStorage2D = (GstGLESTexStorage2DFunc)
+            eglGetProcAddress ("glTexStorage2D");
+    features->MapBufferRange = (GstGLESMapBufferRangeFunc)
+            eglGetProcAddress ("glMapBufferRange");
+    features->UnmapBuffer = (GstGLESUnmapBufferFunc)
+            eglGetProcAddress ("glUnmapBuffer");
+    features->FenceSync = (GstGLESFenceSyncFunc)
+            eglGetProcAddress ("glFenceSync");
+    features->ClientWaitSync = (GstGLESClientWaitSyncFunc)
+            eglGetProcAddress ("glClientWaitSync");
+    features->DeleteSync = (GstGLESDeleteSyncFunc)
+            eglGetProcAddress ("glDeleteSync");
+
+    features->gles3 = features->TexStorage2D && features->MapBufferRange &&
+                      features->UnmapBuffer && features->FenceSync &&
+                      features->ClientWaitSync && features->DeleteSync;
+    if (!features->gles3)
+        return;
+
+    if (extensions && strstr (extensions, "GL_EXT_buffer_storage")) {
+        features->BufferStorage = (GstGLESBufferStorageFunc)
+                eglGetProcAddress ("glBufferStorageEXT");
+        features->buffer_storage = features->BufferStorage != NULL;
+    }
+
+    GST_DEBUG_OBJECT (element, "GLES3 upload path, %s buffers",
+                      features->buffer_storage ? "persistent" : "mapped");
+}
+
+/* OpenGL ES 2.0 implementation */
+GLuint
+gl_create_texture(GLuint tex_filter)
+{
+    GLuint tex_id = 0;
+
+    glGenTextures (1, &tex_id);
+    glBindTexture (GL_TEXTURE_2D, tex_id);
+
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, tex_filter);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, tex_filter);
+
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    return tex_id;
+}
+
+static gsize
+gl_texture_size (GLenum format, gint width, gint height)
+{
+    gint bpp = format == GL_RGBA ? 4 : format == GL_RGB ? 3 : 1;
+
+    return (gsize) width * height * bpp;
+}
+
+static void
+gl_texture_free (gpointer data)
+{
+    g_slice_free (GstGLESTexture, data);
+}
+
+static gboolean
+gl_memory_fits (GstGLESMemory *memory, gsize size)
+{
+    return !memory || !memory->budget ||
+           memory->allocated + size <= memory->budget;
+}
+
+void
+gl_memory_charge (GstGLESTexturePool *pool, GstGLESMemory *memory,
+                  gsize size)
+{
+    if (memory)
+        memory->allocated += size;
+
+    if (pool) {
+        g_mutex_lock (&pool->lock);
+        pool->allocated += size;
+        g_mutex_unlock (&pool->lock);
+    }
+}
+
+void
+gl_memory_uncharge (GstGLESTexturePool *pool, GstGLESMemory *memory,
+                    gsize size)
+{
+    if (memory)
+        memory->allocated -= size;
+
+    if (pool) {
+        g_mutex_lock (&pool->lock);
+        pool->allocated -= size;
+        g_mutex_unlock (&pool->lock);
+    }
+}
+
+void
+gl_texture_pool_init (GstGLESTexturePool *pool)
+{
+    g_mutex_init (&pool->lock);
+    pool->free = NULL;
+    pool->allocated = 0;
+    pool->cached = 0;
+}
+
+void
+gl_texture_pool_clear (GstGLESTexturePool *pool)
+{
+    g_list_free_full (pool->free, gl_texture_free);
+    pool->free = NULL;
+    g_mutex_clear (&pool->lock);
+}
+
+GstGLESAllocResult
+gl_texture_pool_acquire (GstGLESTexturePool *pool, GstGLESMemory *memory,
+                         GstGLESTexture *tex, GLenum format, gint width,
+                         gint height, GLuint filter,
+                         const GstGLESFeatures *features)
+{
+    gsize size = gl_texture_size (format, width, height);
+    GstGLESTexture *cached = NULL;
+    GLenum error;
+    GList *l;
+
+    if (!gl_memory_fits (memory, size))
+        return GST_GLES_ALLOC_NO_BUDGET;
+
+    if (pool) {
+        g_mutex_lock (&pool->lock);
+        for (l = pool->free; l; l = l->next) {
+            GstGLESTexture *free_tex = l->data;
+
+            if (free_tex->format == format && free_tex->width == width &&
+                free_tex->height == height) {
+                cached = free_tex;
+                pool->free = g_list_delete_link (pool->free, l);
+                pool->cached -= size;
+                break;
+            }
+        }
+        g_mutex_unlock (&pool->lock);
+    }
+
+    if (cached) {
+        tex->id = cached->id;
+        gl_texture_free (cached);
+
+        glBindTexture (GL_TEXTURE_2D, tex->id);
+        glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        /* the pool counted it already */
+        if (memory)
+            memory->allocated += size;
+    } else {
+        /* only the error of the allocation itself is of interest */
+        while (glGetError () != GL_NO_ERROR);
+
+        tex->id = gl_create_texture (filter);
+        if (format == GL_R8)
+            features->TexStorage2D (GL_TEXTURE_2D, 1, GL_R8, width, height);
+        else
+            glTexImage2D (GL_TEXTURE_2D, 0, format, width, height, 0,
+                          format, GL_UNSIGNED_BYTE, NULL);
+
+        error = glGetError ();
+        if (error != GL_NO_ERROR) {
+            GST_ERROR ("Could not allocate %dx%d texture: 0x%x", width,
+                       height, error);
+            glDeleteTextures (1, &tex->id);
+            tex->id = 0;
+            return GST_GLES_ALLOC_FAILED;
+        }
+        gl_memory_charge (pool, memory, size);
+    }
+
+    tex->format = format;
+    tex->width = width;
+    tex->height = height;
+
+    return GST_GLES_ALLOC_OK;
+}
+
+void
+gl_texture_pool_release (GstGLESTexturePool *pool, GstGLESMemory *memory,
+                         GstGLESTexture *tex)
+{
+    gsize size = gl_texture_size (tex->format, tex->width, tex->height);
+
+    if (!tex->id)
+        return;
+
+    if (memory)
+        memory->allocated -= size;
+
+    if (pool) {
+        g_mutex_lock (&pool->lock);
+        if (pool->cached + size <= GST_GLES_POOL_MAX_CACHED) {
+            pool->free = g_list_prepend (pool->free,
+                                         g_slice_dup (GstGLESTexture, tex));
+            pool->cached += size;
+            g_mutex_unlock (&pool->lock);
+            tex->id = 0;
+            return;
+        }
+        pool->allocated -= size;
+        g_mutex_unlock (&pool->lock);
+    }
+
+    glDeleteTextures (1, &tex->id);
+    tex->id = 0;
+}
+
+void
+gl_stream_init (GstGLESStream *stream, GstGLESShader *deinterlace,
+                const GstGLESFeatures *features, GstGLESTexturePool *pool,
+                GstGLESMemory *memory)
+{
+    if (features && features->gles3)
+        stream->features = features;
+    if (features)
+        stream->max_texture_size = features->max_texture_size;
+    stream->pool = pool;
+    stream->memory = memory;
+
+    /* the immutable GLES3 planes are allocated with the first upload */
+    if (!stream->features) {
+        stream->y_tex.id = gl_create_texture(GL_NEAREST);
+        stream->u_tex.id = gl_create_texture(GL_NEAREST);
+        stream->v_tex.id = gl_create_texture(GL_NEAREST);
+    }
+
+    stream->y_tex.loc = glGetUniformLocation(deinterlace->program, "s_ytex");
+    stream->u_tex.loc = glGetUniformLocation(deinterlace->program, "s_utex");
+    stream->v_tex.loc = glGetUniformLocation(deinterlace->program, "s_vtex");
+
+    stream->color_matrix_loc = glGetUniformLocation (deinterlace->program,
+                                                     "color_matrix");
+    stream->color_offset_loc = glGetUniformLocation (deinterlace->program,
+                                                     "color_offset");
+    gl_stream_set_balance (stream, 0.0f, 1.0f, 0.0f, 1.0f);
+}
+
+void
+gl_stream_set_balance (GstGLESStream *stream, gfloat brightness,
+                       gfloat contrast, gfloat hue, gfloat saturation)
+{
+    /* BT.601 video range to full range rgb */
+    static const gfloat yuv_to_rgb[3][3] =
+    {
+        { 1.0f,  0.0f,     1.5958f },
+        { 1.0f, -0.39173f, -0.81290f },
+        { 1.0f,  2.017f,   0.0f },
+    };
+    static const gfloat yuv_offset[3] = { 0.0625f, 0.5f, 0.5f };
+    gfloat c = cosf (hue * G_PI) * saturation;
+    gfloat s = sinf (hue * G_PI) * saturation;
+    /* the balance on the centered yuv values: luma is scaled to full
+       range and by the contrast, chroma is rotated by the hue */
+    gfloat balance[3][3] =
+    {
+        { 1.1643f * contrast, 0.0f, 0.0f },
+        { 0.0f,  c, s },
+        { 0.0f, -s, c },
+    };
+    gint row, col, i;
+
+    for (row = 0; row < 3; row++) {
+        gfloat offset = yuv_to_rgb[row][0] * brightness;
+
+        for (col = 0; col < 3; col++) {
+            gfloat value = 0.0f;
+
+            for (i = 0; i < 3; i++)
+                value += yuv_to_rgb[row][i] * balance[i][col];
+
+            stream->color_matrix[col * 3 + row] = value;
+            offset -= value * yuv_offset[col];
+        }
+        stream->color_offset[row] = offset;
+    }
+}
+
+static void
+gl_stream_reset_crop (GstGLESStream *stream)
+{
+    stream->frame_width = stream->width;
+    stream->frame_height = stream->height;
+    stream->crop.x = 0;
+    stream->crop.y = 0;
+    stream->crop.width = stream->width;
+    stream->crop.height = stream->height;
+}
+
+/* takes an rgb texture for the framebuffer from the pool */
+static GstGLESAllocResult
+gl_stream_acquire_rgb (GstElement *element, GstGLESStream *stream,
+                       GstGLESTexture *tex, gint width, gint height)
+{
+    GstGLESAllocResult res;
+
+    res = gl_texture_pool_acquire (stream->pool, stream->memory, tex, GL_RGB,
+                                   width, height, GL_LINEAR,
+                                   stream->features);
+    if (res == GST_GLES_ALLOC_NO_BUDGET)
+        GST_WARNING_OBJECT (element, "%dx%d RGB texture exceeds the GPU "
+                            "memory budget", width, height);
+
+    return res;
+}
+
+/* makes the rgb texture the target of the framebuffer, the driver may
+ * still refuse it, e.g. for its size */
+static GstGLESAllocResult
+gl_stream_attach_rgb (GstElement *element, GstGLESStream *stream)
+{
+    GLenum status;
+
+    glBindFramebuffer (GL_FRAMEBUFFER, stream->framebuffer);
+    glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_TEXTURE_2D, stream->rgb_tex.id, 0);
+
+    status = glCheckFramebufferStatus (GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        GST_ERROR_OBJECT (element, "%dx%d framebuffer incomplete: 0x%x",
+                          stream->rgb_tex.width, stream->rgb_tex.height,
+                          status);
+        return GST_GLES_ALLOC_FAILED;
+    }
+
+    return GST_GLES_ALLOC_OK;
+}
+
+GstGLESAllocResult
+gl_stream_gen_framebuffer (GstElement *element, GstGLESStream *stream,
+                           gint width, gint height)
+{
+    GstGLESAllocResult res;
+
+    res = gl_stream_acquire_rgb (element, stream, &stream->rgb_tex, width,
+                                 height);
+    if (res != GST_GLES_ALLOC_OK)
+        return res;
+
+    glGenFramebuffers (1, &stream->framebuffer);
+    res = gl_stream_attach_rgb (element, stream);
+    if (res != GST_GLES_ALLOC_OK)
+        return res;
+
+    stream->width = width;
+    stream->height = height;
+    gl_stream_reset_crop (stream);
+    stream->initialized = TRUE;
+
+    return GST_GLES_ALLOC_OK;
+}
+
+GstGLESAllocResult
+gl_stream_resize (GstElement *element, GstGLESStream *stream, gint width,
+                  gint height)
+{
+    GstGLESAllocResult res;
+
+    if (stream->width == width && stream->height == height &&
+        stream->rgb_tex.id)
+        return GST_GLES_ALLOC_OK;
+
+    GST_DEBUG_OBJECT (element, "Resize stream from %dx%d to %dx%d",
+                      stream->width, stream->height, width, height);
+
+    /* a texture of the new size may be waiting in the pool, the old
+       one must not stay attached once it is handed back */
+    glBindFramebuffer (GL_FRAMEBUFFER, stream->framebuffer);
+    glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_TEXTURE_2D, 0, 0);
+    gl_texture_pool_release (stream->pool, stream->memory, &stream->rgb_tex);
+    res = gl_stream_acquire_rgb (element, stream, &stream->rgb_tex, width,
+                                 height);
+    if (res != GST_GLES_ALLOC_OK)
+        return res;
+
+    res = gl_stream_attach_rgb (element, stream);
+    if (res != GST_GLES_ALLOC_OK)
+        return res;
+
+    stream->width = width;
+    stream->height = height;
+    gl_stream_reset_crop (stream);
+
+    return GST_GLES_ALLOC_OK;
+}
+
+GstGLESAllocResult
+gl_stream_swap_texture (GstElement *element, GstGLESStream *stream,
+                        GstGLESTexture *tex)
+{
+    GstGLESAllocResult res;
+    GLuint id;
+
+    if (tex->id && (tex->width != stream->width ||
+                    tex->height != stream->height))
+        gl_texture_pool_release (stream->pool, stream->memory, tex);
+    if (!tex->id) {
+        res = gl_stream_acquire_rgb (element, stream, tex, stream->width,
+                                     stream->height);
+        if (res != GST_GLES_ALLOC_OK)
+            return res;
+    }
+
+    /* both have the same storage, only the names change places */
+    id = tex->id;
+    tex->id = stream->rgb_tex.id;
+    stream->rgb_tex.id = id;
+
+    glBindFramebuffer (GL_FRAMEBUFFER, stream->framebuffer);
+    glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_TEXTURE_2D, stream->rgb_tex.id, 0);
+
+    return GST_GLES_ALLOC_OK;
+}
+
+void
+gl_stream_set_crop (GstGLESStream *stream, gint frame_width,
+                    gint frame_height, const GstGLESCrop *crop)
+{
+    stream->frame_width = frame_width;
+    stream->frame_height = frame_height;
+    stream->crop = *crop;
+}
+
+static void
+gl_stream_delete_pbos (GstGLESStream *stream)
+{
+    guint i;
+
+    for (i = 0; i < GST_GLES_STREAM_PBOS; i++) {
+        if (stream->pbo_fence[i])
+            stream->features->DeleteSync (stream->pbo_fence[i]);
+        stream->pbo_fence[i] = NULL;
+        stream->pbo_data[i] = NULL;
+    }
+    stream->pbo_filled = FALSE;
+
+    /* deleting a buffer also ends its persistent mapping */
+    if (stream->pbo[0])
+        glDeleteBuffers (GST_GLES_STREAM_PBOS, stream->pbo);
+    memset (stream->pbo, 0, sizeof (stream->pbo));
+    gl_memory_uncharge (stream->pool, stream->memory,
+                        GST_GLES_STREAM_PBOS * stream->pbo_size);
+    stream->pbo_size = 0;
+}
+
+static void
+gl_stream_delete_planes (GstGLESStream *stream)
+{
+    GstGLESTexture *planes[] = {
+        &stream->y_tex, &stream->u_tex, &stream->v_tex
+    };
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (planes); i++) {
+        if (stream->features) {
+            gl_texture_pool_release (stream->pool, stream->memory,
+                                     planes[i]);
+        } else {
+            gl_memory_uncharge (stream->pool, stream->memory,
+                                gl_texture_size (planes[i]->format,
+                                                 planes[i]->width,
+                                                 planes[i]->height));
+            glDeleteTextures (1, &planes[i]->id);
+        }
+    }
+}
+
+void
+gl_stream_delete (GstGLESStream *stream)
+{
+    if (stream->framebuffer)
+        glDeleteFramebuffers (1, &stream->framebuffer);
+    gl_texture_pool_release (stream->pool, stream->memory, &stream->rgb_tex);
+    gl_stream_delete_planes (stream);
+    if (stream->features)
+        gl_stream_delete_pbos (stream);
+    g_free (stream->pack);
+
+    memset (stream, 0, sizeof (GstGLESStream));
+}
+
+/* immutable textures can't be resized, they are replaced instead */
+static gboolean
+gl_stream_alloc_planes (GstGLESStream *stream)
+{
+    GstGLESTexture *planes[] = {
+        &stream->y_tex, &stream->u_tex, &stream->v_tex
+    };
+    guint i;
+
+    gl_stream_delete_planes (stream);
+    stream->plane_width = 0;
+    stream->plane_height = 0;
+
+    for (i = 0; i < G_N_ELEMENTS (planes); i++) {
+        gint div = i ? 2 : 1;
+
+        if (gl_texture_pool_acquire (stream->pool, stream->memory,
+                                     planes[i], GL_R8, stream->width / div,
+                                     stream->height / div, GL_NEAREST,
+                                     stream->features) != GST_GLES_ALLOC_OK) {
+            gl_stream_delete_planes (stream);
+            return FALSE;
+        }
+    }
+
+    stream->plane_width = stream->width;
+    stream->plane_height = stream->height;
+    return TRUE;
+}
+
+/* GLES2 planes are specified anew with every upload, only their size is
+ * tracked for the accounting */
+static void
+gl_stream_track_plane (GstGLESStream *stream, GstGLESTexture *tex,
+                       gint width, gint height)
+{
+    if (tex->width == width && tex->height == height)
+        return;
+
+    /* the budget is not checked, the upload can't be left out */
+    gl_memory_uncharge (stream->pool, stream->memory,
+                        gl_texture_size (tex->format, tex->width,
+                                         tex->height));
+    gl_memory_charge (stream->pool, stream->memory,
+                      gl_texture_size (GL_LUMINANCE, width, height));
+
+    tex->format = GL_LUMINANCE;
+    tex->width = width;
+    tex->height = height;
+}
+
+static gboolean
+gl_stream_alloc_pbos (GstGLESStream *stream, gsize size)
+{
+    const GstGLESFeatures *gl = stream->features;
+    const GLbitfield persistent = GL_MAP_WRITE_BIT |
+                                  GL_MAP_PERSISTENT_BIT_EXT |
+                                  GL_MAP_COHERENT_BIT_EXT;
+    guint i;
+
+    gl_stream_delete_pbos (stream);
+    if (!gl_memory_fits (stream->memory, GST_GLES_STREAM_PBOS * size))
+        return FALSE;
+    gl_memory_charge (stream->pool, stream->memory,
+                      GST_GLES_STREAM_PBOS * size);
+    glGenBuffers (GST_GLES_STREAM_PBOS, stream->pbo);
+
+    for (i = 0; i < GST_GLES_STREAM_PBOS; i++) {
+        glBindBuffer (GL_PIXEL_UNPACK_BUFFER, stream->pbo[i]);
+        if (gl->buffer_storage) {
+            gl->BufferStorage (GL_PIXEL_UNPACK_BUFFER, size, NULL,
+                               persistent);
+            stream->pbo_data[i] = gl->MapBufferRange (GL_PIXEL_UNPACK_BUFFER,
+                                                      0, size, persistent);
+        } else {
+            glBufferData (GL_PIXEL_UNPACK_BUFFER, size, NULL,
+                          GL_STREAM_DRAW);
+        }
+    }
+    glBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0);
+
+    stream->pbo_size = size;
+    stream->pbo_index = 0;
+    return TRUE;
+}
+
+/* size of the rows of the crop in an unpack buffer, the columns are
+ * skipped by the unpack state */
+static gsize
+gl_stream_pbo_fill_size (GstGLESStream *stream)
+{
+    gint stride = stream->frame_width;
+
+    return stride * stream->crop.height +
+           2 * (stride / 2) * (stream->crop.height / 2);
+}
+
+/* copies the rows of the crop of an I420 frame into dst */
+static void
+gl_stream_copy_rows (GstGLESStream *stream, guint8 *dst, const guint8 *data)
+{
+    const GstGLESCrop *crop = &stream->crop;
+    gint stride = stream->frame_width;
+    gsize y_size = stride * crop->height;
+    gsize c_size = (stride / 2) * (crop->height / 2);
+    gsize frame_y = stride * stream->frame_height;
+    gsize frame_c = (stride / 2) * (stream->frame_height / 2);
+
+    memcpy (dst, data + crop->y * stride, y_size);
+    memcpy (dst + y_size, data + frame_y + (crop->y / 2) * (stride / 2),
+            c_size);
+    memcpy (dst + y_size + c_size,
+            data + frame_y + frame_c + (crop->y / 2) * (stride / 2), c_size);
+}
+
+gboolean
+gl_stream_fill_upload (GstGLESStream *stream, GstBuffer *buf)
+{
+    guint i = stream->pbo_index;
+    gint stride = stream->frame_width;
+    gsize frame_size = stride * stream->frame_height +
+                       2 * (stride / 2) * (stream->frame_height / 2);
+#if GST_CHECK_VERSION(1, 0, 0)
+    GstMapInfo bufmap;
+#endif
+
+    /* only a persistent buffer the gpu is done with can be written
+       without the context */
+    if (!stream->initialized || !stream->pbo_data[i] ||
+        stream->pbo_fence[i] ||
+        stream->pbo_size < gl_stream_pbo_fill_size (stream))
+        return FALSE;
+
+    /* the geometry is the one of the last frame, a buffer which doesn't
+       hold such a frame is left to the upload in the render job */
+#if GST_CHECK_VERSION(1, 0, 0)
+    if (!gst_buffer_map (buf, &bufmap, GST_MAP_READ))
+        return FALSE;
+    if (bufmap.size < frame_size) {
+        gst_buffer_unmap (buf, &bufmap);
+        return FALSE;
+    }
+    gl_stream_copy_rows (stream, stream->pbo_data[i], bufmap.data);
+    gst_buffer_unmap (buf, &bufmap);
+#else
+    if (GST_BUFFER_SIZE (buf) < frame_size)
+        return FALSE;
+    gl_stream_copy_rows (stream, stream->pbo_data[i], GST_BUFFER_DATA (buf));
+#endif
+
+    stream->pbo_filled = TRUE;
+    stream->filled_crop = stream->crop;
+    stream->filled_width = stream->frame_width;
+    stream->filled_height = stream->frame_height;
+    return TRUE;
+}
+
+/* the frame is usually in the next unpack buffer already, otherwise it is
+ * copied in here. the transfer into the plane textures then runs
+ * asynchronously to the render thread */
+static void
+gl_load_texture_pbo (GstElement *element, GstGLESStream *stream,
+                     const guint8 *data)
+{
+    const GstGLESFeatures *gl = stream->features;
+    const GstGLESCrop *crop = &stream->crop;
+    gint stride = stream->frame_width;
+    gsize y_size = stride * crop->height;
+    gsize c_size = (stride / 2) * (crop->height / 2);
+    gsize size = gl_stream_pbo_fill_size (stream);
+    gboolean filled;
+    guint i, next;
+    guint8 *dst;
+
+    if ((stream->plane_width != stream->width ||
+         stream->plane_height != stream->height) &&
+        !gl_stream_alloc_planes (stream)) {
+        GST_WARNING_OBJECT (element, "Could not allocate the planes");
+        return;
+    }
+    if (stream->pbo_size < size && !gl_stream_alloc_pbos (stream, size)) {
+        GST_WARNING_OBJECT (element, "Upload buffers exceed the GPU memory "
+                            "budget");
+        return;
+    }
+
+    /* the crop may have changed with this frame */
+    filled = stream->pbo_filled &&
+             stream->filled_width == stream->frame_width &&
+             stream->filled_height == stream->frame_height &&
+             stream->filled_crop.y == crop->y &&
+             stream->filled_crop.height == crop->height;
+    stream->pbo_filled = FALSE;
+
+    i = stream->pbo_index;
+    next = (i + 1) % GST_GLES_STREAM_PBOS;
+    glBindBuffer (GL_PIXEL_UNPACK_BUFFER, stream->pbo[i]);
+
+    if (stream->pbo_data[i]) {
+        /* the gpu may still read from a persistent buffer */
+        if (stream->pbo_fence[i]) {
+            gl->ClientWaitSync (stream->pbo_fence[i],
+                                GL_SYNC_FLUSH_COMMANDS_BIT, GST_SECOND);
+            gl->DeleteSync (stream->pbo_fence[i]);
+            stream->pbo_fence[i] = NULL;
+        }
+        dst = stream->pbo_data[i];
+    } else {
+        dst = gl->MapBufferRange (GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                  GL_MAP_WRITE_BIT |
+                                  GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+
+    if (G_UNLIKELY (!dst)) {
+        GST_WARNING_OBJECT (element, "Could not map upload buffer");
+        glBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+
+    if (!filled)
+        gl_stream_copy_rows (stream, dst, data);
+    if (!stream->pbo_data[i])
+        gl->UnmapBuffer (GL_PIXEL_UNPACK_BUFFER);
+    stream->pbo_index = next;
+
+    glPixelStorei (GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei (GL_UNPACK_ROW_LENGTH, stride);
+    glPixelStorei (GL_UNPACK_SKIP_PIXELS, crop->x);
+
+    glActiveTexture (GL_TEXTURE0);
+    glBindTexture (GL_TEXTURE_2D, stream->y_tex.id);
+    glTexSubImage2D (GL_TEXTURE_2D, 0, 0, 0, crop->width, crop->height,
+                     GL_RED, GL_UNSIGNED_BYTE, NULL);
+    glUniform1i (stream->y_tex.loc, 0);
+
+    glPixelStorei (GL_UNPACK_ROW_LENGTH, stride / 2);
+    glPixelStorei (GL_UNPACK_SKIP_PIXELS, crop->x / 2);
+
+    glActiveTexture (GL_TEXTURE1);
+    glBindTexture (GL_TEXTURE_2D, stream->u_tex.id);
+    glTexSubImage2D (GL_TEXTURE_2D, 0, 0, 0, crop->width / 2,
+                     crop->height / 2, GL_RED, GL_UNSIGNED_BYTE,
+                     GSIZE_TO_POINTER (y_size));
+    glUniform1i (stream->u_tex.loc, 1);
+
+    glActiveTexture (GL_TEXTURE2);
+    glBindTexture (GL_TEXTURE_2D, stream->v_tex.id);
+    glTexSubImage2D (GL_TEXTURE_2D, 0, 0, 0, crop->width / 2,
+                     crop->height / 2, GL_RED, GL_UNSIGNED_BYTE,
+                     GSIZE_TO_POINTER (y_size + c_size));
+    glUniform1i (stream->v_tex.loc, 2);
+
+    glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei (GL_UNPACK_SKIP_PIXELS, 0);
+    glBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0);
+    stream->uploaded = size;
+
+    if (!stream->pbo_data[i])
+        return;
+
+    stream->pbo_fence[i] = gl->FenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    /* the next buffer was last read two frames ago, once the gpu is done
+       with it the streaming thread can fill in the next frame */
+    if (stream->pbo_fence[next]) {
+        gl->ClientWaitSync (stream->pbo_fence[next],
+                            GL_SYNC_FLUSH_COMMANDS_BIT, GST_SECOND);
+        gl->DeleteSync (stream->pbo_fence[next]);
+        stream->pbo_fence[next] = NULL;
+    }
+}
+
+static gboolean
+gl_stream_packs_crop (GstGLESStream *stream)
+{
+    return stream->max_texture_size > 0 &&
+           stream->frame_width > stream->max_texture_size &&
+           stream->crop.width < stream->frame_width;
+}
+
+/* copies the crop of an I420 frame into a tightly packed one */
+static const guint8 *
+gl_stream_pack_crop (GstGLESStream *stream, const guint8 *data)
+{
+    const GstGLESCrop *crop = &stream->crop;
+    gint stride = stream->frame_width;
+    gsize y_size = crop->width * crop->height;
+    gsize c_size = (crop->width / 2) * (crop->height / 2);
+    const guint8 *src;
+    guint8 *dst;
+    gint plane, row;
+
+    if (stream->pack_size < y_size + 2 * c_size) {
+        g_free (stream->pack);
+        stream->pack_size = y_size + 2 * c_size;
+        stream->pack = g_malloc (stream->pack_size);
+    }
+
+    dst = stream->pack;
+    for (plane = 0; plane < 3; plane++) {
+        gint div = plane ? 2 : 1;
+
+        src = data + (crop->y / div) * (stride / div) + crop->x / div;
+        if (plane > 0)
+            src += stride * stream->frame_height;
+        if (plane > 1)
+            src += (stride / 2) * (stream->frame_height / 2);
+
+        for (row = 0; row < crop->height / div; row++) {
+            memcpy (dst, src, crop->width / div);
+            dst += crop->width / div;
+            src += stride / div;
+        }
+    }
+
+    return stream->pack;
+}
+
+static void
+gl_load_texture (GstElement *element, GstGLESStream *stream, GstBuffer *buf)
+{
+    gint stride, first_row;
+    gsize frame_y, frame_c;
+#if GST_CHECK_VERSION(1, 0, 0)
+    GstMapInfo bufmap;
+    const guint8 *data;
+
+    if (G_UNLIKELY(!gst_buffer_map (buf, &bufmap, GST_MAP_READ))) {
+	GST_WARNING_OBJECT (element, "%s: Failed to map buffer data", __func__);
+	return;
+    }
+
+    data = bufmap.data;
+#else
+    const guint8 *data = GST_BUFFER_DATA (buf);
+#endif
+
+    if (stream->features) {
+        gl_load_texture_pbo (element, stream, data);
+        goto done;
+    }
+
+    /* GLES2 can't skip columns on upload, so only the rows outside of
+       the crop are left out and the columns are cut by the texcoords.
+       rows wider than a texture are packed on the cpu instead */
+    if (gl_stream_packs_crop (stream)) {
+        data = gl_stream_pack_crop (stream, data);
+        stride = stream->crop.width;
+        first_row = 0;
+        frame_y = stride * stream->crop.height;
+        frame_c = (stride / 2) * (stream->crop.height / 2);
+    } else {
+        stride = stream->frame_width;
+        first_row = stream->crop.y;
+        frame_y = stride * stream->frame_height;
+        frame_c = (stride / 2) * (stream->frame_height / 2);
+    }
+
+    gl_stream_track_plane (stream, &stream->y_tex, stride,
+                           stream->crop.height);
+    gl_stream_track_plane (stream, &stream->u_tex, stride / 2,
+                           stream->crop.height / 2);
+    gl_stream_track_plane (stream, &stream->v_tex, stride / 2,
+                           stream->crop.height / 2);
+
+    /* y component */
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture (GL_TEXTURE_2D, stream->y_tex.id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, stride,
+                 stream->crop.height, 0, GL_LUMINANCE,
+                 GL_UNSIGNED_BYTE, data + first_row * stride);
+    glUniform1i (stream->y_tex.loc, 0);
+
+    /* u component */
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture (GL_TEXTURE_2D, stream->u_tex.id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
+                 stride/2,
+                 stream->crop.height/2, 0, GL_LUMINANCE,
+                 GL_UNSIGNED_BYTE, data + frame_y +
+                 (first_row/2) * (stride/2));
+    glUniform1i (stream->u_tex.loc, 1);
+
+    /* v component */
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture (GL_TEXTURE_2D, stream->v_tex.id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
+                 stride/2,
+                 stream->crop.height/2, 0, GL_LUMINANCE,
+                 GL_UNSIGNED_BYTE, data + frame_y + frame_c +
+                 (first_row/2) * (stride/2));
+    glUniform1i (stream->v_tex.loc, 2);
+    stream->uploaded = stride * stream->crop.height +
+                       2 * (stride / 2) * (stream->crop.height / 2);
+
+done:
+#if GST_CHECK_VERSION(1, 0, 0)
+    gst_buffer_unmap(buf, &bufmap);
+#endif
+    return;
+}
+
+void
+gl_stream_draw_fbo (GstElement *element, GstGLESStream *stream,
+                    GstGLESShader *deinterlace, GstBuffer *buf)
+{
+    GLfloat vVertices[] =
+    {
+        -1.0f, -1.0f,
+        0.0f, 1.0f,
+
+        1.0f, -1.0f,
+        1.0f, 1.0f,
+
+        1.0f, 1.0f,
+        1.0f, 0.0f,
+
+        -1.0f, 1.0f,
+        0.0f, 0.0f,
+    };
+
+    /* the GLES2 planes still hold the full rows */
+    if (!stream->features && !gl_stream_packs_crop (stream) &&
+        stream->crop.width != stream->frame_width) {
+        GLfloat left = (GLfloat) stream->crop.x / stream->frame_width;
+        GLfloat right = (GLfloat) (stream->crop.x + stream->crop.width) /
+                        stream->frame_width;
+
+        vVertices[2] = vVertices[14] = left;
+        vVertices[6] = vVertices[10] = right;
+    }
+
+    glBindFramebuffer (GL_FRAMEBUFFER, stream->framebuffer);
+    glUseProgram (deinterlace->program);
+
+    glViewport(0, 0, stream->width, stream->height);
+
+    glClear (GL_COLOR_BUFFER_BIT);
+
+    stream->uploaded = 0;
+    gl_load_texture(element, stream, buf);
+    GLint line_height_loc =
+            glGetUniformLocation(deinterlace->program,
+                                 "line_height");
+    glUniform1f(line_height_loc, 1.0/stream->height);
+    glUniformMatrix3fv (stream->color_matrix_loc, 1, GL_FALSE,
+                        stream->color_matrix);
+    glUniform3fv (stream->color_offset_loc, 1, stream->color_offset);
+
+    gl_draw_quad (deinterlace, vVertices);
+}
+
+void
+gl_draw_quad (GstGLESShader *shader, const GLfloat *vertices)
+{
+    GLushort indices[] = { 0, 1, 2, 0, 2, 3 };
+
+    glVertexAttribPointer (shader->position_loc, 2, GL_FLOAT,
+        GL_FALSE, 4 * sizeof (GLfloat), vertices);
+
+    glVertexAttribPointer (shader->texcoord_loc, 2, GL_FLOAT,
+        GL_FALSE, 4 * sizeof (GLfloat), &vertices[2]);
+
+    glEnableVertexAttribArray (shader->position_loc);
+    glEnableVertexAttribArray (shader->texcoord_loc);
+
+    glDrawElements (GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices);
+}
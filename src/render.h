@@ -0,0 +1,287 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _RENDER_H__
+#define _RENDER_H__
+
+#include <GLES2/gl2.h>
+
+#include <gst/gst.h>
+
+#include "shader.h"
+
+typedef struct _GstGLESStream      GstGLESStream;
+typedef struct _GstGLESFeatures    GstGLESFeatures;
+typedef struct _GstGLESCrop        GstGLESCrop;
+typedef struct _GstGLESMemory      GstGLESMemory;
+typedef struct _GstGLESTexturePool GstGLESTexturePool;
+
+/* number of pixel unpack buffers a stream cycles through */
+#define GST_GLES_STREAM_PBOS 3
+
+/* free textures a pool keeps for reuse, in bytes */
+#define GST_GLES_POOL_MAX_CACHED (16 * 1024 * 1024)
+
+/* GLES 3.0 entry points are resolved at runtime, so the plugin builds
+ * against GLES2 headers and still runs on GLES2 only stacks */
+typedef void (GL_APIENTRYP GstGLESTexStorage2DFunc) (GLenum target,
+        GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+typedef void * (GL_APIENTRYP GstGLESMapBufferRangeFunc) (GLenum target,
+        GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (GL_APIENTRYP GstGLESUnmapBufferFunc) (GLenum target);
+typedef void (GL_APIENTRYP GstGLESBufferStorageFunc) (GLenum target,
+        GLsizeiptr size, const void *data, GLbitfield flags);
+typedef gpointer (GL_APIENTRYP GstGLESFenceSyncFunc) (GLenum condition,
+        GLbitfield flags);
+typedef GLenum (GL_APIENTRYP GstGLESClientWaitSyncFunc) (gpointer sync,
+        GLbitfield flags, guint64 timeout);
+typedef void (GL_APIENTRYP GstGLESDeleteSyncFunc) (gpointer sync);
+typedef void (GL_APIENTRYP GstGLESMaxShaderCompilerThreadsFunc) (
+        GLuint count);
+
+/* optional features of the contexts of a display */
+struct _GstGLESFeatures
+{
+    gboolean probed;
+
+    /* GLES 3.0: pixel buffer objects and immutable R8 textures */
+    gboolean gles3;
+    /* EXT_buffer_storage: persistently mapped upload buffers */
+    gboolean buffer_storage;
+    /* textures and framebuffers can't be larger in either direction */
+    GLint max_texture_size;
+    /* KHR_parallel_shader_compile: compiles run on driver threads */
+    gboolean parallel_compile;
+    /* two channel and half float textures, EGL images as external
+       textures, importing dma-bufs as EGL images and NV binary shaders */
+    gboolean texture_rg;
+    gboolean half_float;
+    gboolean image_external;
+    gboolean dmabuf_import;
+    gboolean binary_shaders;
+
+    GstGLESTexStorage2DFunc TexStorage2D;
+    GstGLESMapBufferRangeFunc MapBufferRange;
+    GstGLESUnmapBufferFunc UnmapBuffer;
+    GstGLESBufferStorageFunc BufferStorage;
+    GstGLESFenceSyncFunc FenceSync;
+    GstGLESClientWaitSyncFunc ClientWaitSync;
+    GstGLESDeleteSyncFunc DeleteSync;
+};
+
+/* outcome of allocating GPU storage */
+typedef enum
+{
+    GST_GLES_ALLOC_OK = 0,
+    /* it would take the element beyond its memory budget */
+    GST_GLES_ALLOC_NO_BUDGET,
+    /* the driver failed to provide the texture or framebuffer */
+    GST_GLES_ALLOC_FAILED
+} GstGLESAllocResult;
+
+/* visible part of a frame in pixels, kept even for the I420 chroma */
+struct _GstGLESCrop
+{
+    gint x;
+    gint y;
+    gint width;
+    gint height;
+};
+
+/* GPU memory held by one element in bytes, allocations which would take
+ * it beyond budget fail. a budget of 0 is unlimited */
+struct _GstGLESMemory
+{
+    gsize allocated;
+    gsize budget;
+};
+
+/* textures of a share group. released ones are kept by format and size
+ * for the next stream of any element, up to GST_GLES_POOL_MAX_CACHED
+ * bytes. allocated counts all memory of the streams using the pool
+ * including the cached textures, protected by lock */
+struct _GstGLESTexturePool
+{
+    GMutex lock;
+    GList *free;
+    gsize allocated;
+    gsize cached;
+};
+
+/* GL state of a single video input: the yuv plane textures and the
+ * framebuffer the deinterlaced rgb picture is rendered into */
+struct _GstGLESStream
+{
+    gboolean initialized;
+
+    /* size of the rgb texture */
+    gint width;
+    gint height;
+
+    /* size of the uploaded frames and their visible part, only the rows
+       (and with GLES3 the columns) of the crop are transferred */
+    gint frame_width;
+    gint frame_height;
+    GstGLESCrop crop;
+
+    /* GLES2 can't upload part of a row, crops of frames wider than
+       max_texture_size are packed into a buffer of pack_size first */
+    GLint max_texture_size;
+    guint8 *pack;
+    gsize pack_size;
+
+    /* textures for yuv input planes */
+    GstGLESTexture y_tex;
+    GstGLESTexture u_tex;
+    GstGLESTexture v_tex;
+
+    GstGLESTexture rgb_tex;
+
+    /* framebuffer object */
+    GLuint framebuffer;
+
+    /* yuv to rgb conversion with the colour balance applied, the matrix
+       is stored column major */
+    GLfloat color_matrix[9];
+    GLfloat color_offset[3];
+    GLint color_matrix_loc;
+    GLint color_offset_loc;
+
+    /* the rgb texture and GLES3 planes come from pool, all allocations
+       are accounted to memory. both may be NULL */
+    GstGLESTexturePool *pool;
+    GstGLESMemory *memory;
+
+    /* GLES3 upload path, the planes go through a ring of pixel unpack
+       buffers into immutable textures of plane_width x plane_height */
+    const GstGLESFeatures *features;
+    gint plane_width;
+    gint plane_height;
+    GLuint pbo[GST_GLES_STREAM_PBOS];
+    gsize pbo_size;
+    guint pbo_index;
+    /* persistent mappings and the fences guarding them */
+    guint8 *pbo_data[GST_GLES_STREAM_PBOS];
+    gpointer pbo_fence[GST_GLES_STREAM_PBOS];
+    /* the buffer at pbo_index has been filled ahead of the upload with
+       the crop of frames of filled_width x filled_height */
+    gboolean pbo_filled;
+    GstGLESCrop filled_crop;
+    gint filled_width;
+    gint filled_height;
+
+    /* bytes handed to the driver by the last upload, 0 if it failed */
+    gsize uploaded;
+};
+
+GLuint
+gl_create_texture (GLuint tex_filter);
+
+/* fills in the features of the current context, gles_version is the
+ * client version the context was created with */
+void
+gl_probe_features (GstElement *element, GstGLESFeatures *features,
+                   gint gles_version);
+
+void
+gl_texture_pool_init (GstGLESTexturePool *pool);
+/* frees the bookkeeping only, the cached textures go away with the
+ * share group */
+void
+gl_texture_pool_clear (GstGLESTexturePool *pool);
+
+/* accounts size bytes of buffers allocated outside of the pool to the
+ * element and to the pool, either may be NULL */
+void
+gl_memory_charge (GstGLESTexturePool *pool, GstGLESMemory *memory,
+                  gsize size);
+void
+gl_memory_uncharge (GstGLESTexturePool *pool, GstGLESMemory *memory,
+                    gsize size);
+
+/* binds a texture with storage for format and size, reusing a cached
+ * one of the pool if possible. GL_R8 textures are immutable and need
+ * the GLES3 features */
+GstGLESAllocResult
+gl_texture_pool_acquire (GstGLESTexturePool *pool, GstGLESMemory *memory,
+                         GstGLESTexture *tex, GLenum format, gint width,
+                         gint height, GLuint filter,
+                         const GstGLESFeatures *features);
+/* hands tex back to the pool, or deletes it if the pool is full */
+void
+gl_texture_pool_release (GstGLESTexturePool *pool, GstGLESMemory *memory,
+                         GstGLESTexture *tex);
+
+/* creates the plane textures, uniform locations are taken from the
+ * deinterlace program. the GLES3 path is used if features allow */
+void
+gl_stream_init (GstGLESStream *stream, GstGLESShader *deinterlace,
+                const GstGLESFeatures *features, GstGLESTexturePool *pool,
+                GstGLESMemory *memory);
+/* allocates the rgb texture and the framebuffer object */
+GstGLESAllocResult
+gl_stream_gen_framebuffer (GstElement *element, GstGLESStream *stream,
+                           gint width, gint height);
+/* reallocates the rgb texture if the size changed, the framebuffer
+ * object and the plane textures are kept. the stream has no rgb texture
+ * if this fails */
+GstGLESAllocResult
+gl_stream_resize (GstElement *element, GstGLESStream *stream, gint width,
+                  gint height);
+/* makes tex the target of the framebuffer and hands the rgb texture of
+ * the stream over to tex. tex is reallocated if it does not have the
+ * size of the stream */
+GstGLESAllocResult
+gl_stream_swap_texture (GstElement *element, GstGLESStream *stream,
+                        GstGLESTexture *tex);
+/* restricts the upload to crop of frames of frame_width x frame_height,
+ * the rgb texture must have the size of the crop. allocating or resizing
+ * the stream resets the crop to the whole frame */
+void
+gl_stream_set_crop (GstGLESStream *stream, gint frame_width,
+                    gint frame_height, const GstGLESCrop *crop);
+/* folds a colour balance into the conversion matrix. brightness and hue
+ * range from -1 to 1, contrast and saturation from 0 to 2 with 1 leaving
+ * the picture unchanged */
+void
+gl_stream_set_balance (GstGLESStream *stream, gfloat brightness,
+                       gfloat contrast, gfloat hue, gfloat saturation);
+void
+gl_stream_delete (GstGLESStream *stream);
+
+/* copies the I420 planes of buf into the next persistent unpack buffer
+ * without a current context, so the upload of buf only transfers them.
+ * must not run concurrently to a job using the stream, FALSE if there is
+ * no such buffer ready */
+gboolean
+gl_stream_fill_upload (GstGLESStream *stream, GstBuffer *buf);
+
+/* uploads the I420 planes of buf and renders them deinterlaced and
+ * colour converted into the framebuffer */
+void
+gl_stream_draw_fbo (GstElement *element, GstGLESStream *stream,
+                    GstGLESShader *deinterlace, GstBuffer *buf);
+
+/* draws a quad of four interleaved position/texcoord vertices */
+void
+gl_draw_quad (GstGLESShader *shader, const GLfloat *vertices);
+
+#endif
@@ -39,7 +39,10 @@ GST_DEBUG_CATEGORY_EXTERN (gst_gles_sink_debug);
 
 static const gchar* shader_basenames[] = {
     "deint_linear", /* SHADER_DEINT_LINEAR */
-    "copy" /* SHADER_COPY, simple linear scaled copy shader */
+    "copy", /* SHADER_COPY, simple linear scaled copy shader */
+    "overlay", /* SHADER_OVERLAY, alpha blended overlay rectangles */
+    "blend", /* SHADER_BLEND, scaled copy with constant alpha */
+    "snapshot_i420" /* SHADER_SNAPSHOT_I420, rgb packed into I420 planes */
 };
 
 #ifndef DATA_DIR
@@ -74,6 +77,12 @@ gl_load_binary_shader (GstElement *sink, const char *filename,
     }
 
     file = g_file_new_for_path (filename);
+    /* not every shader ships as a binary */
+    if (!g_file_query_exists (file, NULL)) {
+        GST_DEBUG_OBJECT (sink, "No binary shader %s", filename);
+        goto cleanup;
+    }
+
     /* create a shader object */
     shader = glCreateShader (type);
     if (shader == 0) {
@@ -106,10 +115,25 @@ cleanup:
     return shader;
 }
 
+static void
+gl_log_shader_error (GstElement *sink, GLuint shader)
+{
+    GLint info_len = 0;
+
+    glGetShaderiv (shader, GL_INFO_LOG_LENGTH, &info_len);
+    if(info_len > 1) {
+        char *info_log = malloc (sizeof(char) * info_len);
+        glGetShaderInfoLog (shader, info_len, NULL, info_log);
+
+        GST_ERROR_OBJECT (sink, "Failed to compile shader: %s", info_log);
+        free (info_log);
+    }
+}
+
 /* load and compile a shader src into a shader program */
 static GLuint
 gl_load_source_shader (GstElement *sink, const char *shader_filename,
-                       GLenum type)
+                       GLenum type, gboolean check)
 {
     GFile *shader_file;
     GLuint shader = 0;
@@ -150,20 +174,15 @@ gl_load_source_shader (GstElement *sink, const char *shader_filename,
     /* compile the shader */
     glCompileShader (shader);
 
+    /* querying the status waits for the compiler, which would serialize
+       parallel compiles. a failure then shows when linking */
+    if (!check)
+        return shader;
+
     /* check compiler status */
     glGetShaderiv (shader, GL_COMPILE_STATUS, &compiled);
     if (!compiled) {
-        GLint info_len = 0;
-
-        glGetShaderiv (shader, GL_INFO_LOG_LENGTH, &info_len);
-        if(info_len > 1) {
-            char *info_log = malloc (sizeof(char) * info_len);
-            glGetShaderInfoLog (shader, info_len, NULL, info_log);
-
-            GST_ERROR_OBJECT (sink, "Failed to compile shader: %s", info_log);
-            free (info_log);
-        }
-
+        gl_log_shader_error (sink, shader);
         glDeleteShader (shader);
         shader = 0;
     } else {
@@ -174,29 +193,27 @@ gl_load_source_shader (GstElement *sink, const char *shader_filename,
 }
 
 /*
- * Loads a shader from either precompiled binary file when possible.
- * If no binary is found the source file is taken and compiled at
- * runtime. */
+ * Loads a shader from the precompiled binary file or from the source file
+ * compiled at runtime. */
 static GLuint
-gl_load_shader (GstElement *sink, const gchar *basename, const GLenum type)
+gl_load_shader (GstElement *sink, const gchar *basename, const GLenum type,
+                gboolean binary, gboolean check)
 {
-    GstGLESSink *el = GST_GLES_SINK (sink);
     gchar *filename;
     GLuint shader;
 
-    filename = g_strdup_printf ("%s/%s%s", DATA_DIR, basename,
-                                SHADER_EXT_BINARY);
-    GST_DEBUG_OBJECT (el, "Load binary shader from %s", filename);
+    if (binary) {
+        filename = g_strdup_printf ("%s/%s%s", DATA_DIR, basename,
+                                    SHADER_EXT_BINARY);
+        GST_DEBUG_OBJECT (sink, "Load binary shader from %s", filename);
 
-    shader = gl_load_binary_shader (sink, filename, type);
-    if (!shader) {
-        g_free (filename);
-        filename = g_strdup_printf ("%s/%s%s", DATA_DIR,
-                                    basename,
+        shader = gl_load_binary_shader (sink, filename, type);
+    } else {
+        filename = g_strdup_printf ("%s/%s%s", DATA_DIR, basename,
                                     SHADER_EXT_SOURCE);
-        GST_DEBUG_OBJECT(el, "Load source shader from %s", filename);
+        GST_DEBUG_OBJECT(sink, "Load source shader from %s", filename);
 
-        shader = gl_load_source_shader(sink, filename, type);
+        shader = gl_load_source_shader(sink, filename, type, check);
     }
 
     g_free (filename);
@@ -206,19 +223,33 @@ gl_load_shader (GstElement *sink, const gchar *basename, const GLenum type)
 /*
  * Load vertex and fragment Shaders.
  * Vertex shader is a predefined default, fragment shader can be configured
- * through process_type */
+ * through process_type. Binaries are only used if there are both, as the
+ * varyings of a binary vertex shader need not match a source fragment
+ * shader */
 static gint
 gl_load_shaders (GstElement *sink, GstGLESShader *shader,
-                 GstGLESShaderTypes process_type)
+                 GstGLESShaderTypes process_type, gboolean check)
 {
+    shader->fragment_shader = gl_load_shader (sink,
+                                            shader_basenames[process_type],
+                                            GL_FRAGMENT_SHADER, TRUE, check);
+    if (shader->fragment_shader) {
+        shader->vertex_shader = gl_load_shader (sink, VERTEX_SHADER_BASENAME,
+                                                GL_VERTEX_SHADER, TRUE, check);
+        if (shader->vertex_shader)
+            return 0;
+
+        glDeleteShader (shader->fragment_shader);
+    }
+
     shader->vertex_shader = gl_load_shader (sink, VERTEX_SHADER_BASENAME,
-                                          GL_VERTEX_SHADER);
+                                          GL_VERTEX_SHADER, FALSE, check);
     if (!shader->vertex_shader)
         return -EINVAL;
 
     shader->fragment_shader = gl_load_shader (sink,
                                             shader_basenames[process_type],
-                                            GL_FRAGMENT_SHADER);
+                                            GL_FRAGMENT_SHADER, FALSE, check);
     if (!shader->fragment_shader)
         return -EINVAL;
 
@@ -226,12 +257,27 @@ gl_load_shaders (GstElement *sink, GstGLESShader *shader,
 }
 
 gint
-gl_init_shader (GstElement *sink, GstGLESShader *shader,
-                GstGLESShaderTypes process_type)
+gl_compile_shader (GstElement *sink, GstGLESShader *shader,
+                   GstGLESShaderTypes process_type, gboolean check)
+{
+    gint ret;
+
+    /* load the shaders */
+    ret = gl_load_shaders(sink, shader, process_type, check);
+    if(ret < 0) {
+        GST_ERROR_OBJECT(sink, "Could not create GL shaders: %d", ret);
+        return ret;
+    }
+
+    return 0;
+}
+
+gint
+gl_link_shader (GstElement *sink, GstGLESShader *shader,
+                const GstGLESShader *compiled)
 {
     gint linked;
     GLint err;
-    gint ret;
 
     shader->program = glCreateProgram();
     if(!shader->program) {
@@ -239,20 +285,13 @@ gl_init_shader (GstElement *sink, GstGLESShader *shader,
         return -ENOMEM;
     }
 
-    /* load the shaders */
-    ret = gl_load_shaders(sink, shader, process_type);
-    if(ret < 0) {
-        GST_ERROR_OBJECT(sink, "Could not create GL shaders: %d", ret);
-        return ret;
-    }
-
-    glAttachShader(shader->program, shader->vertex_shader);
+    glAttachShader(shader->program, compiled->vertex_shader);
     err = glGetError ();
     if (err != GL_NO_ERROR) {
         GST_ERROR_OBJECT (sink, "Error while attaching the vertex shader: 0x%04x\n", err);
     }
 
-    glAttachShader(shader->program, shader->fragment_shader);
+    glAttachShader(shader->program, compiled->fragment_shader);
     err = glGetError ();
     if (err != GL_NO_ERROR) {
         GST_ERROR_OBJECT (sink, "Error while attaching the fragment shader: 0x%04x\n", err);
@@ -265,8 +304,17 @@ gl_init_shader (GstElement *sink, GstGLESShader *shader,
     glGetProgramiv(shader->program, GL_LINK_STATUS, &linked);
     if(!linked) {
         GLint info_len = 0;
+        GLint status;
         GST_ERROR_OBJECT(sink, "Linker failure");
 
+        /* compile errors of unchecked shaders show up here */
+        glGetShaderiv (compiled->vertex_shader, GL_COMPILE_STATUS, &status);
+        if (!status)
+            gl_log_shader_error (sink, compiled->vertex_shader);
+        glGetShaderiv (compiled->fragment_shader, GL_COMPILE_STATUS, &status);
+        if (!status)
+            gl_log_shader_error (sink, compiled->fragment_shader);
+
         glGetProgramiv(shader->program, GL_INFO_LOG_LENGTH, &info_len);
         if(info_len > 1) {
             char *info_log = malloc(sizeof(char) * info_len);
@@ -277,6 +325,7 @@ gl_init_shader (GstElement *sink, GstGLESShader *shader,
         }
 
         glDeleteProgram(shader->program);
+        shader->program = 0;
         return -EINVAL;
     }
 
@@ -290,6 +339,19 @@ gl_init_shader (GstElement *sink, GstGLESShader *shader,
     return 0;
 }
 
+gint
+gl_init_shader (GstElement *sink, GstGLESShader *shader,
+                GstGLESShaderTypes process_type)
+{
+    gint ret;
+
+    ret = gl_compile_shader (sink, shader, process_type, TRUE);
+    if (ret < 0)
+        return ret;
+
+    return gl_link_shader (sink, shader, shader);
+}
+
 void
 gl_delete_shader(GstGLESShader *shader)
 {
@@ -28,7 +28,11 @@ typedef struct _GstGLESShader      GstGLESShader;
 
 enum _GstGLESShaderTypes {
     SHADER_DEINT_LINEAR = 0,
-    SHADER_COPY
+    SHADER_COPY,
+    SHADER_OVERLAY,
+    SHADER_BLEND,
+    SHADER_SNAPSHOT_I420,
+    SHADER_COUNT
 };
 
 struct _GstGLESShader
@@ -46,6 +50,11 @@ struct _GstGLESTexture
 {
     GLuint id;
     GLint loc;
+
+    /* storage of the texture, for reuse and memory accounting */
+    GLenum format;
+    gint width;
+    gint height;
 };
 
 /* initialises the GL program with its shaders and sets the program handle
@@ -53,6 +62,17 @@ struct _GstGLESTexture
 gint
 gl_init_shader (GstElement *sink, GstGLESShader *shader,
                 GstGLESShaderTypes process_type);
+/* only compiles the vertex and fragment shader of process_type. without
+ * check the compile status is left to gl_link_shader, so the compiles of
+ * several shaders can run in parallel */
+gint
+gl_compile_shader (GstElement *sink, GstGLESShader *shader,
+                   GstGLESShaderTypes process_type, gboolean check);
+/* links a new program from shaders compiled by gl_compile_shader, which may
+ * be shared with other contexts of the same share group */
+gint
+gl_link_shader (GstElement *sink, GstGLESShader *shader,
+                const GstGLESShader *compiled);
 void
 gl_delete_shader (GstGLESShader *shader);
 #endif
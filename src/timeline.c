@@ -0,0 +1,155 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "timeline.h"
+
+GST_DEBUG_CATEGORY_EXTERN (gst_gles_sink_debug);
+#define GST_CAT_DEFAULT gst_gles_sink_debug
+
+/* element names are only unique within a bin, so every timeline of the
+ * process gets a number of its own */
+static gint timeline_instances;
+
+GstGLESTimeline *
+gst_gles_timeline_open (GstElement *element, guint n_records)
+{
+    GstGLESTimeline *timeline;
+    gchar *name;
+    gpointer map;
+    gsize size;
+    gint fd;
+
+    name = gst_element_get_name (element);
+    g_strdelimit (name, "/", '_');
+    size = sizeof (GstGLESTimelineHeader) +
+           n_records * sizeof (GstGLESTimelineRecord);
+
+    timeline = g_slice_new0 (GstGLESTimeline);
+    /* a file left behind by a process of the same pid is not reused */
+    do {
+        g_free (timeline->path);
+        timeline->path = g_strdup_printf (GST_GLES_TIMELINE_PREFIX
+                                          "%d-%s-%d", getpid (), name,
+                                          g_atomic_int_add (
+                                              &timeline_instances, 1));
+        fd = open (timeline->path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    } while (fd < 0 && errno == EEXIST);
+
+    if (fd < 0 || ftruncate (fd, size) < 0) {
+        GST_WARNING_OBJECT (element, "Could not create %s: %s",
+                            timeline->path, g_strerror (errno));
+        if (fd >= 0)
+            unlink (timeline->path);
+        goto fail;
+    }
+
+    map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        GST_WARNING_OBJECT (element, "Could not map %s: %s",
+                            timeline->path, g_strerror (errno));
+        unlink (timeline->path);
+        goto fail;
+    }
+    close (fd);
+
+    timeline->size = size;
+    timeline->header = map;
+    timeline->records = (GstGLESTimelineRecord *) (timeline->header + 1);
+
+    timeline->header->version = GST_GLES_TIMELINE_VERSION;
+    timeline->header->record_size = sizeof (GstGLESTimelineRecord);
+    timeline->header->n_records = n_records;
+    timeline->header->pid = getpid ();
+    g_strlcpy (timeline->header->name, name,
+               sizeof (timeline->header->name));
+    /* readers ignore the file until the header is complete */
+    __sync_synchronize ();
+    timeline->header->magic = GST_GLES_TIMELINE_MAGIC;
+
+    GST_DEBUG_OBJECT (element, "Publishing frame timeline in %s",
+                      timeline->path);
+    g_free (name);
+    return timeline;
+
+fail:
+    if (fd >= 0)
+        close (fd);
+    g_free (timeline->path);
+    g_slice_free (GstGLESTimeline, timeline);
+    g_free (name);
+    return NULL;
+}
+
+void
+gst_gles_timeline_close (GstGLESTimeline *timeline)
+{
+    munmap (timeline->header, timeline->size);
+    unlink (timeline->path);
+    g_free (timeline->path);
+    g_slice_free (GstGLESTimeline, timeline);
+}
+
+GstGLESTimelineRecord *
+gst_gles_timeline_begin (GstGLESTimeline *timeline)
+{
+    GstGLESTimelineHeader *header = timeline->header;
+    GstGLESTimelineRecord *record;
+
+    record = &timeline->records[header->write_index % header->n_records];
+    record->seq = 0;
+    __sync_synchronize ();
+
+    record->pts = GST_CLOCK_TIME_NONE;
+    record->arrival = 0;
+    record->upload_start = 0;
+    record->upload_end = 0;
+    record->draw_end = 0;
+    record->swap_end = 0;
+    record->upload_bytes = 0;
+    record->drop = GST_GLES_TIMELINE_SHOWN;
+
+    timeline->current = record;
+    return record;
+}
+
+void
+gst_gles_timeline_commit (GstGLESTimeline *timeline)
+{
+    GstGLESTimelineHeader *header = timeline->header;
+
+    if (!timeline->current)
+        return;
+
+    __sync_synchronize ();
+    timeline->current->seq = header->write_index + 1;
+    header->write_index++;
+    timeline->current = NULL;
+}
@@ -0,0 +1,107 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _TIMELINE_H__
+#define _TIMELINE_H__
+
+#include <gst/gst.h>
+
+/* per frame timing published through a file in /dev/shm, so external
+ * monitoring can follow every sink without debug logging. the file is
+ * a header followed by a ring of records, written by a single thread
+ * without locks. a record is valid while its seq equals its ring index
+ * + 1, readers copy it and check seq again afterwards */
+
+#define GST_GLES_TIMELINE_MAGIC   0x474c5446 /* GLTF */
+#define GST_GLES_TIMELINE_VERSION 1
+#define GST_GLES_TIMELINE_PREFIX  "/dev/shm/gst-gles-timeline-"
+#define GST_GLES_TIMELINE_RECORDS 1024
+
+typedef struct _GstGLESTimeline        GstGLESTimeline;
+typedef struct _GstGLESTimelineHeader  GstGLESTimelineHeader;
+typedef struct _GstGLESTimelineRecord  GstGLESTimelineRecord;
+
+typedef enum
+{
+    GST_GLES_TIMELINE_SHOWN = 0,
+    GST_GLES_TIMELINE_DROP_FIRST,
+    GST_GLES_TIMELINE_DROP_DECIMATED,
+    /* no longer recorded, late frames are dropped by basesink before
+       they reach the sink. kept so the numbers stay stable */
+    GST_GLES_TIMELINE_DROP_LATE,
+    GST_GLES_TIMELINE_DROP_NOT_READY,
+    GST_GLES_TIMELINE_DROP_NO_MEMORY,
+    GST_GLES_TIMELINE_DROP_ERROR,
+    GST_GLES_TIMELINE_DROP_COUNT
+} GstGLESTimelineDrop;
+
+/* times are monotonic clock nanoseconds, 0 for stages not reached */
+struct _GstGLESTimelineRecord
+{
+    volatile guint64 seq;
+
+    guint64 pts;
+    guint64 arrival;
+    guint64 upload_start;
+    /* planes uploaded and converted into the stream framebuffer */
+    guint64 upload_end;
+    guint64 draw_end;
+    guint64 swap_end;
+    guint32 drop;
+    /* frame data handed to the driver for the upload */
+    guint32 upload_bytes;
+};
+
+struct _GstGLESTimelineHeader
+{
+    guint32 magic;
+    guint32 version;
+    guint32 record_size;
+    guint32 n_records;
+    guint32 pid;
+    guint32 reserved;
+    gchar name[64];
+
+    /* number of records ever committed */
+    volatile guint64 write_index;
+};
+
+struct _GstGLESTimeline
+{
+    gchar *path;
+    gsize size;
+    GstGLESTimelineHeader *header;
+    GstGLESTimelineRecord *records;
+    GstGLESTimelineRecord *current;
+};
+
+GstGLESTimeline *
+gst_gles_timeline_open (GstElement *element, guint n_records);
+void
+gst_gles_timeline_close (GstGLESTimeline *timeline);
+
+/* claims and clears the next record, it is only published by commit */
+GstGLESTimelineRecord *
+gst_gles_timeline_begin (GstGLESTimeline *timeline);
+void
+gst_gles_timeline_commit (GstGLESTimeline *timeline);
+
+#endif
@@ -0,0 +1,635 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Wayland window system backend. Top level windows use xdg-shell, an
+ * application provided wl_surface handle is embedded as a subsurface.
+ * wp_viewporter keeps the surface at the size requested by the compositor
+ * until the EGL buffers are resized with the next frame, frame callbacks
+ * pace the rendering and wp_presentation reports when a frame was shown.
+ *
+ * It can be tried without a desktop against weston's headless backend:
+ *
+ *   weston --backend=headless-backend.so --use-gl --socket=gles-test &
+ *   WAYLAND_DISPLAY=gles-test gst-launch videotestsrc ! glessink backend=wayland
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+#define GST_USE_UNSTABLE_API
+#include <gst/gst.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <wayland-client.h>
+#include <wayland-egl.h>
+
+#include "xdg-shell-client-protocol.h"
+#include "viewporter-client-protocol.h"
+#include "presentation-time-client-protocol.h"
+
+#include "window.h"
+
+GST_DEBUG_CATEGORY_EXTERN (gst_gles_sink_debug);
+#define GST_CAT_DEFAULT gst_gles_sink_debug
+
+#ifndef EGL_PLATFORM_WAYLAND_KHR
+#define EGL_PLATFORM_WAYLAND_KHR 0x31D8
+#endif
+
+/* a frame callback that did not arrive within this time is ignored, the
+ * compositor does not send them for hidden surfaces */
+#define FRAME_CALLBACK_TIMEOUT (100 * G_TIME_SPAN_MILLISECOND)
+
+typedef struct _GstGLESWaylandDisplay  GstGLESWaylandDisplay;
+typedef struct _GstGLESWaylandWindow   GstGLESWaylandWindow;
+
+struct _GstGLESWaylandDisplay
+{
+    struct wl_display *display;
+    gboolean own_display;
+
+    /* all our proxies live on a private queue, so we never dispatch
+       events of the application or of the EGL implementation */
+    struct wl_event_queue *queue;
+    struct wl_registry *registry;
+
+    struct wl_compositor *compositor;
+    struct wl_subcompositor *subcompositor;
+    struct xdg_wm_base *wm_base;
+    struct wp_viewporter *viewporter;
+    struct wp_presentation *presentation;
+    /* presentation times are only used in the clock gstreamer uses */
+    gboolean monotonic_presentation;
+
+    /* serializes dispatching and all window state changes */
+    GMutex lock;
+};
+
+struct _GstGLESWaylandWindow
+{
+    GstGLESWindow *window;
+
+    struct wl_surface *surface;
+    struct wl_subsurface *subsurface;
+    struct xdg_surface *xdg_surface;
+    struct xdg_toplevel *xdg_toplevel;
+    struct wl_egl_window *egl_window;
+    struct wp_viewport *viewport;
+
+    struct wl_callback *frame_callback;
+    gint64 frame_requested;
+    GList *feedbacks;
+
+    gboolean configured;
+    gboolean resize_pending;
+    gint pending_width;
+    gint pending_height;
+};
+
+static struct wl_display *application_display = NULL;
+
+void
+window_wayland_set_display (gpointer display)
+{
+    application_display = display;
+}
+
+/* registry */
+
+static void
+wm_base_ping (void *data, struct xdg_wm_base *wm_base, uint32_t serial)
+{
+    xdg_wm_base_pong (wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener =
+{
+    wm_base_ping
+};
+
+static void
+presentation_clock_id (void *data, struct wp_presentation *presentation,
+                       uint32_t clk_id)
+{
+    GstGLESWaylandDisplay *display = data;
+
+    display->monotonic_presentation = clk_id == CLOCK_MONOTONIC;
+}
+
+static const struct wp_presentation_listener presentation_listener =
+{
+    presentation_clock_id
+};
+
+static void
+registry_global (void *data, struct wl_registry *registry, uint32_t name,
+                 const char *interface, uint32_t version)
+{
+    GstGLESWaylandDisplay *display = data;
+
+    if (g_str_equal (interface, wl_compositor_interface.name)) {
+        display->compositor = wl_registry_bind (registry, name,
+                                                &wl_compositor_interface, 1);
+    } else if (g_str_equal (interface, wl_subcompositor_interface.name)) {
+        display->subcompositor = wl_registry_bind (registry, name,
+                &wl_subcompositor_interface, 1);
+    } else if (g_str_equal (interface, xdg_wm_base_interface.name)) {
+        display->wm_base = wl_registry_bind (registry, name,
+                                             &xdg_wm_base_interface, 1);
+        xdg_wm_base_add_listener (display->wm_base, &wm_base_listener,
+                                  display);
+    } else if (g_str_equal (interface, wp_viewporter_interface.name)) {
+        display->viewporter = wl_registry_bind (registry, name,
+                                                &wp_viewporter_interface, 1);
+    } else if (g_str_equal (interface, wp_presentation_interface.name)) {
+        display->presentation = wl_registry_bind (registry, name,
+                &wp_presentation_interface, 1);
+        wp_presentation_add_listener (display->presentation,
+                                      &presentation_listener, display);
+    }
+}
+
+static void
+registry_global_remove (void *data, struct wl_registry *registry,
+                        uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener =
+{
+    registry_global,
+    registry_global_remove
+};
+
+/* reads and dispatches the pending events of our queue without blocking,
+ * expects the display lock to be held */
+static void
+wayland_dispatch (GstGLESWaylandDisplay *display)
+{
+    struct pollfd pfd;
+
+    while (wl_display_prepare_read_queue (display->display,
+                                          display->queue) != 0)
+        wl_display_dispatch_queue_pending (display->display, display->queue);
+    wl_display_flush (display->display);
+
+    pfd.fd = wl_display_get_fd (display->display);
+    pfd.events = POLLIN;
+    if (poll (&pfd, 1, 0) > 0)
+        wl_display_read_events (display->display);
+    else
+        wl_display_cancel_read (display->display);
+
+    wl_display_dispatch_queue_pending (display->display, display->queue);
+}
+
+static void
+wayland_close_display (gpointer native_display)
+{
+    GstGLESWaylandDisplay *display = native_display;
+
+    if (display->presentation)
+        wp_presentation_destroy (display->presentation);
+    if (display->viewporter)
+        wp_viewporter_destroy (display->viewporter);
+    if (display->wm_base)
+        xdg_wm_base_destroy (display->wm_base);
+    if (display->subcompositor)
+        wl_subcompositor_destroy (display->subcompositor);
+    if (display->compositor)
+        wl_compositor_destroy (display->compositor);
+    if (display->registry)
+        wl_registry_destroy (display->registry);
+    if (display->queue)
+        wl_event_queue_destroy (display->queue);
+
+    if (display->own_display)
+        wl_display_disconnect (display->display);
+    else
+        wl_display_flush (display->display);
+
+    g_mutex_clear (&display->lock);
+    g_slice_free (GstGLESWaylandDisplay, display);
+}
+
+static gint
+wayland_open_display (GstElement *element, gpointer *native_display,
+                      EGLDisplay *egl_display)
+{
+    GstGLESWaylandDisplay *display;
+
+    display = g_slice_new0 (GstGLESWaylandDisplay);
+    g_mutex_init (&display->lock);
+
+    if (application_display) {
+        display->display = application_display;
+    } else {
+        display->display = wl_display_connect (NULL);
+        display->own_display = TRUE;
+    }
+
+    if (!display->display) {
+        GST_ERROR_OBJECT (element, "Could not connect to wayland display");
+        g_mutex_clear (&display->lock);
+        g_slice_free (GstGLESWaylandDisplay, display);
+        return -1;
+    }
+
+    display->queue = wl_display_create_queue (display->display);
+    display->registry = wl_display_get_registry (display->display);
+    wl_proxy_set_queue ((struct wl_proxy *) display->registry,
+                        display->queue);
+    wl_registry_add_listener (display->registry, &registry_listener,
+                              display);
+    /* a second roundtrip delivers the events of the bound globals */
+    wl_display_roundtrip_queue (display->display, display->queue);
+    wl_display_roundtrip_queue (display->display, display->queue);
+
+    if (!display->compositor ||
+        (!display->wm_base && !display->subcompositor)) {
+        GST_ERROR_OBJECT (element, "Compositor lacks wl_compositor and "
+                          "xdg_wm_base or wl_subcompositor");
+        wayland_close_display (display);
+        return -1;
+    }
+
+    GST_DEBUG_OBJECT (element, "viewporter: %s, presentation: %s",
+                      display->viewporter ? "yes" : "no",
+                      display->presentation ? "yes" : "no");
+
+    *native_display = display;
+    *egl_display = egl_get_platform_display (element,
+                                             "EGL_EXT_platform_wayland",
+                                             EGL_PLATFORM_WAYLAND_KHR,
+                                             display->display);
+    if (*egl_display == EGL_NO_DISPLAY)
+        *egl_display = eglGetDisplay ((EGLNativeDisplayType)
+                                      display->display);
+
+    return 0;
+}
+
+/* shell surface */
+
+static void
+xdg_surface_configure (void *data, struct xdg_surface *xdg_surface,
+                       uint32_t serial)
+{
+    GstGLESWaylandWindow *wl_window = data;
+
+    xdg_surface_ack_configure (xdg_surface, serial);
+    wl_window->configured = TRUE;
+}
+
+static const struct xdg_surface_listener xdg_surface_listener =
+{
+    xdg_surface_configure
+};
+
+static void
+xdg_toplevel_configure (void *data, struct xdg_toplevel *toplevel,
+                        int32_t width, int32_t height,
+                        struct wl_array *states)
+{
+    GstGLESWaylandWindow *wl_window = data;
+
+    /* 0x0 leaves the size up to us */
+    if (width <= 0 || height <= 0)
+        return;
+
+    wl_window->pending_width = width;
+    wl_window->pending_height = height;
+    wl_window->resize_pending = TRUE;
+
+    /* the compositor scales the old buffers until the next frame has
+       been rendered in the new size */
+    if (wl_window->viewport)
+        wp_viewport_set_destination (wl_window->viewport, width, height);
+}
+
+static void
+xdg_toplevel_close (void *data, struct xdg_toplevel *toplevel)
+{
+}
+
+static const struct xdg_toplevel_listener xdg_toplevel_listener =
+{
+    xdg_toplevel_configure,
+    xdg_toplevel_close
+};
+
+/* pacing and presentation feedback */
+
+static void
+frame_callback_done (void *data, struct wl_callback *callback,
+                     uint32_t time)
+{
+    GstGLESWaylandWindow *wl_window = data;
+
+    wl_callback_destroy (callback);
+    wl_window->frame_callback = NULL;
+}
+
+static const struct wl_callback_listener frame_callback_listener =
+{
+    frame_callback_done
+};
+
+static void
+feedback_done (GstGLESWaylandWindow *wl_window,
+               struct wp_presentation_feedback *feedback)
+{
+    wl_window->feedbacks = g_list_remove (wl_window->feedbacks, feedback);
+    wp_presentation_feedback_destroy (feedback);
+}
+
+static void
+feedback_sync_output (void *data, struct wp_presentation_feedback *feedback,
+                      struct wl_output *output)
+{
+}
+
+static void
+feedback_presented (void *data, struct wp_presentation_feedback *feedback,
+                    uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec,
+                    uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo,
+                    uint32_t flags)
+{
+    GstGLESWaylandWindow *wl_window = data;
+    GstGLESWaylandDisplay *display = wl_window->window->native_display;
+    guint64 sec = ((guint64) tv_sec_hi << 32) | tv_sec_lo;
+
+    if (!display->monotonic_presentation) {
+        feedback_done (wl_window, feedback);
+        return;
+    }
+
+    wl_window->window->presentation_time = sec * GST_SECOND + tv_nsec;
+    if (refresh)
+        wl_window->window->refresh_period = refresh;
+    GST_LOG ("Frame presented at %" GST_TIME_FORMAT ", refresh %u ns",
+             GST_TIME_ARGS (wl_window->window->presentation_time), refresh);
+
+    feedback_done (wl_window, feedback);
+}
+
+static void
+feedback_discarded (void *data, struct wp_presentation_feedback *feedback)
+{
+    feedback_done (data, feedback);
+}
+
+static const struct wp_presentation_feedback_listener feedback_listener =
+{
+    feedback_sync_output,
+    feedback_presented,
+    feedback_discarded
+};
+
+/* window */
+
+static gint
+wayland_init (GstElement *element, GstGLESWindow *window, gint width,
+              gint height)
+{
+    GstGLESWaylandDisplay *display = window->native_display;
+    GstGLESWaylandWindow *wl_window;
+
+    wl_window = g_slice_new0 (GstGLESWaylandWindow);
+    wl_window->window = window;
+    window->backend_data = wl_window;
+
+    g_mutex_lock (&display->lock);
+    wl_window->surface = wl_compositor_create_surface (display->compositor);
+
+    if (window->external_window) {
+        struct wl_surface *parent = (struct wl_surface *) window->window;
+
+        if (!display->subcompositor) {
+            GST_ERROR_OBJECT (element, "Compositor can't embed surfaces");
+            goto fail;
+        }
+
+        /* the application surface is on its own display connection,
+           which it has to share with us, see window_wayland_set_display */
+        wl_window->subsurface = wl_subcompositor_get_subsurface (
+                    display->subcompositor, wl_window->surface, parent);
+        wl_subsurface_set_desync (wl_window->subsurface);
+        wl_window->configured = TRUE;
+    } else {
+        if (!display->wm_base) {
+            GST_ERROR_OBJECT (element, "Compositor has no xdg_wm_base");
+            goto fail;
+        }
+
+        wl_window->xdg_surface = xdg_wm_base_get_xdg_surface (
+                    display->wm_base, wl_window->surface);
+        xdg_surface_add_listener (wl_window->xdg_surface,
+                                  &xdg_surface_listener, wl_window);
+        wl_window->xdg_toplevel = xdg_surface_get_toplevel (
+                    wl_window->xdg_surface);
+        xdg_toplevel_add_listener (wl_window->xdg_toplevel,
+                                   &xdg_toplevel_listener, wl_window);
+        xdg_toplevel_set_title (wl_window->xdg_toplevel, "GLESSink");
+        wl_surface_commit (wl_window->surface);
+
+        /* no buffer may be attached before the first configure */
+        while (!wl_window->configured) {
+            if (wl_display_roundtrip_queue (display->display,
+                                            display->queue) < 0) {
+                GST_ERROR_OBJECT (element, "Lost wayland connection");
+                goto fail;
+            }
+        }
+    }
+
+    if (wl_window->resize_pending) {
+        width = wl_window->pending_width;
+        height = wl_window->pending_height;
+        wl_window->resize_pending = FALSE;
+    }
+
+    if (display->viewporter) {
+        wl_window->viewport = wp_viewporter_get_viewport (display->viewporter,
+                                                          wl_window->surface);
+        wp_viewport_set_destination (wl_window->viewport, width, height);
+    }
+
+    wl_window->egl_window = wl_egl_window_create (wl_window->surface, width,
+                                                  height);
+    window->width = width;
+    window->height = height;
+    g_mutex_unlock (&display->lock);
+
+    return 0;
+
+fail:
+    g_mutex_unlock (&display->lock);
+    return -1;
+}
+
+static void
+wayland_close (GstElement *element, GstGLESWindow *window)
+{
+    GstGLESWaylandDisplay *display = window->native_display;
+    GstGLESWaylandWindow *wl_window = window->backend_data;
+
+    if (!wl_window)
+        return;
+
+    g_mutex_lock (&display->lock);
+    while (wl_window->feedbacks)
+        feedback_done (wl_window, wl_window->feedbacks->data);
+    if (wl_window->frame_callback)
+        wl_callback_destroy (wl_window->frame_callback);
+    if (wl_window->viewport)
+        wp_viewport_destroy (wl_window->viewport);
+    if (wl_window->egl_window)
+        wl_egl_window_destroy (wl_window->egl_window);
+    if (wl_window->xdg_toplevel)
+        xdg_toplevel_destroy (wl_window->xdg_toplevel);
+    if (wl_window->xdg_surface)
+        xdg_surface_destroy (wl_window->xdg_surface);
+    if (wl_window->subsurface)
+        wl_subsurface_destroy (wl_window->subsurface);
+    if (wl_window->surface)
+        wl_surface_destroy (wl_window->surface);
+    wl_display_flush (display->display);
+    g_mutex_unlock (&display->lock);
+
+    g_slice_free (GstGLESWaylandWindow, wl_window);
+    window->backend_data = NULL;
+}
+
+static gboolean
+wayland_handle_events (GstElement *element, GstGLESWindow *window)
+{
+    GstGLESWaylandDisplay *display = window->native_display;
+    GstGLESWaylandWindow *wl_window = window->backend_data;
+    gboolean resized = FALSE;
+
+    g_mutex_lock (&display->lock);
+    wayland_dispatch (display);
+
+    if (wl_window->resize_pending) {
+        GST_DEBUG_OBJECT (element, "Resize to %dx%d",
+                          wl_window->pending_width,
+                          wl_window->pending_height);
+        wl_egl_window_resize (wl_window->egl_window,
+                              wl_window->pending_width,
+                              wl_window->pending_height, 0, 0);
+        window->width = wl_window->pending_width;
+        window->height = wl_window->pending_height;
+        wl_window->resize_pending = FALSE;
+        resized = TRUE;
+    }
+    g_mutex_unlock (&display->lock);
+
+    return resized;
+}
+
+static gint
+wayland_init_surface (GstElement *element, GstGLESWindow *window,
+                      EGLConfig config)
+{
+    GstGLESWaylandWindow *wl_window = window->backend_data;
+
+    window->surface = eglCreateWindowSurface (window->egl_display, config,
+            (EGLNativeWindowType) wl_window->egl_window, NULL);
+    return window->surface == EGL_NO_SURFACE ? -1 : 0;
+}
+
+static void
+wayland_lock (GstGLESWindow *window)
+{
+    GstGLESWaylandDisplay *display = window->native_display;
+
+    g_mutex_lock (&display->lock);
+}
+
+static void
+wayland_unlock (GstGLESWindow *window)
+{
+    GstGLESWaylandDisplay *display = window->native_display;
+
+    g_mutex_unlock (&display->lock);
+}
+
+static gboolean
+wayland_frame_ready (GstGLESWindow *window)
+{
+    GstGLESWaylandWindow *wl_window = window->backend_data;
+    gboolean ready;
+
+    wayland_lock (window);
+    ready = !wl_window->frame_callback ||
+            g_get_monotonic_time () - wl_window->frame_requested >
+            FRAME_CALLBACK_TIMEOUT;
+    wayland_unlock (window);
+
+    return ready;
+}
+
+static void
+wayland_pre_swap (GstGLESWindow *window)
+{
+    GstGLESWaylandDisplay *display = window->native_display;
+    GstGLESWaylandWindow *wl_window = window->backend_data;
+
+    /* both are committed together with the buffer by eglSwapBuffers */
+    if (wl_window->frame_callback)
+        wl_callback_destroy (wl_window->frame_callback);
+    wl_window->frame_callback = wl_surface_frame (wl_window->surface);
+    wl_callback_add_listener (wl_window->frame_callback,
+                              &frame_callback_listener, wl_window);
+    wl_window->frame_requested = g_get_monotonic_time ();
+
+    if (display->presentation) {
+        struct wp_presentation_feedback *feedback;
+
+        feedback = wp_presentation_feedback (display->presentation,
+                                             wl_window->surface);
+        wp_presentation_feedback_add_listener (feedback, &feedback_listener,
+                                               wl_window);
+        wl_window->feedbacks = g_list_prepend (wl_window->feedbacks,
+                                               feedback);
+    }
+}
+
+const GstGLESWindowBackend wayland_backend =
+{
+    GST_GLES_WINDOW_BACKEND_WAYLAND, "wayland", EGL_WINDOW_BIT,
+    wayland_open_display, wayland_close_display,
+    wayland_init, wayland_close, wayland_handle_events,
+    wayland_init_surface,
+    wayland_lock, wayland_unlock,
+    wayland_frame_ready, wayland_pre_swap
+};
@@ -0,0 +1,429 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#define GST_USE_UNSTABLE_API
+#include <gst/gst.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "window.h"
+
+GST_DEBUG_CATEGORY_EXTERN (gst_gles_sink_debug);
+#define GST_CAT_DEFAULT gst_gles_sink_debug
+
+typedef EGLDisplay (*GetPlatformDisplayFunc) (EGLenum platform,
+                                              void *native_display,
+                                              const EGLint *attrib_list);
+
+#define WINDOW_EVENT_MASK \
+    (StructureNotifyMask | ExposureMask | VisibilityChangeMask)
+
+/* assumed as long as the display server reports no refresh period */
+#define DEFAULT_REFRESH_PERIOD (GST_SECOND / 60)
+
+/* X11 implementation */
+
+static gint
+x11_open_display (GstElement *element, gpointer *native_display,
+                  EGLDisplay *egl_display)
+{
+    Display *display;
+
+    display = XOpenDisplay (NULL);
+    if (!display) {
+        GST_ERROR_OBJECT (element, "Could not create X display");
+        return -1;
+    }
+
+    *native_display = display;
+    *egl_display = eglGetDisplay ((EGLNativeDisplayType) display);
+    return 0;
+}
+
+static void
+x11_close_display (gpointer native_display)
+{
+    XCloseDisplay ((Display *) native_display);
+}
+
+static gint
+x11_init_surface (GstElement *element, GstGLESWindow *window,
+                  EGLConfig config)
+{
+    window->surface = eglCreateWindowSurface(window->egl_display, config,
+                                             window->window, NULL);
+    return window->surface == EGL_NO_SURFACE ? -1 : 0;
+}
+
+static void
+x11_lock (GstGLESWindow *window)
+{
+    XLockDisplay (window->display);
+}
+
+static void
+x11_unlock (GstGLESWindow *window)
+{
+    XUnlockDisplay (window->display);
+}
+
+static gint
+x11_init (GstElement *element, GstGLESWindow *window, gint width,
+          gint height)
+{
+    Window root;
+    XSetWindowAttributes swa;
+    XWMHints hints;
+
+    window->display = window->native_display;
+
+    XLockDisplay (window->display);
+    root = DefaultRootWindow (window->display);
+    swa.event_mask = WINDOW_EVENT_MASK;
+
+    if (!window->window) {
+        window->window = XCreateWindow (
+                    window->display, root,
+                    0, 0, width, height, 0,
+                    CopyFromParent, InputOutput,
+                    CopyFromParent, CWEventMask,
+                    &swa);
+
+        XSetWindowBackgroundPixmap (window->display, window->window,
+                                    None);
+
+        hints.input = True;
+        hints.flags = InputHint;
+        XSetWMHints(window->display, window->window, &hints);
+
+        XMapWindow (window->display, window->window);
+        XStoreName (window->display, window->window, "GLESSink");
+    } else {
+        guint border, depth;
+        int x, y;
+        /* change event mask, so we get resize notifications */
+        XSelectInput (window->display, window->window,
+                      WINDOW_EVENT_MASK);
+
+        /* retrieve the current window geometry */
+        XGetGeometry (window->display, window->window, &root,
+                      &x, &y, (uint*)&window->width, (uint*)&window->height,
+                      &border, &depth);
+    }
+
+    XUnlockDisplay (window->display);
+
+    return 0;
+}
+
+static void
+x11_close (GstElement *element, GstGLESWindow *window)
+{
+    if (window->display) {
+        XLockDisplay (window->display);
+
+        /* only destroy the window if we created it, windows
+          owned by the application stay untouched */
+        if (!window->external_window) {
+            XDestroyWindow (window->display, window->window);
+            window->window = 0;
+        } else
+            XSelectInput (window->display, window->window, 0);
+
+        XSync (window->display, FALSE);
+        XUnlockDisplay (window->display);
+    }
+}
+
+static gboolean
+x11_handle_events (GstElement *element, GstGLESWindow *window)
+{
+    gboolean resized = FALSE;
+    XEvent xev;
+
+    XLockDisplay (window->display);
+    /* the display connection is shared, only pick the events of our
+       own window */
+    while (XCheckWindowEvent (window->display, window->window,
+                              WINDOW_EVENT_MASK, &xev)) {
+        switch (xev.type) {
+        case ConfigureRequest:
+            GST_DEBUG_OBJECT (element, "XConfigure* Request");
+        case ConfigureNotify:
+            GST_DEBUG_OBJECT(element, "XConfigure* Event: wxh: %dx%d",
+                             xev.xconfigure.width,
+                             xev.xconfigure.height);
+            window->width = xev.xconfigure.width;
+            window->height = xev.xconfigure.height;
+
+            resized = TRUE;
+            break;
+        default:
+            break;
+        }
+    }
+    XUnlockDisplay (window->display);
+
+    return resized;
+}
+
+/* headless implementation, renders into a pbuffer. the surfaceless mesa
+ * platform is preferred, so neither a GPU nor a display server is needed */
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+static gint
+headless_open_display (GstElement *element, gpointer *native_display,
+                       EGLDisplay *egl_display)
+{
+    *native_display = NULL;
+    *egl_display = egl_get_platform_display (element,
+                                             "EGL_MESA_platform_surfaceless",
+                                             EGL_PLATFORM_SURFACELESS_MESA,
+                                             EGL_DEFAULT_DISPLAY);
+
+    if (*egl_display == EGL_NO_DISPLAY) {
+        GST_DEBUG_OBJECT (element, "Using default display");
+        *egl_display = eglGetDisplay (EGL_DEFAULT_DISPLAY);
+    }
+
+    return 0;
+}
+
+static gint
+headless_init (GstElement *element, GstGLESWindow *window, gint width,
+               gint height)
+{
+    window->width = width;
+    window->height = height;
+
+    return 0;
+}
+
+static gint
+headless_init_surface (GstElement *element, GstGLESWindow *window,
+                       EGLConfig config)
+{
+    const EGLint attribs[] =
+    {
+        EGL_WIDTH, window->width,
+        EGL_HEIGHT, window->height,
+        EGL_NONE
+    };
+
+    window->surface = eglCreatePbufferSurface (window->egl_display, config,
+                                               attribs);
+    return window->surface == EGL_NO_SURFACE ? -1 : 0;
+}
+
+/* backend dispatch */
+
+static const GstGLESWindowBackend x11_backend =
+{
+    GST_GLES_WINDOW_BACKEND_X11, "x11", EGL_WINDOW_BIT,
+    x11_open_display, x11_close_display,
+    x11_init, x11_close, x11_handle_events, x11_init_surface,
+    x11_lock, x11_unlock,
+    NULL, NULL
+};
+
+static const GstGLESWindowBackend headless_backend =
+{
+    GST_GLES_WINDOW_BACKEND_HEADLESS, "headless", EGL_PBUFFER_BIT,
+    headless_open_display, NULL,
+    headless_init, NULL, NULL, headless_init_surface,
+    NULL, NULL,
+    NULL, NULL
+};
+
+static const GstGLESWindowBackend *backends[] =
+{
+    &x11_backend,
+    &headless_backend,
+#ifdef HAVE_WAYLAND
+    &wayland_backend,
+#else
+    NULL,
+#endif
+};
+
+GType
+gst_gles_window_backend_get_type (void)
+{
+    static volatile gsize backend_type = 0;
+    static const GEnumValue values[] =
+    {
+        { GST_GLES_WINDOW_BACKEND_X11, "X11 window", "x11" },
+        { GST_GLES_WINDOW_BACKEND_HEADLESS,
+          "Offscreen pbuffer, no display server", "headless" },
+        { GST_GLES_WINDOW_BACKEND_WAYLAND, "Wayland surface", "wayland" },
+        { 0, NULL, NULL }
+    };
+
+    if (g_once_init_enter (&backend_type)) {
+        GType type = g_enum_register_static ("GstGLESWindowBackendType",
+                                             values);
+        g_once_init_leave (&backend_type, type);
+    }
+
+    return backend_type;
+}
+
+const GstGLESWindowBackend *
+window_get_backend (GstGLESWindowBackendType type)
+{
+    g_return_val_if_fail (type < GST_GLES_WINDOW_BACKEND_COUNT, NULL);
+
+    return backends[type];
+}
+
+gint
+window_init (GstElement *element, GstGLESWindow *window,
+             const GstGLESWindowBackend *backend, gpointer native_display,
+             gint width, gint height)
+{
+    GST_DEBUG_OBJECT (element, "Init %s window", backend->name);
+
+    window->backend = backend;
+    window->native_display = native_display;
+    window->presentation_time = GST_CLOCK_TIME_NONE;
+    window->refresh_period = DEFAULT_REFRESH_PERIOD;
+    window->last_swap = 0;
+    return backend->init (element, window, width, height);
+}
+
+void
+window_close (GstElement *element, GstGLESWindow *window)
+{
+    if (window->backend && window->backend->close)
+        window->backend->close (element, window);
+}
+
+gboolean
+window_handle_events (GstElement *element, GstGLESWindow *window)
+{
+    if (!window->backend->handle_events)
+        return FALSE;
+
+    return window->backend->handle_events (element, window);
+}
+
+void
+window_lock (GstGLESWindow *window)
+{
+    if (window->backend->lock)
+        window->backend->lock (window);
+}
+
+void
+window_unlock (GstGLESWindow *window)
+{
+    if (window->backend->unlock)
+        window->backend->unlock (window);
+}
+
+gboolean
+window_frame_ready (GstGLESWindow *window, gboolean vsync)
+{
+    GstClockTime elapsed;
+
+    if (window->backend->frame_ready)
+        return window->backend->frame_ready (window);
+    if (vsync || !window->last_swap)
+        return TRUE;
+
+    /* a quarter of the period is left for the jitter of the frames, so
+       a stream at the refresh rate is not decimated */
+    elapsed = (g_get_monotonic_time () - window->last_swap) * GST_USECOND;
+    return elapsed >= window->refresh_period - window->refresh_period / 4;
+}
+
+void
+window_swap_buffers (GstGLESWindow *window)
+{
+    /* only the backend's window state needs the lock, the swap itself is
+       serialized by the driver and xlib */
+    if (window->backend->pre_swap) {
+        window_lock (window);
+        window->backend->pre_swap (window);
+        window_unlock (window);
+    }
+
+    eglSwapBuffers (window->egl_display, window->surface);
+    window->last_swap = g_get_monotonic_time ();
+}
+
+/* EGL implementation */
+
+gint
+egl_init_surface (GstElement *element, GstGLESWindow *window,
+                  EGLConfig config)
+{
+    GST_DEBUG_OBJECT (element, "create %s surface", window->backend->name);
+    if (window->backend->init_surface (element, window, config) < 0) {
+        GST_ERROR_OBJECT (element, "Could not create EGL surface");
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+egl_close_surface (GstElement *element, GstGLESWindow *window)
+{
+    if (window->surface) {
+        eglDestroySurface (window->egl_display, window->surface) ;
+        window->surface = NULL;
+    }
+}
+
+EGLDisplay
+egl_get_platform_display (GstElement *element, const gchar *extension,
+                          EGLenum platform, gpointer native_display)
+{
+    GetPlatformDisplayFunc get_platform_display;
+    const gchar *extensions;
+
+    /* client extensions, only available with EGL 1.5 or
+       EGL_EXT_client_extensions */
+    extensions = eglQueryString (EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (!extensions || !strstr (extensions, extension))
+        return EGL_NO_DISPLAY;
+
+    get_platform_display = (GetPlatformDisplayFunc)
+            eglGetProcAddress ("eglGetPlatformDisplayEXT");
+    if (!get_platform_display)
+        return EGL_NO_DISPLAY;
+
+    GST_DEBUG_OBJECT (element, "Using %s", extension);
+    return get_platform_display (platform, native_display, NULL);
+}
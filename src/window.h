@@ -0,0 +1,159 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _WINDOW_H__
+#define _WINDOW_H__
+
+#include <EGL/egl.h>
+
+#include <X11/Xlib.h>
+
+#include <gst/gst.h>
+
+typedef struct _GstGLESWindow         GstGLESWindow;
+typedef struct _GstGLESWindowBackend  GstGLESWindowBackend;
+
+/* window systems the sinks can render on */
+typedef enum
+{
+    GST_GLES_WINDOW_BACKEND_X11,
+    GST_GLES_WINDOW_BACKEND_HEADLESS,
+    GST_GLES_WINDOW_BACKEND_WAYLAND
+} GstGLESWindowBackendType;
+
+#define GST_GLES_WINDOW_BACKEND_COUNT (GST_GLES_WINDOW_BACKEND_WAYLAND + 1)
+
+#define GST_TYPE_GLES_WINDOW_BACKEND (gst_gles_window_backend_get_type ())
+GType gst_gles_window_backend_get_type (void);
+
+/* operations of a window system, optional ones may be NULL */
+struct _GstGLESWindowBackend
+{
+    GstGLESWindowBackendType type;
+    const gchar *name;
+    /* EGL_SURFACE_TYPE the config has to support */
+    EGLint surface_type;
+
+    /* opens the native display and gets the matching EGL display */
+    gint (*open_display) (GstElement *element, gpointer *native_display,
+                          EGLDisplay *egl_display);
+    void (*close_display) (gpointer native_display);
+
+    gint (*init) (GstElement *element, GstGLESWindow *window,
+                  gint width, gint height);
+    void (*close) (GstElement *element, GstGLESWindow *window);
+    gboolean (*handle_events) (GstElement *element, GstGLESWindow *window);
+    gint (*init_surface) (GstElement *element, GstGLESWindow *window,
+                          EGLConfig config);
+    /* serializes access to the native display, optional */
+    void (*lock) (GstGLESWindow *window);
+    void (*unlock) (GstGLESWindow *window);
+
+    /* frame pacing, optional. frame_ready returns FALSE while the last
+     * frame has not been picked up by the display server, pre_swap is
+     * called with the lock held right before the buffers are swapped */
+    gboolean (*frame_ready) (GstGLESWindow *window);
+    void (*pre_swap) (GstGLESWindow *window);
+};
+
+struct _GstGLESWindow
+{
+    const GstGLESWindowBackend *backend;
+    gpointer native_display;
+    /* window state private to the backend */
+    gpointer backend_data;
+
+    gint width;
+    gint height;
+
+    /* monotonic time the last frame was shown, as reported by the display
+     * server, GST_CLOCK_TIME_NONE if unknown */
+    GstClockTime presentation_time;
+    /* refresh period of the display as reported by the display server,
+     * 60 Hz is assumed as long as there is no report */
+    GstClockTime refresh_period;
+    /* monotonic time of the last swap in microseconds, 0 before */
+    gint64 last_swap;
+
+    /* x11 context */
+    Display *display;
+    Window window;
+    gboolean external_window;
+
+    /* egl context */
+    EGLDisplay egl_display;
+    EGLSurface surface;
+};
+
+/* returns NULL if the backend has not been compiled in */
+const GstGLESWindowBackend *
+window_get_backend (GstGLESWindowBackendType type);
+
+/* creates a window of the given size on the already opened native display,
+ * unless an external window has been set. returns 0 on success, -1 on
+ * failure */
+gint
+window_init (GstElement *element, GstGLESWindow *window,
+             const GstGLESWindowBackend *backend, gpointer native_display,
+             gint width, gint height);
+void
+window_close (GstElement *element, GstGLESWindow *window);
+/* processes pending window events, returns TRUE if the window has been
+ * resized and needs to be redrawn */
+gboolean
+window_handle_events (GstElement *element, GstGLESWindow *window);
+/* serializes access to the native display connection, which is shared by
+ * all windows. only needed around calls the backend does not lock itself */
+void
+window_lock (GstGLESWindow *window);
+void
+window_unlock (GstGLESWindow *window);
+/* FALSE while the window should not be swapped again. without vsync
+ * windows are paced to one swap per refresh period */
+gboolean
+window_frame_ready (GstGLESWindow *window, gboolean vsync);
+/* presents the rendered frame, must be called without the lock held */
+void
+window_swap_buffers (GstGLESWindow *window);
+
+/* creates the EGL surface of the window on the already initialized egl
+ * display. returns 0 on success, -1 on failure */
+gint
+egl_init_surface (GstElement *element, GstGLESWindow *window,
+                  EGLConfig config);
+void
+egl_close_surface (GstElement *element, GstGLESWindow *window);
+/* gets the display of an EGL platform if the client extension is
+ * available, EGL_NO_DISPLAY otherwise */
+EGLDisplay
+egl_get_platform_display (GstElement *element, const gchar *extension,
+                          EGLenum platform, gpointer native_display);
+
+#ifdef HAVE_WAYLAND
+extern const GstGLESWindowBackend wayland_backend;
+
+/* makes the wayland backend use the display connection of the
+ * application, required to embed into its surfaces */
+void
+window_wayland_set_display (gpointer display);
+#endif
+
+#endif
@@ -0,0 +1,478 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Pushes unsynchronized frames straight into the chain function of a
+ * glessink and reports the results as JSON on stdout. Each frame is
+ * timed from the chain call to its return. The sink publishes its frame
+ * timeline meanwhile, which splits that time into the upload with the
+ * deinterlacing pass, the scaling draw and the swap, and tells the bytes
+ * actually uploaded. The headless backend is used by default, so it runs
+ * on a build machine with mesa's llvmpipe, e.g. with make check:
+ *
+ *   GST_PLUGIN_PATH=src/.libs tools/gles-benchmark > results.json
+ *
+ * With --backend=x11 it can run against a real display or Xvfb.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <gst/gst.h>
+#if GST_CHECK_VERSION(1, 0, 0)
+#include <gst/video/videooverlay.h>
+#else
+#include <gst/interfaces/xoverlay.h>
+#endif
+
+#include "timeline.h"
+
+typedef struct
+{
+    gint width;
+    gint height;
+} Size;
+
+/* input resolutions */
+static const Size resolutions[] =
+{
+    { 352, 288 },
+    { 720, 576 },
+    { 1280, 720 },
+    { 1920, 1080 },
+};
+
+/* size of the area the video is scaled into, 0x0 for the whole window */
+static const Size render_sizes[] =
+{
+    { 0, 0 },
+    { 360, 288 },
+};
+
+/* the sink takes nothing else */
+static const gchar *formats[] = { "I420" };
+
+static gint n_frames = 300;
+static gchar *backend = "headless";
+static gchar *plugin = NULL;
+
+static GOptionEntry entries[] =
+{
+    { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Frames per configuration (default: 300)", "N" },
+    { "backend", 'b', 0, G_OPTION_ARG_STRING, &backend,
+      "Window system backend of the sink (default: headless)", "NAME" },
+    { "plugin", 'p', 0, G_OPTION_ARG_FILENAME, &plugin,
+      "Load the plugin from this file instead of the registry", "FILE" },
+    { NULL }
+};
+
+static gint
+compare_time (gconstpointer a, gconstpointer b)
+{
+    GstClockTime ta = *(const GstClockTime *) a;
+    GstClockTime tb = *(const GstClockTime *) b;
+
+    return ta < tb ? -1 : ta > tb;
+}
+
+static gdouble
+percentile_ms (GArray *times, guint percent)
+{
+    guint index;
+
+    if (!times->len)
+        return 0.0;
+
+    index = MIN (times->len - 1, times->len * percent / 100);
+    return (gdouble) g_array_index (times, GstClockTime, index) / GST_MSECOND;
+}
+
+static void
+print_percentiles (const gchar *name, GArray *times)
+{
+    g_array_sort (times, compare_time);
+    g_print ("      \"%s_ms\": { \"p50\": %.3f, \"p90\": %.3f, "
+             "\"p99\": %.3f, \"max\": %.3f },\n", name,
+             percentile_ms (times, 50), percentile_ms (times, 90),
+             percentile_ms (times, 99), percentile_ms (times, 100));
+}
+
+/* stages of the shown frames and the bytes they uploaded, taken from
+ * the timeline of the sink */
+typedef struct
+{
+    GArray *upload;
+    GArray *draw;
+    GArray *swap;
+    guint shown;
+    guint dropped;
+    guint64 bytes;
+} Stages;
+
+static void
+stage_add (GArray *times, guint64 start, guint64 end)
+{
+    GstClockTime duration;
+
+    if (!start || !end || end < start)
+        return;
+
+    duration = end - start;
+    g_array_append_val (times, duration);
+}
+
+static gchar *
+find_timeline (GstElement *sink)
+{
+    gchar *dirname = g_path_get_dirname (GST_GLES_TIMELINE_PREFIX);
+    gchar *element = gst_element_get_name (sink);
+    gchar *prefix, *path = NULL;
+    const gchar *name;
+    GDir *dir;
+
+    /* the basename of the prefix, then pid, element and instance */
+    prefix = g_strdup_printf ("%s%d-%s-", GST_GLES_TIMELINE_PREFIX
+                              + strlen (dirname) + 1, getpid (), element);
+
+    dir = g_dir_open (dirname, 0, NULL);
+    while (dir && !path && (name = g_dir_read_name (dir))) {
+        if (g_str_has_prefix (name, prefix))
+            path = g_build_filename (dirname, name, NULL);
+    }
+    if (dir)
+        g_dir_close (dir);
+
+    g_free (prefix);
+    g_free (element);
+    g_free (dirname);
+    return path;
+}
+
+/* reads the records of the last n frames. the sink is idle in between
+ * two chain calls, so they need no check against concurrent writes */
+static gboolean
+read_stages (GstElement *sink, guint n, Stages *stages)
+{
+    const GstGLESTimelineHeader *header;
+    const GstGLESTimelineRecord *records;
+    guint64 first, i;
+    struct stat st;
+    gpointer map;
+    gchar *path;
+    gint fd;
+
+    path = find_timeline (sink);
+    if (!path)
+        return FALSE;
+    fd = open (path, O_RDONLY);
+    g_free (path);
+    if (fd < 0)
+        return FALSE;
+
+    if (fstat (fd, &st) < 0 ||
+        st.st_size < (off_t) sizeof (GstGLESTimelineHeader)) {
+        close (fd);
+        return FALSE;
+    }
+    map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED)
+        return FALSE;
+
+    header = map;
+    if (header->magic != GST_GLES_TIMELINE_MAGIC ||
+        header->version != GST_GLES_TIMELINE_VERSION ||
+        header->record_size != sizeof (GstGLESTimelineRecord) ||
+        sizeof (GstGLESTimelineHeader) + (gsize) header->n_records *
+        header->record_size > (gsize) st.st_size) {
+        munmap (map, st.st_size);
+        return FALSE;
+    }
+
+    /* longer runs only have the latest frames in the ring */
+    records = (const GstGLESTimelineRecord *) (header + 1);
+    n = MIN (n, header->n_records);
+    first = header->write_index > n ? header->write_index - n : 0;
+
+    for (i = first; i < header->write_index; i++) {
+        const GstGLESTimelineRecord *r = &records[i % header->n_records];
+
+        if (r->drop != GST_GLES_TIMELINE_SHOWN) {
+            stages->dropped++;
+            continue;
+        }
+        stage_add (stages->upload, r->upload_start, r->upload_end);
+        stage_add (stages->draw, r->upload_end, r->draw_end);
+        stage_add (stages->swap, r->draw_end, r->swap_end);
+        stages->bytes += r->upload_bytes;
+        stages->shown++;
+    }
+
+    munmap (map, st.st_size);
+    return TRUE;
+}
+
+static GstClockTime
+cpu_time (void)
+{
+    struct rusage usage;
+
+    getrusage (RUSAGE_SELF, &usage);
+    return GST_TIMEVAL_TO_TIME (usage.ru_utime) +
+           GST_TIMEVAL_TO_TIME (usage.ru_stime);
+}
+
+/* a luma ramp which moves with every frame, so nothing can be cached */
+static GstBuffer *
+create_frame (gint width, gint height, gint frame)
+{
+    gsize y_size = width * height;
+    GstBuffer *buf;
+    guint8 *data;
+    gint x, y;
+#if GST_CHECK_VERSION(1, 0, 0)
+    GstMapInfo map;
+
+    buf = gst_buffer_new_and_alloc (y_size * 3 / 2);
+    gst_buffer_map (buf, &map, GST_MAP_WRITE);
+    data = map.data;
+#else
+    buf = gst_buffer_new_and_alloc (y_size * 3 / 2);
+    data = GST_BUFFER_DATA (buf);
+#endif
+
+    for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+            data[y * width + x] = x + y + frame * 8;
+    memset (data + y_size, 128, y_size / 2);
+
+#if GST_CHECK_VERSION(1, 0, 0)
+    gst_buffer_unmap (buf, &map);
+#endif
+    return buf;
+}
+
+static GstCaps *
+create_caps (const gchar *format, gint width, gint height)
+{
+#if GST_CHECK_VERSION(1, 0, 0)
+    return gst_caps_new_simple ("video/x-raw",
+                                "format", G_TYPE_STRING, format,
+                                "width", G_TYPE_INT, width,
+                                "height", G_TYPE_INT, height,
+                                "framerate", GST_TYPE_FRACTION, 0, 1,
+                                "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1,
+                                NULL);
+#else
+    return gst_caps_new_simple ("video/x-raw-yuv",
+                                "format", GST_TYPE_FOURCC,
+                                GST_STR_FOURCC (format),
+                                "width", G_TYPE_INT, width,
+                                "height", G_TYPE_INT, height,
+                                "framerate", GST_TYPE_FRACTION, 0, 1,
+                                "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1,
+                                NULL);
+#endif
+}
+
+static void
+start_stream (GstPad *pad, GstCaps *caps)
+{
+#if GST_CHECK_VERSION(1, 0, 0)
+    GstSegment segment;
+
+    gst_pad_send_event (pad, gst_event_new_stream_start ("gles-benchmark"));
+    gst_pad_send_event (pad, gst_event_new_caps (caps));
+    gst_segment_init (&segment, GST_FORMAT_TIME);
+    gst_pad_send_event (pad, gst_event_new_segment (&segment));
+#else
+    gst_pad_send_event (pad, gst_event_new_new_segment (FALSE, 1.0,
+                        GST_FORMAT_TIME, 0, -1, 0));
+#endif
+}
+
+static gboolean
+run (const gchar *format, const Size *size, const Size *render_size,
+     gboolean first)
+{
+    GstElement *sink;
+    GstCaps *caps;
+    GstPad *pad;
+    GstBuffer *frames[2];
+    GArray *times;
+    Stages stages = { NULL, };
+    GstClockTime start, stop, cpu_start, cpu_stop, last;
+    gint i;
+
+    sink = gst_element_factory_make ("glessink", NULL);
+    if (!sink) {
+        g_printerr ("glessink not found, set GST_PLUGIN_PATH or use "
+                    "--plugin\n");
+        return FALSE;
+    }
+
+    g_object_set (sink, "sync", FALSE, "qos", FALSE, "timeline", TRUE, NULL);
+    gst_util_set_object_arg (G_OBJECT (sink), "backend", backend);
+    if (render_size->width)
+#if GST_CHECK_VERSION(1, 0, 0)
+        gst_video_overlay_set_render_rectangle (GST_VIDEO_OVERLAY (sink), 0, 0,
+                                                render_size->width,
+                                                render_size->height);
+#else
+        gst_x_overlay_set_render_rectangle (GST_X_OVERLAY (sink), 0, 0,
+                                            render_size->width,
+                                            render_size->height);
+#endif
+
+    caps = create_caps (format, size->width, size->height);
+    for (i = 0; i < G_N_ELEMENTS (frames); i++) {
+        frames[i] = create_frame (size->width, size->height, i);
+#if !GST_CHECK_VERSION(1, 0, 0)
+        gst_buffer_set_caps (frames[i], caps);
+#endif
+    }
+
+    pad = gst_element_get_static_pad (sink, "sink");
+    gst_element_set_state (sink, GST_STATE_PLAYING);
+    start_stream (pad, caps);
+
+    /* the first frame creates the window, context and textures */
+    gst_pad_chain (pad, gst_buffer_ref (frames[0]));
+
+    times = g_array_sized_new (FALSE, FALSE, sizeof (GstClockTime),
+                               n_frames);
+    cpu_start = cpu_time ();
+    start = last = gst_util_get_timestamp ();
+
+    for (i = 0; i < n_frames; i++) {
+        GstBuffer *buf = gst_buffer_ref (frames[i % G_N_ELEMENTS (frames)]);
+        GstClockTime now, elapsed;
+
+        GST_BUFFER_TIMESTAMP (buf) = i * GST_MSECOND;
+        if (gst_pad_chain (pad, buf) != GST_FLOW_OK) {
+            g_printerr ("Rendering failed\n");
+            break;
+        }
+
+        now = gst_util_get_timestamp ();
+        elapsed = now - last;
+        g_array_append_val (times, elapsed);
+        last = now;
+    }
+
+    stop = gst_util_get_timestamp ();
+    cpu_stop = cpu_time ();
+
+    /* the timeline goes away with the sink */
+    stages.upload = g_array_new (FALSE, FALSE, sizeof (GstClockTime));
+    stages.draw = g_array_new (FALSE, FALSE, sizeof (GstClockTime));
+    stages.swap = g_array_new (FALSE, FALSE, sizeof (GstClockTime));
+    if (!read_stages (sink, times->len, &stages))
+        g_printerr ("No frame timeline, stages are not reported\n");
+
+    gst_element_set_state (sink, GST_STATE_NULL);
+    gst_object_unref (pad);
+    gst_object_unref (sink);
+    for (i = 0; i < G_N_ELEMENTS (frames); i++)
+        gst_buffer_unref (frames[i]);
+    gst_caps_unref (caps);
+
+    g_print ("%s    {\n", first ? "" : ",\n");
+    g_print ("      \"format\": \"%s\",\n", format);
+    g_print ("      \"width\": %d,\n", size->width);
+    g_print ("      \"height\": %d,\n", size->height);
+    g_print ("      \"render_width\": %d,\n", render_size->width);
+    g_print ("      \"render_height\": %d,\n", render_size->height);
+    g_print ("      \"frames\": %u,\n", times->len);
+    g_print ("      \"fps\": %.2f,\n", stop > start ?
+             (gdouble) times->len * GST_SECOND / (stop - start) : 0.0);
+    g_print ("      \"dropped\": %u,\n", stages.dropped);
+    print_percentiles ("render", times);
+    print_percentiles ("upload", stages.upload);
+    print_percentiles ("draw", stages.draw);
+    print_percentiles ("swap", stages.swap);
+    g_print ("      \"cpu_ms_per_frame\": %.3f,\n", times->len ?
+             (gdouble) (cpu_stop - cpu_start) / GST_MSECOND / times->len :
+             0.0);
+    g_print ("      \"bytes_per_frame\": %" G_GUINT64_FORMAT "\n",
+             stages.shown ? stages.bytes / stages.shown : 0);
+    g_print ("    }");
+
+    g_array_free (stages.upload, TRUE);
+    g_array_free (stages.draw, TRUE);
+    g_array_free (stages.swap, TRUE);
+    g_array_free (times, TRUE);
+    return TRUE;
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    gboolean first = TRUE;
+    guint f, r, s;
+
+    context = g_option_context_new ("- benchmark the glessink render path");
+    g_option_context_add_main_entries (context, entries, NULL);
+    g_option_context_add_group (context, gst_init_get_option_group ());
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("%s\n", error->message);
+        g_error_free (error);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free (context);
+
+    if (plugin && !gst_plugin_load_file (plugin, &error)) {
+        g_printerr ("Could not load %s: %s\n", plugin, error->message);
+        g_error_free (error);
+        return EXIT_FAILURE;
+    }
+
+    g_print ("{\n  \"backend\": \"%s\",\n  \"frames\": %d,\n"
+             "  \"results\": [\n", backend, n_frames);
+
+    for (f = 0; f < G_N_ELEMENTS (formats); f++) {
+        for (r = 0; r < G_N_ELEMENTS (resolutions); r++) {
+            for (s = 0; s < G_N_ELEMENTS (render_sizes); s++) {
+                if (!run (formats[f], &resolutions[r], &render_sizes[s],
+                          first))
+                    return EXIT_FAILURE;
+                first = FALSE;
+            }
+        }
+    }
+
+    g_print ("\n  ]\n}\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,287 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Julian Scheel <julian@jusst.de>
+ * Copyright (C) 2011 Soeren Grunewald <soeren.grunewald@avionic-design.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Reads the frame timelines glessink publishes with timeline=true. By
+ * default all timelines in /dev/shm are summarized, --dump prints every
+ * record which is still in the ring:
+ *
+ *   gles-timeline [--dump] [FILE...]
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "timeline.h"
+
+static gboolean dump = FALSE;
+
+static GOptionEntry entries[] =
+{
+    { "dump", 'd', 0, G_OPTION_ARG_NONE, &dump,
+      "Print every record instead of a summary", NULL },
+    { NULL }
+};
+
+static const gchar *drop_names[] =
+{
+    "shown", "drop-first", "decimated", "late", "not-ready", "no-memory",
+    "error"
+};
+
+typedef struct
+{
+    guint64 count;
+    guint64 sum;
+    guint64 max;
+} Stage;
+
+static void
+stage_add (Stage *stage, guint64 start, guint64 end)
+{
+    guint64 duration;
+
+    if (!start || !end || end < start)
+        return;
+
+    duration = end - start;
+    stage->count++;
+    stage->sum += duration;
+    stage->max = MAX (stage->max, duration);
+}
+
+static void
+stage_print (const gchar *name, const Stage *stage, gboolean last)
+{
+    g_print ("      \"%s\": { \"mean_ms\": %.3f, \"max_ms\": %.3f }%s\n",
+             name, stage->count ?
+             (gdouble) stage->sum / stage->count / GST_MSECOND : 0.0,
+             (gdouble) stage->max / GST_MSECOND, last ? "" : ",");
+}
+
+/* copies the records still in the ring, skipping the one which is
+ * being written right now */
+static guint
+read_records (const GstGLESTimelineHeader *header,
+              GstGLESTimelineRecord *out)
+{
+    const GstGLESTimelineRecord *records;
+    guint64 write_index, first, i;
+    guint n = 0;
+
+    records = (const GstGLESTimelineRecord *) (header + 1);
+    write_index = header->write_index;
+    first = write_index > header->n_records ?
+            write_index - header->n_records : 0;
+
+    for (i = first; i < write_index; i++) {
+        const GstGLESTimelineRecord *record;
+
+        record = &records[i % header->n_records];
+        if (record->seq != i + 1)
+            continue;
+        __sync_synchronize ();
+        out[n] = *record;
+        __sync_synchronize ();
+        if (record->seq != i + 1)
+            continue;
+        n++;
+    }
+
+    return n;
+}
+
+static void
+print_dump (const GstGLESTimelineHeader *header,
+            const GstGLESTimelineRecord *records, guint n)
+{
+    guint i;
+
+    for (i = 0; i < n; i++) {
+        const GstGLESTimelineRecord *r = &records[i];
+
+        g_print ("%u %s seq=%" G_GUINT64_FORMAT " pts=%" GST_TIME_FORMAT
+                 " arrival=%" G_GUINT64_FORMAT " upload=%" G_GUINT64_FORMAT
+                 "..%" G_GUINT64_FORMAT " draw=%" G_GUINT64_FORMAT
+                 " swap=%" G_GUINT64_FORMAT " bytes=%u %s\n", header->pid,
+                 header->name, r->seq, GST_TIME_ARGS (r->pts), r->arrival,
+                 r->upload_start, r->upload_end, r->draw_end, r->swap_end,
+                 r->upload_bytes,
+                 r->drop < G_N_ELEMENTS (drop_names) ?
+                 drop_names[r->drop] : "unknown");
+    }
+}
+
+static void
+print_summary (const gchar *path, const GstGLESTimelineHeader *header,
+               const GstGLESTimelineRecord *records, guint n, gboolean first)
+{
+    guint64 drops[G_N_ELEMENTS (drop_names)] = { 0, };
+    Stage upload = { 0, }, draw = { 0, }, swap = { 0, }, total = { 0, };
+    guint i;
+
+    for (i = 0; i < n; i++) {
+        const GstGLESTimelineRecord *r = &records[i];
+
+        if (r->drop < G_N_ELEMENTS (drops))
+            drops[r->drop]++;
+        stage_add (&upload, r->upload_start, r->upload_end);
+        stage_add (&draw, r->upload_end, r->draw_end);
+        stage_add (&swap, r->draw_end, r->swap_end);
+        stage_add (&total, r->arrival, r->swap_end);
+    }
+
+    g_print ("%s    {\n", first ? "" : ",\n");
+    g_print ("      \"file\": \"%s\",\n", path);
+    g_print ("      \"pid\": %u,\n", header->pid);
+    g_print ("      \"element\": \"%s\",\n", header->name);
+    g_print ("      \"frames_total\": %" G_GUINT64_FORMAT ",\n",
+             header->write_index);
+    g_print ("      \"records\": %u,\n", n);
+    g_print ("      \"drops\": {");
+    for (i = 0; i < G_N_ELEMENTS (drop_names); i++)
+        g_print (" \"%s\": %" G_GUINT64_FORMAT "%s", drop_names[i], drops[i],
+                 i + 1 < G_N_ELEMENTS (drop_names) ? "," : " },\n");
+    stage_print ("upload", &upload, FALSE);
+    stage_print ("draw", &draw, FALSE);
+    stage_print ("swap", &swap, FALSE);
+    stage_print ("total", &total, TRUE);
+    g_print ("    }");
+}
+
+static gboolean
+read_timeline (const gchar *path, gboolean first)
+{
+    const GstGLESTimelineHeader *header;
+    GstGLESTimelineRecord *records;
+    struct stat st;
+    gpointer map;
+    guint n;
+    gint fd;
+
+    fd = open (path, O_RDONLY);
+    if (fd < 0)
+        return FALSE;
+
+    if (fstat (fd, &st) < 0 ||
+        st.st_size < (off_t) sizeof (GstGLESTimelineHeader)) {
+        close (fd);
+        return FALSE;
+    }
+
+    map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED)
+        return FALSE;
+
+    header = map;
+    if (header->magic != GST_GLES_TIMELINE_MAGIC ||
+        header->version != GST_GLES_TIMELINE_VERSION ||
+        header->record_size != sizeof (GstGLESTimelineRecord) ||
+        sizeof (GstGLESTimelineHeader) + (gsize) header->n_records *
+        header->record_size > (gsize) st.st_size) {
+        g_printerr ("%s: not a timeline of this version\n", path);
+        munmap (map, st.st_size);
+        return FALSE;
+    }
+
+    records = g_new (GstGLESTimelineRecord, header->n_records);
+    n = read_records (header, records);
+
+    if (dump)
+        print_dump (header, records, n);
+    else
+        print_summary (path, header, records, n, first);
+
+    g_free (records);
+    munmap (map, st.st_size);
+    return TRUE;
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    GPtrArray *files;
+    gboolean first = TRUE;
+    guint i;
+
+    context = g_option_context_new ("[FILE...] - read glessink frame "
+                                    "timelines");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("%s\n", error->message);
+        g_error_free (error);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free (context);
+
+    files = g_ptr_array_new_with_free_func (g_free);
+    if (argc > 1) {
+        for (i = 1; i < argc; i++)
+            g_ptr_array_add (files, g_strdup (argv[i]));
+    } else {
+        gchar *dirname = g_path_get_dirname (GST_GLES_TIMELINE_PREFIX);
+        gchar *prefix = g_path_get_basename (GST_GLES_TIMELINE_PREFIX "x");
+        const gchar *name;
+        GDir *dir;
+
+        /* basename of the prefix without the placeholder */
+        prefix[strlen (prefix) - 1] = '\0';
+
+        dir = g_dir_open (dirname, 0, NULL);
+        while (dir && (name = g_dir_read_name (dir))) {
+            if (g_str_has_prefix (name, prefix))
+                g_ptr_array_add (files, g_build_filename (dirname, name,
+                                                          NULL));
+        }
+        if (dir)
+            g_dir_close (dir);
+        g_free (prefix);
+        g_free (dirname);
+    }
+
+    if (!dump)
+        g_print ("{\n  \"timelines\": [\n");
+
+    for (i = 0; i < files->len; i++) {
+        if (read_timeline (g_ptr_array_index (files, i), first))
+            first = FALSE;
+    }
+
+    if (!dump)
+        g_print ("%s  ]\n}\n", first ? "" : "\n");
+
+    g_ptr_array_free (files, TRUE);
+    return EXIT_SUCCESS;
+}